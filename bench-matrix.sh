@@ -0,0 +1,89 @@
+#!/bin/sh
+#
+# Runs the benchmark programs under every combination of page allocator and
+# scheduler, several times each, and prints a table comparing them.  Each run is
+# a fresh headless boot through run-bench.sh, so this only needs QEMU, and works
+# offline.
+#
+#   MATRIX_PGALLOC   the page allocators to compare (default: "simple buddy")
+#   MATRIX_SCHED     the schedulers to compare (default: "cfs rr mlfq stride")
+#   MATRIX_PROGRAMS  the benchmark programs to run (default: "tarfsbench schedbench clockbench")
+#   MATRIX_RUNS      how many times to boot each combination (default: 3)
+#   MATRIX_OUT       where the results of each run are kept (default: bench-matrix),
+#                    which is emptied first if an earlier matrix made it
+#   MATRIX_NO_BUILD=1  use the kernel and programs as they are, without running build.sh
+#
+# BENCH_TIMEOUT and BENCH_PACK are passed through to run-bench.sh, and any
+# arguments are added to every kernel command line.  fifo isn't in the default
+# schedulers, as it never preempts the CPU-bound threads in schedbench.
+#
+# Results are kept in $MATRIX_OUT/<program>/<pgalloc>-<sched>/run<N>.txt, and the
+# table can be printed again from them (e.g. with other metrics) with:
+#
+#   tools/bench-table.py -m cycles,p99 bench-matrix
+#
+
+TOP="`pwd`"
+MATRIX_PGALLOC=${MATRIX_PGALLOC:-simple buddy}
+MATRIX_SCHED=${MATRIX_SCHED:-cfs rr mlfq stride}
+MATRIX_PROGRAMS=${MATRIX_PROGRAMS:-tarfsbench schedbench clockbench}
+MATRIX_RUNS=${MATRIX_RUNS:-3}
+MATRIX_OUT="${MATRIX_OUT:-$TOP/bench-matrix}"
+QEMU=qemu-system-x86_64
+
+if ! command -v $QEMU >/dev/null; then
+	echo "$QEMU not found" >&2
+	exit 1
+fi
+
+if [ "$MATRIX_NO_BUILD" != "1" ]; then
+	./build.sh || exit 1
+fi
+
+# Results from an earlier matrix would be mixed in with these, so they go, but
+# only from a directory this script made, which it marks when it does.
+MARKER=.bench-matrix
+
+if [ -e "$MATRIX_OUT" ]; then
+	if [ -f "$MATRIX_OUT/$MARKER" ]; then
+		rm -rf "$MATRIX_OUT"
+	elif [ -d "$MATRIX_OUT" ] && [ -z "`ls -A "$MATRIX_OUT"`" ]; then
+		rmdir "$MATRIX_OUT"
+	else
+		echo "$MATRIX_OUT exists, but wasn't made by bench-matrix.sh; not overwriting it" >&2
+		exit 1
+	fi
+fi
+
+mkdir -p "$MATRIX_OUT" && touch "$MATRIX_OUT/$MARKER" || exit 1
+
+failed=0
+for program in $MATRIX_PROGRAMS; do
+	for pgalloc in $MATRIX_PGALLOC; do
+		for sched in $MATRIX_SCHED; do
+			dir="$MATRIX_OUT/$program/$pgalloc-$sched"
+			mkdir -p "$dir" || exit 1
+
+			run=1
+			while [ $run -le $MATRIX_RUNS ]; do
+				echo "$program: pgalloc=$pgalloc sched=$sched run $run/$MATRIX_RUNS" >&2
+
+				BENCH_PROGRAM=$program BENCH_PGALLOC=$pgalloc BENCH_SCHED=$sched BENCH_OUT="$dir/run$run.txt" \
+					./run-bench.sh "$@" >/dev/null
+
+				if ! grep -qs "^BENCH [a-z]*\.done" "$dir/run$run.txt"; then
+					failed=$((failed + 1))
+				fi
+
+				run=$((run + 1))
+			done
+		done
+	done
+done
+
+python3 "$TOP/tools/bench-table.py" "$MATRIX_OUT" || exit 1
+
+if [ $failed -ne 0 ]; then
+	echo "$failed runs did not finish" >&2
+	exit 1
+fi
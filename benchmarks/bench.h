@@ -0,0 +1,254 @@
+/*
+ * Benchmark Helpers
+ *
+ * Shared by the user-space benchmark programs.  Results are printed to the
+ * screen, and also written to the QEMU debug console through /.stats/console,
+ * one line per result, so that they can be collected on the host:
+ *
+ *   BENCH <suite>.<name> key=value key=value ...
+ *
+ * Times are in TSC cycles, as there is no finer clock available to user programs.
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <infos.h>
+
+static inline uint64_t bench_cycles()
+{
+	uint32_t lo, hi;
+	asm volatile("lfence; rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * A fixed-seed xorshift generator, so that every run does the same work.
+ */
+struct BenchRandom {
+	uint64_t state;
+
+	BenchRandom(uint64_t seed = 0x2545f4914f6cdd1dULL) : state(seed) {
+	}
+
+	uint64_t next() {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+};
+
+/**
+ * Per-operation latencies, from which percentiles are reported.
+ */
+struct BenchSamples {
+	uint64_t *values;
+	unsigned int count, capacity;
+
+	BenchSamples(unsigned int capacity) : values(NULL), count(0), capacity(capacity) {
+		values = (uint64_t *)malloc(capacity * sizeof(uint64_t));
+	}
+
+	~BenchSamples() {
+		free(values);
+	}
+
+	void add(uint64_t value) {
+		if (count < capacity) {
+			values[count++] = value;
+		}
+	}
+
+	/* Sorts the samples (a shell sort, which is plenty for a few thousand) */
+	void sort() {
+		for (unsigned int gap = count / 2; gap > 0; gap /= 2) {
+			for (unsigned int i = gap; i < count; i++) {
+				uint64_t v = values[i];
+				unsigned int j = i;
+				for (; j >= gap && values[j - gap] > v; j -= gap) {
+					values[j] = values[j - gap];
+				}
+				values[j] = v;
+			}
+		}
+	}
+
+	/* Returns the given percentile, once the samples have been sorted */
+	uint64_t percentile(unsigned int pct) const {
+		if (count == 0) return 0;
+
+		unsigned int index = (count * pct) / 100;
+		return values[index < count ? index : count - 1];
+	}
+};
+
+/**
+ * Reads a counter from one of the kernel's stats files, which are made up of
+ * "name value" lines.
+ * @param file The name of the stats file, within /.stats.
+ * @param key The name of the counter.
+ * @return Returns the value of the counter, or zero if it could not be read.
+ */
+static uint64_t bench_stat(const char *file, const char *key)
+{
+	char path[64];
+	sprintf(path, "/.stats/%s", file);
+
+	HFILE f = open(path, 0);
+	if (is_error(f)) {
+		return 0;
+	}
+
+	static char buffer[8192];
+	int n = read(f, buffer, sizeof(buffer) - 1);
+	close(f);
+
+	if (n <= 0) {
+		return 0;
+	}
+	buffer[n] = 0;
+
+	int key_len = strlen(key);
+	for (char *line = buffer; *line; ) {
+		if (strncmp(line, key, key_len) == 0 && line[key_len] == ' ') {
+			uint64_t value = 0;
+			for (char *p = line + key_len + 1; *p >= '0' && *p <= '9'; p++) {
+				value = (value * 10) + (*p - '0');
+			}
+			return value;
+		}
+
+		while (*line && *line != '\n') line++;
+		if (*line) line++;
+	}
+
+	return 0;
+}
+
+/**
+ * Writes to one of the kernel's control files, e.g. to change the calling
+ * thread's priority with bench_control("prio", "4").
+ * @return Returns TRUE if the kernel accepted the write.
+ */
+static bool bench_control(const char *file, const char *text)
+{
+	char path[64];
+	sprintf(path, "/.stats/%s", file);
+
+	HFILE f = open(path, 0);
+	if (is_error(f)) {
+		return false;
+	}
+
+	int n = write(f, text, strlen(text));
+	close(f);
+
+	return n > 0;
+}
+
+/**
+ * Writes a line of results to the screen and to the debug console.
+ */
+static void bench_emit(const char *line)
+{
+	printf("%s\n", line);
+
+	HFILE console = open("/.stats/console", 0);
+	if (!is_error(console)) {
+		write(console, line, strlen(line));
+		write(console, "\n", 1);
+		close(console);
+	}
+}
+
+/**
+ * Reports the results of one benchmark.
+ * @param name The name of the benchmark, including the suite.
+ * @param samples The per-operation latencies, which are sorted by this function.
+ * @param bytes The number of bytes transferred, or zero if not applicable.
+ * @param cycles The total time taken.
+ * @param dev_reads The number of device reads the benchmark caused.
+ */
+static void bench_report(const char *name, BenchSamples& samples, uint64_t bytes, uint64_t cycles, uint64_t dev_reads)
+{
+	samples.sort();
+
+	// Rates are scaled up so that they can be printed as integers.
+	uint64_t ops = samples.count;
+	uint64_t bytes_per_kcycle = cycles ? (bytes * 1000) / cycles : 0;
+	uint64_t dev_reads_per_kop = ops ? (dev_reads * 1000) / ops : 0;
+
+	char line[512];
+	sprintf(line, "BENCH %s ops=%lu bytes=%lu cycles=%lu bytes_per_kcycle=%lu p50=%lu p90=%lu p99=%lu max=%lu dev_reads=%lu dev_reads_per_kop=%lu",
+		name, ops, bytes, cycles, bytes_per_kcycle,
+		samples.percentile(50), samples.percentile(90), samples.percentile(99), samples.percentile(100),
+		dev_reads, dev_reads_per_kop);
+
+	bench_emit(line);
+}
+
+/**
+ * One of the benchmarks in a program, which can be picked by name on the
+ * program's command line.
+ */
+struct Benchmark {
+	const char *name;
+	void (*run)();
+};
+
+/**
+ * Checks whether a benchmark was asked for on the command line.  With no
+ * arguments, every benchmark is.
+ */
+static bool bench_selected(const char *cmdline, const char *name)
+{
+	if (!cmdline || !*cmdline) {
+		return true;
+	}
+
+	int len = strlen(name);
+	for (const char *p = cmdline; *p; ) {
+		while (*p == ' ') p++;
+
+		if (strncmp(p, name, len) == 0 && (p[len] == ' ' || p[len] == 0)) {
+			return true;
+		}
+
+		while (*p && *p != ' ') p++;
+	}
+
+	return false;
+}
+
+/**
+ * Runs the selected benchmarks of a program, between "BENCH <suite>.start" and
+ * "BENCH <suite>.done" lines, the last of which tells the host it can stop.
+ * @param suite The name of the suite, which prefixes every result.
+ * @param benchmarks The program's benchmarks, in the order they are run.
+ * @param cmdline The program's command line.
+ */
+template<unsigned int N>
+static int bench_main(const char *suite, const Benchmark (&benchmarks)[N], const char *cmdline)
+{
+	char line[64];
+
+	sprintf(line, "BENCH %s.start", suite);
+	bench_emit(line);
+
+	for (unsigned int i = 0; i < N; i++) {
+		if (bench_selected(cmdline, benchmarks[i].name)) {
+			benchmarks[i].run();
+		}
+	}
+
+	sprintf(line, "BENCH %s.done", suite);
+	bench_emit(line);
+
+	return 0;
+}
+
+#endif /* BENCH_H */
@@ -0,0 +1,93 @@
+/*
+ * Clock Benchmarks
+ *
+ * Measures the cost of reading the time from user space.  With no arguments
+ * every benchmark is run; otherwise only the named ones are, e.g.
+ * "clockbench gettime".
+ *
+ *   gettime   clock_gettime(), which reads the kernel's time page once it has
+ *             been mapped, and checks that the monotonic clock never goes
+ *             backwards
+ *   stats     reading the time from /.stats/clock, which is a system call (and
+ *             a formatted stats file) per reading, for comparison
+ *   rtc       reading /.stats/rtc, which formats the RTC driver's cached time
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos.h>
+#include "../bench.h"
+#include "../clock.h"
+
+#define NR_READS		1000
+#define NR_PAGE_READS		10000
+
+static void bench_gettime()
+{
+	// the first reading maps the page, which isn't what is being measured
+	clock_gettime_ns(CLOCK_MONOTONIC);
+
+	BenchSamples samples(NR_PAGE_READS);
+	uint64_t backwards = 0, last = 0;
+
+	uint64_t start = bench_cycles();
+	for (unsigned int i = 0; i < NR_PAGE_READS; i++) {
+		uint64_t before = bench_cycles();
+		uint64_t now = clock_gettime_ns(CLOCK_MONOTONIC);
+		samples.add(bench_cycles() - before);
+
+		if (now < last) {
+			backwards++;
+		}
+		last = now;
+	}
+	uint64_t cycles = bench_cycles() - start;
+
+	bench_report("clock.gettime", samples, 0, cycles, 0);
+
+	char line[256];
+	sprintf(line, "BENCH clock.gettime_check mapped=%u backwards=%lu", clock_time_page() ? 1 : 0, backwards);
+	bench_emit(line);
+}
+
+static void bench_stats()
+{
+	BenchSamples samples(NR_READS);
+
+	uint64_t start = bench_cycles();
+	for (unsigned int i = 0; i < NR_READS; i++) {
+		uint64_t before = bench_cycles();
+		bench_stat("clock", "monotonic_ns");
+		samples.add(bench_cycles() - before);
+	}
+	uint64_t cycles = bench_cycles() - start;
+
+	bench_report("clock.stats", samples, 0, cycles, 0);
+}
+
+static void bench_rtc()
+{
+	BenchSamples samples(NR_READS);
+
+	uint64_t start = bench_cycles();
+	for (unsigned int i = 0; i < NR_READS; i++) {
+		uint64_t before = bench_cycles();
+		bench_stat("rtc", "updates");
+		samples.add(bench_cycles() - before);
+	}
+	uint64_t cycles = bench_cycles() - start;
+
+	bench_report("clock.rtc", samples, 0, cycles, 0);
+}
+
+static const Benchmark benchmarks[] = {
+	{ "gettime", bench_gettime },
+	{ "stats", bench_stats },
+	{ "rtc", bench_rtc },
+};
+
+int main(const char *cmdline)
+{
+	return bench_main("clock", benchmarks, cmdline);
+}
@@ -0,0 +1,214 @@
+/*
+ * Scheduler Benchmarks
+ *
+ * Runs under whichever scheduler the kernel was booted with (sched.algorithm=),
+ * so that the same numbers can be compared across schedulers.  With no arguments
+ * every benchmark is run; otherwise only the named ones are, e.g.
+ * "schedbench interactive".
+ *
+ *   interactive   response time of a thread that sleeps and does a short burst
+ *                 of work, while CPU-bound threads compete with it
+ *   share         CPU share of CPU-bound threads holding 1, 2 and 3 shares of
+ *                 tickets, against the share their tickets entitle them to
+ *
+ * The CPU-bound threads never block, so under fifo the benchmark never finishes.
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos.h>
+#include "../bench.h"
+
+#define NR_HOGS			4
+#define NR_WAKEUPS		500
+#define SLEEP_US		1000
+#define BURST_ITERATIONS	10000
+#define NR_SHARE_PERIODS	20
+#define SHARE_PERIOD_US		100000
+
+static volatile bool hogs_stop;
+static volatile uint64_t hog_iterations[NR_HOGS];
+
+/**
+ * Spins until told to stop, counting how far it got.
+ */
+static void hog(void *arg)
+{
+	volatile uint64_t *iterations = (volatile uint64_t *)arg;
+
+	while (!hogs_stop) {
+		(*iterations)++;
+	}
+}
+
+/**
+ * A short burst of work, standing in for handling an event.
+ */
+static void burst()
+{
+	volatile uint64_t x = 0;
+	for (unsigned int i = 0; i < BURST_ITERATIONS; i++) {
+		x += i;
+	}
+}
+
+static void bench_interactive()
+{
+	HTHREAD hogs[NR_HOGS];
+
+	hogs_stop = false;
+	for (unsigned int i = 0; i < NR_HOGS; i++) {
+		hog_iterations[i] = 0;
+		hogs[i] = create_thread(hog, (void *)&hog_iterations[i]);
+	}
+
+	BenchSamples samples(NR_WAKEUPS);
+	uint64_t start = bench_cycles();
+
+	// Each sample is the time from going to sleep to finishing the burst that
+	// follows, so it includes the wait to be scheduled after waking.
+	for (unsigned int i = 0; i < NR_WAKEUPS; i++) {
+		uint64_t t = bench_cycles();
+		usleep(SLEEP_US);
+		burst();
+		samples.add(bench_cycles() - t);
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+
+	hogs_stop = true;
+	uint64_t iterations = 0;
+	for (unsigned int i = 0; i < NR_HOGS; i++) {
+		join_thread(hogs[i]);
+		iterations += hog_iterations[i];
+	}
+
+	bench_report("sched.interactive", samples, 0, cycles, 0);
+
+	// How much the CPU-bound threads got done in the meantime.
+	char line[128];
+	sprintf(line, "BENCH sched.interactive_hogs threads=%u iterations=%lu", NR_HOGS, iterations);
+	bench_emit(line);
+}
+
+// The tickets of each of the threads in the share benchmark.
+static const unsigned int share_tickets[] = { 100, 200, 300 };
+
+#define NR_SHARERS (sizeof(share_tickets) / sizeof(share_tickets[0]))
+
+struct Sharer {
+	unsigned int tickets;
+	volatile bool ready;
+	volatile uint64_t iterations;
+};
+
+static Sharer sharers[NR_SHARERS];
+
+/**
+ * Takes its tickets, then spins like a hog.
+ */
+static void sharer(void *arg)
+{
+	Sharer *s = (Sharer *)arg;
+
+	char tickets[16];
+	sprintf(tickets, "%u", s->tickets);
+	if (!bench_control("stride", tickets)) {
+		printf("schedbench: unable to set tickets (not running under stride?)\n");
+	}
+	s->ready = true;
+
+	while (!hogs_stop) {
+		s->iterations++;
+	}
+}
+
+static void bench_share()
+{
+	HTHREAD threads[NR_SHARERS];
+	unsigned int total_tickets = 0;
+
+	hogs_stop = false;
+	for (unsigned int i = 0; i < NR_SHARERS; i++) {
+		sharers[i].tickets = share_tickets[i];
+		sharers[i].ready = false;
+		sharers[i].iterations = 0;
+		total_tickets += share_tickets[i];
+
+		threads[i] = create_thread(sharer, &sharers[i]);
+	}
+
+	for (unsigned int i = 0; i < NR_SHARERS; i++) {
+		while (!sharers[i].ready) {
+			usleep(SLEEP_US);
+		}
+	}
+
+	// Only count from when every thread has its tickets.
+	uint64_t base[NR_SHARERS];
+	for (unsigned int i = 0; i < NR_SHARERS; i++) {
+		base[i] = sharers[i].iterations;
+	}
+
+	// Each sample is the largest error in any thread's share over the whole run
+	// so far, in parts per thousand, taken every period.
+	BenchSamples samples(NR_SHARE_PERIODS);
+	uint64_t start = bench_cycles();
+	uint64_t done[NR_SHARERS];
+
+	for (unsigned int period = 0; period < NR_SHARE_PERIODS; period++) {
+		usleep(SHARE_PERIOD_US);
+
+		uint64_t total = 0;
+		for (unsigned int i = 0; i < NR_SHARERS; i++) {
+			done[i] = sharers[i].iterations - base[i];
+			total += done[i];
+		}
+
+		uint64_t max_error = 0;
+		for (unsigned int i = 0; i < NR_SHARERS && total; i++) {
+			uint64_t share = (done[i] * 1000) / total;
+			uint64_t expected = (share_tickets[i] * 1000) / total_tickets;
+			uint64_t error = share > expected ? share - expected : expected - share;
+
+			if (error > max_error) {
+				max_error = error;
+			}
+		}
+
+		samples.add(max_error);
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+
+	hogs_stop = true;
+	for (unsigned int i = 0; i < NR_SHARERS; i++) {
+		join_thread(threads[i]);
+	}
+
+	bench_report("sched.share_error_permille", samples, 0, cycles, 0);
+
+	// The final shares, against the tickets.
+	uint64_t total = 0;
+	for (unsigned int i = 0; i < NR_SHARERS; i++) {
+		total += done[i];
+	}
+
+	for (unsigned int i = 0; i < NR_SHARERS && total; i++) {
+		char line[128];
+		sprintf(line, "BENCH sched.share_%u tickets=%u expected_permille=%u share_permille=%lu",
+			i, share_tickets[i], (share_tickets[i] * 1000) / total_tickets, (done[i] * 1000) / total);
+		bench_emit(line);
+	}
+}
+
+static const Benchmark benchmarks[] = {
+	{ "interactive", bench_interactive },
+	{ "share", bench_share },
+};
+
+int main(const char *cmdline)
+{
+	return bench_main("sched", benchmarks, cmdline);
+}
@@ -0,0 +1,364 @@
+/*
+ * TAR File-system Read-path Benchmarks
+ *
+ * Expects the archive made by tools/mkbenchfs.py, which puts the benchmark data
+ * under /bench.  With no arguments every benchmark is run; otherwise only the
+ * named ones are, e.g. "tarfsbench seq rand".
+ *
+ *   seq       sequential 64 KiB reads of a large file
+ *   rand      random, aligned 4 KiB preads of the same file
+ *   open      open/close of thousands of small files
+ *   lookup    open/close of a file at the bottom of a deep directory tree
+ *   readdir   listing of a directory with thousands of entries
+ *   copy      copying the large file to /.stats/null, with read and write
+ *             through a user buffer, and then with sendfile in the kernel
+ *   mmap      mapping part of the pattern file, with a write to /.stats/tarfs,
+ *             and reading it through the mapping, which shares the page cache's
+ *             pages, checking every word
+ *   boot      how long each phase of boot took, including mounting the archive,
+ *             from /.stats/boot
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos.h>
+#include "../bench.h"
+
+#define LARGE_FILE		"/bench/large.bin"
+#define SMALL_DIR		"/bench/small"
+#define DEEP_FILE		"/bench/deep/d00/d01/d02/d03/d04/d05/d06/d07/d08/d09/d10/d11/d12/d13/d14/d15/d16/d17/d18/d19/d20/d21/d22/d23/d24/d25/d26/d27/d28/d29/d30/d31/leaf"
+#define WIDE_DIR		"/bench/wide"
+
+// Every 8-byte (little-endian) word of the pattern file holds its own offset.
+#define PATTERN_FILE		"/bench/pattern.bin"
+
+#define NR_SMALL_FILES		4096
+#define SEQ_CHUNK		65536
+#define RAND_CHUNK		4096
+#define NR_RAND_READS		4096
+#define NR_LOOKUPS		1000
+#define NR_READDIR_PASSES	4
+
+// Where the pattern file is mapped, and how much of it.  Mappings can pin at most
+// half the page cache, which is 256 pages by default.
+#define MMAP_VA			0x0000600000000000ULL
+#define MMAP_OFFSET		65536
+#define MMAP_LENGTH		(256 * 1024)
+#define NR_MMAP_PASSES		4
+
+static char buffer[SEQ_CHUNK];
+
+static void bench_seq()
+{
+	HFILE f = open(LARGE_FILE, 0);
+	if (is_error(f)) {
+		printf("tarfsbench: unable to open " LARGE_FILE "\n");
+		return;
+	}
+
+	BenchSamples samples(8192);
+	uint64_t bytes = 0;
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+
+	for (;;) {
+		uint64_t t = bench_cycles();
+		int n = read(f, buffer, SEQ_CHUNK);
+		samples.add(bench_cycles() - t);
+
+		if (n <= 0) break;
+		bytes += n;
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+	close(f);
+
+	bench_report("tarfs.seq_read", samples, bytes, cycles, bench_stat("tarfs", "device_reads") - reads);
+}
+
+static void bench_rand()
+{
+	HFILE f = open(LARGE_FILE, 0);
+	if (is_error(f)) {
+		printf("tarfsbench: unable to open " LARGE_FILE "\n");
+		return;
+	}
+
+	// Find the size of the file, so that the offsets stay inside it.
+	uint64_t size = 0;
+	int n;
+	while ((n = read(f, buffer, SEQ_CHUNK)) > 0) {
+		size += n;
+	}
+
+	uint64_t nr_chunks = size / RAND_CHUNK;
+	if (nr_chunks == 0) {
+		close(f);
+		return;
+	}
+
+	BenchSamples samples(NR_RAND_READS);
+	BenchRandom random;
+	uint64_t bytes = 0;
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+
+	for (unsigned int i = 0; i < NR_RAND_READS; i++) {
+		off_t off = (random.next() % nr_chunks) * RAND_CHUNK;
+
+		uint64_t t = bench_cycles();
+		n = pread(f, buffer, RAND_CHUNK, off);
+		samples.add(bench_cycles() - t);
+
+		if (n > 0) bytes += n;
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+	close(f);
+
+	bench_report("tarfs.rand_pread", samples, bytes, cycles, bench_stat("tarfs", "device_reads") - reads);
+}
+
+static void bench_open()
+{
+	BenchSamples samples(NR_SMALL_FILES);
+	char path[64];
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+
+	for (unsigned int i = 0; i < NR_SMALL_FILES; i++) {
+		sprintf(path, SMALL_DIR "/f%04u", i);
+
+		uint64_t t = bench_cycles();
+		HFILE f = open(path, 0);
+		if (!is_error(f)) {
+			close(f);
+		}
+		samples.add(bench_cycles() - t);
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+
+	bench_report("tarfs.open_close", samples, 0, cycles, bench_stat("tarfs", "device_reads") - reads);
+}
+
+static void bench_lookup()
+{
+	BenchSamples samples(NR_LOOKUPS);
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+
+	for (unsigned int i = 0; i < NR_LOOKUPS; i++) {
+		uint64_t t = bench_cycles();
+		HFILE f = open(DEEP_FILE, 0);
+		if (!is_error(f)) {
+			close(f);
+		}
+		samples.add(bench_cycles() - t);
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+
+	bench_report("tarfs.deep_lookup", samples, 0, cycles, bench_stat("tarfs", "device_reads") - reads);
+}
+
+static void bench_readdir()
+{
+	BenchSamples samples(65536);
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+
+	for (unsigned int pass = 0; pass < NR_READDIR_PASSES; pass++) {
+		HDIR dir = opendir(WIDE_DIR, 0);
+		if (is_error(dir)) {
+			printf("tarfsbench: unable to open " WIDE_DIR "\n");
+			return;
+		}
+
+		struct dirent de;
+		for (;;) {
+			uint64_t t = bench_cycles();
+			int rc = readdir(dir, &de);
+			samples.add(bench_cycles() - t);
+
+			if (!rc) break;
+		}
+
+		closedir(dir);
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+
+	bench_report("tarfs.readdir", samples, 0, cycles, bench_stat("tarfs", "device_reads") - reads);
+}
+
+static void bench_copy()
+{
+	HFILE f = open(LARGE_FILE, 0);
+	if (is_error(f)) {
+		printf("tarfsbench: unable to open " LARGE_FILE "\n");
+		return;
+	}
+
+	HFILE null = open("/.stats/null", 0);
+	if (is_error(null)) {
+		close(f);
+		return;
+	}
+
+	// Every chunk crosses into the kernel twice, and is copied twice.
+	BenchSamples samples(8192);
+	uint64_t bytes = 0;
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+
+	for (;;) {
+		uint64_t t = bench_cycles();
+		int n = read(f, buffer, SEQ_CHUNK);
+		if (n > 0) {
+			write(null, buffer, n);
+		}
+		samples.add(bench_cycles() - t);
+
+		if (n <= 0) break;
+		bytes += n;
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+	close(null);
+	close(f);
+
+	bench_report("tarfs.copy_rw", samples, bytes, cycles, bench_stat("tarfs", "device_reads") - reads);
+
+	// The same copy as a single request, which the kernel serves straight
+	// out of the page cache.
+	BenchSamples sendfile_samples(1);
+	uint64_t sent = bench_stat("tarfs", "sendfile_bytes");
+	reads = bench_stat("tarfs", "device_reads");
+	start = bench_cycles();
+
+	if (!bench_control("tarfs", "sendfile " LARGE_FILE " null")) {
+		printf("tarfsbench: sendfile failed\n");
+	}
+
+	cycles = bench_cycles() - start;
+	sendfile_samples.add(cycles);
+
+	bench_report("tarfs.copy_sendfile", sendfile_samples, bench_stat("tarfs", "sendfile_bytes") - sent, cycles,
+		bench_stat("tarfs", "device_reads") - reads);
+}
+
+static void bench_mmap()
+{
+	char command[128];
+	sprintf(command, "map " PATTERN_FILE " %lu %u %u", MMAP_VA, MMAP_OFFSET, MMAP_LENGTH);
+
+	uint64_t reads = bench_stat("tarfs", "device_reads");
+	uint64_t start = bench_cycles();
+	bool mapped = bench_control("tarfs", command);
+	uint64_t map_cycles = bench_cycles() - start;
+
+	BenchSamples samples(NR_MMAP_PASSES);
+	uint64_t bytes = 0, errors = 0;
+
+	if (mapped) {
+		const volatile uint64_t *words = (const volatile uint64_t *)MMAP_VA;
+
+		start = bench_cycles();
+		for (unsigned int pass = 0; pass < NR_MMAP_PASSES; pass++) {
+			uint64_t t = bench_cycles();
+			for (unsigned int i = 0; i < MMAP_LENGTH / 8; i++) {
+				if (words[i] != MMAP_OFFSET + ((uint64_t)i * 8)) {
+					errors++;
+				}
+			}
+			samples.add(bench_cycles() - t);
+
+			bytes += MMAP_LENGTH;
+		}
+		uint64_t cycles = bench_cycles() - start;
+
+		sprintf(command, "unmap %lu", MMAP_VA);
+		if (!bench_control("tarfs", command)) {
+			errors++;
+		}
+
+		bench_report("tarfs.mmap", samples, bytes, cycles, bench_stat("tarfs", "device_reads") - reads);
+	} else {
+		printf("tarfsbench: unable to map " PATTERN_FILE "\n");
+	}
+
+	char line[256];
+	sprintf(line, "BENCH tarfs.mmap_check mapped=%u map_cycles=%lu errors=%lu", mapped ? 1 : 0, map_cycles, errors);
+	bench_emit(line);
+}
+
+/**
+ * Reports the kernel's boot phases, one line each, from "phase <name> start <tsc>
+ * cycles <n> us <n> calls <n>" lines.
+ */
+static void bench_boot()
+{
+	HFILE f = open("/.stats/boot", 0);
+	if (is_error(f)) {
+		return;
+	}
+
+	static char buffer[4096];
+	int n = read(f, buffer, sizeof(buffer) - 1);
+	close(f);
+
+	if (n <= 0) {
+		return;
+	}
+	buffer[n] = 0;
+
+	for (char *line = buffer; *line; ) {
+		char *end = line;
+		while (*end && *end != '\n') end++;
+
+		if (strncmp(line, "phase ", 6) == 0) {
+			char *name = line + 6;
+			char *p = name;
+			while (p < end && *p != ' ') p++;
+			*p++ = 0;
+
+			// the rest of the line is already in key/value pairs, bar the '='s
+			char values[128];
+			int len = 0;
+			bool key = true;
+			for (; p < end && len < (int)sizeof(values) - 1; p++) {
+				if (*p == ' ') {
+					values[len++] = key ? '=' : ' ';
+					key = !key;
+				} else {
+					values[len++] = *p;
+				}
+			}
+			values[len] = 0;
+
+			char result[256];
+			sprintf(result, "BENCH boot.%s %s", name, values);
+			bench_emit(result);
+		}
+
+		line = *end ? end + 1 : end;
+	}
+}
+
+static const Benchmark benchmarks[] = {
+	{ "seq", bench_seq },
+	{ "rand", bench_rand },
+	{ "open", bench_open },
+	{ "lookup", bench_lookup },
+	{ "readdir", bench_readdir },
+	{ "copy", bench_copy },
+	{ "mmap", bench_mmap },
+	{ "boot", bench_boot },
+};
+
+int main(const char *cmdline)
+{
+	return bench_main("tarfs", benchmarks, cmdline);
+}
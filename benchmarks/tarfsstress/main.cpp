@@ -0,0 +1,286 @@
+/*
+ * TAR File-system Stress Test
+ *
+ * Runs several threads at once against the same files, to shake out races in
+ * the page cache and the block I/O queue, and checks everything that is read.
+ * Expects the archive made by tools/mkbenchfs.py.  With no arguments every test
+ * is run; otherwise only the named ones are, e.g. "tarfsstress pread".
+ *
+ *   pread     random, unaligned preads of the pattern file, one handle per thread
+ *   read      sequential reads of the pattern file through one shared handle,
+ *             which between them must return every byte exactly once
+ *   readdir   listings of a directory with thousands of entries
+ *   mixed     all of the above at once
+ *
+ * The pattern file is several times the size of the page cache, so pages are
+ * being reclaimed and re-read throughout.  Every result has an errors= count,
+ * which must be zero; run-bench.sh fails if it isn't.
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos.h>
+#include "../bench.h"
+
+// Every 8-byte (little-endian) word of the pattern file holds its own offset.
+#define PATTERN_FILE		"/bench/pattern.bin"
+#define PATTERN_SIZE		(4 * 1024 * 1024)
+#define WIDE_DIR		"/bench/wide"
+#define NR_WIDE_ENTRIES		10000
+
+#define NR_THREADS		4
+#define NR_PREADS		2000
+#define PREAD_MAX		9000
+#define NR_READDIR_PASSES	2
+
+// A multiple of the word size, so that every chunk starts on a word and says
+// where it came from, but not of the page size, so that chunks straddle pages.
+#define READ_CHUNK		6152
+#define NR_READ_CHUNKS		((PATTERN_SIZE + READ_CHUNK - 1) / READ_CHUNK)
+
+struct Worker {
+	unsigned int id;
+	HFILE shared;
+
+	uint64_t ops, bytes, errors;
+
+	char buffer[PREAD_MAX > READ_CHUNK ? PREAD_MAX : READ_CHUNK];
+	uint8_t seen[NR_WIDE_ENTRIES];
+};
+
+static Worker workers[NR_THREADS];
+
+// How many times each chunk of the pattern file was returned by the shared reads.
+static uint32_t chunk_reads[NR_READ_CHUNKS];
+
+/**
+ * Returns the byte at the given offset of the pattern file.
+ */
+static inline uint8_t pattern_byte(uint64_t off)
+{
+	return (uint8_t)((off & ~7ULL) >> ((off & 7) * 8));
+}
+
+/**
+ * Checks data read from the pattern file against what should be there.
+ * @return Returns the number of bytes that are wrong.
+ */
+static uint64_t check_pattern(const char *data, uint64_t off, size_t size)
+{
+	uint64_t wrong = 0;
+	for (size_t i = 0; i < size; i++) {
+		if ((uint8_t)data[i] != pattern_byte(off + i)) {
+			wrong++;
+		}
+	}
+
+	return wrong;
+}
+
+static void stress_pread(Worker& w)
+{
+	HFILE f = open(PATTERN_FILE, 0);
+	if (is_error(f)) {
+		w.errors++;
+		return;
+	}
+
+	// Each thread has its own sequence of offsets.
+	BenchRandom random(0x9e3779b97f4a7c15ULL * (w.id + 1));
+
+	for (unsigned int i = 0; i < NR_PREADS; i++) {
+		uint64_t off = random.next() % PATTERN_SIZE;
+		size_t size = 1 + (random.next() % PREAD_MAX);
+		size_t expected = off + size > PATTERN_SIZE ? PATTERN_SIZE - off : size;
+
+		int n = pread(f, w.buffer, size, off);
+		if (n != (int)expected) {
+			w.errors++;
+			continue;
+		}
+
+		w.errors += check_pattern(w.buffer, off, n) ? 1 : 0;
+		w.ops++;
+		w.bytes += n;
+	}
+
+	close(f);
+}
+
+static void stress_read(Worker& w)
+{
+	for (;;) {
+		int n = read(w.shared, w.buffer, READ_CHUNK);
+		if (n <= 0) {
+			if (n < 0) w.errors++;
+			break;
+		}
+
+		// The first word says which chunk this is, and the rest has to agree.
+		uint64_t off = 0;
+		for (int i = 0; i < 8 && i < n; i++) {
+			off |= (uint64_t)(uint8_t)w.buffer[i] << (i * 8);
+		}
+
+		if (off % READ_CHUNK != 0 || off >= PATTERN_SIZE || check_pattern(w.buffer, off, n)) {
+			w.errors++;
+			continue;
+		}
+
+		__atomic_add_fetch(&chunk_reads[off / READ_CHUNK], 1, __ATOMIC_RELAXED);
+		w.ops++;
+		w.bytes += n;
+	}
+}
+
+static void stress_readdir(Worker& w)
+{
+	for (unsigned int pass = 0; pass < NR_READDIR_PASSES; pass++) {
+		HDIR dir = opendir(WIDE_DIR, 0);
+		if (is_error(dir)) {
+			w.errors++;
+			return;
+		}
+
+		for (unsigned int i = 0; i < NR_WIDE_ENTRIES; i++) {
+			w.seen[i] = 0;
+		}
+
+		// Every entry has to turn up exactly once, whatever order they come in.
+		struct dirent de;
+		while (readdir(dir, &de)) {
+			unsigned int index = 0;
+			bool ok = strncmp(de.name, "entry-", 6) == 0 && strlen(de.name) == 11;
+			for (int i = 6; ok && i < 11; i++) {
+				ok = de.name[i] >= '0' && de.name[i] <= '9';
+				index = (index * 10) + (de.name[i] - '0');
+			}
+
+			if (!ok || index >= NR_WIDE_ENTRIES || w.seen[index]++) {
+				w.errors++;
+			}
+
+			w.ops++;
+		}
+
+		closedir(dir);
+
+		for (unsigned int i = 0; i < NR_WIDE_ENTRIES; i++) {
+			if (!w.seen[i]) {
+				w.errors++;
+			}
+		}
+	}
+}
+
+// What each thread does: one test for all of them, or a mix.
+static void (*stress_fn)(Worker&);
+
+static void worker(void *arg)
+{
+	Worker *w = (Worker *)arg;
+
+	if (stress_fn) {
+		stress_fn(*w);
+	} else if (w->id % 3 == 0) {
+		stress_pread(*w);
+	} else if (w->id % 3 == 1) {
+		stress_read(*w);
+	} else {
+		stress_readdir(*w);
+	}
+}
+
+/**
+ * Runs every thread to completion, and reports how they did between them.
+ * @param name The name of the test.
+ * @param fn The test each thread runs, or NULL for a mix.
+ */
+static void run_stress(const char *name, void (*fn)(Worker&))
+{
+	HFILE shared = open(PATTERN_FILE, 0);
+	if (is_error(shared)) {
+		printf("tarfsstress: unable to open " PATTERN_FILE "\n");
+	}
+
+	for (unsigned int i = 0; i < NR_READ_CHUNKS; i++) {
+		chunk_reads[i] = 0;
+	}
+
+	stress_fn = fn;
+
+	HTHREAD threads[NR_THREADS];
+	uint64_t start = bench_cycles();
+
+	for (unsigned int i = 0; i < NR_THREADS; i++) {
+		workers[i].id = i;
+		workers[i].shared = shared;
+		workers[i].ops = 0;
+		workers[i].bytes = 0;
+		workers[i].errors = is_error(shared) ? 1 : 0;
+
+		threads[i] = create_thread(worker, &workers[i]);
+	}
+
+	uint64_t ops = 0, bytes = 0, errors = 0;
+	for (unsigned int i = 0; i < NR_THREADS; i++) {
+		join_thread(threads[i]);
+
+		ops += workers[i].ops;
+		bytes += workers[i].bytes;
+		errors += workers[i].errors;
+	}
+
+	uint64_t cycles = bench_cycles() - start;
+
+	// If anybody did shared reads, the whole file must have been read once.
+	if ((fn == stress_read || fn == NULL) && !is_error(shared)) {
+		for (unsigned int i = 0; i < NR_READ_CHUNKS; i++) {
+			if (chunk_reads[i] != 1) {
+				errors++;
+			}
+		}
+	}
+
+	if (!is_error(shared)) {
+		close(shared);
+	}
+
+	char line[256];
+	sprintf(line, "BENCH stress.%s threads=%u ops=%lu bytes=%lu cycles=%lu errors=%lu",
+		name, NR_THREADS, ops, bytes, cycles, errors);
+	bench_emit(line);
+}
+
+static void bench_pread()
+{
+	run_stress("pread", stress_pread);
+}
+
+static void bench_read()
+{
+	run_stress("read", stress_read);
+}
+
+static void bench_readdir()
+{
+	run_stress("readdir", stress_readdir);
+}
+
+static void bench_mixed()
+{
+	run_stress("mixed", NULL);
+}
+
+static const Benchmark benchmarks[] = {
+	{ "pread", bench_pread },
+	{ "read", bench_read },
+	{ "readdir", bench_readdir },
+	{ "mixed", bench_mixed },
+};
+
+int main(const char *cmdline)
+{
+	return bench_main("stress", benchmarks, cmdline);
+}
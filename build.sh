@@ -2,5 +2,14 @@
 
 ln -Tsf `pwd`/coursework infos/oot
 
+# The benchmark programs are built along with the rest of the user programs.
+ln -sf `pwd`/benchmarks/bench.h infos-user/src/bench.h
+ln -sf `pwd`/benchmarks/clock.h infos-user/src/clock.h
+ln -sf `pwd`/coursework/time-page-abi.h infos-user/src/time-page-abi.h
+for b in benchmarks/*/; do
+	ln -Tsf `pwd`/$b infos-user/src/`basename $b`
+done
+
 make -C infos || exit 1
 make -C infos-user fs || exit 1
+make -C tools || exit 1
@@ -0,0 +1,113 @@
+/*
+ * Boot Timing
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "boot-timing.h"
+#include "tsc-clock.h"
+#include <infos/kernel/log.h>
+
+using namespace infos::kernel;
+using namespace coursework;
+
+BootTiming coursework::boot_timing;
+
+BootTiming::BootTiming() : _nr_phases(0), _reported(false), _boot_end(0), _stats("boot", read_stats, NULL, this)
+{
+}
+
+void BootTiming::record(const char *name, uint64_t start, uint64_t end)
+{
+	UniqueIRQSpinLock l(_lock);
+
+	// phases are named by string literals, so the pointer identifies them
+	Phase *phase = NULL;
+	for (unsigned int i = 0; i < _nr_phases; i++) {
+		if (_phases[i].name == name) {
+			phase = &_phases[i];
+			break;
+		}
+	}
+
+	if (!phase) {
+		if (_nr_phases == MAX_PHASES) {
+			return;
+		}
+
+		phase = &_phases[_nr_phases++];
+		phase->name = name;
+		phase->first_start = start;
+		phase->cycles = 0;
+		phase->count = 0;
+	}
+
+	phase->cycles += end - start;
+	phase->count++;
+}
+
+/**
+ * Fills the array with phase indices, longest first.  Must be called with the
+ * lock held.
+ * @return Returns the number of phases.
+ */
+unsigned int BootTiming::sorted(unsigned int *order)
+{
+	for (unsigned int i = 0; i < _nr_phases; i++) {
+		unsigned int j = i;
+		for (; j > 0 && _phases[order[j - 1]].cycles < _phases[i].cycles; j--) {
+			order[j] = order[j - 1];
+		}
+		order[j] = i;
+	}
+
+	return _nr_phases;
+}
+
+void BootTiming::report()
+{
+	UniqueIRQSpinLock l(_lock);
+
+	if (_reported) {
+		return;
+	}
+
+	_reported = true;
+	_boot_end = rdtsc();
+
+	unsigned int order[MAX_PHASES];
+	unsigned int nr_phases = sorted(order);
+
+	syslog.messagef(LogLevel::INFO, "boot: %lu cycles since reset", _boot_end);
+	for (unsigned int i = 0; i < nr_phases; i++) {
+		const Phase& phase = _phases[order[i]];
+		syslog.messagef(LogLevel::INFO, "boot: %-20s %12lu cycles %3lu%% %6lu calls",
+			phase.name, phase.cycles, (phase.cycles * 100) / _boot_end, phase.count);
+	}
+}
+
+size_t BootTiming::read_stats(char *buffer, size_t size, void *arg)
+{
+	BootTiming *timing = (BootTiming *)arg;
+	size_t pos = 0;
+
+	UniqueIRQSpinLock l(timing->_lock);
+
+	// microseconds, once the clock has been calibrated
+	uint64_t hz = tsc_clock.calibrated() ? tsc_clock.frequency() : 0;
+
+	stats_printf(buffer, size, pos, "boot_cycles %lu\n", timing->_boot_end);
+	stats_printf(buffer, size, pos, "tsc_hz %lu\n", hz);
+
+	unsigned int order[MAX_PHASES];
+	unsigned int nr_phases = timing->sorted(order);
+
+	for (unsigned int i = 0; i < nr_phases; i++) {
+		const Phase& phase = timing->_phases[order[i]];
+		stats_printf(buffer, size, pos, "phase %s start %lu cycles %lu us %lu calls %lu\n",
+			phase.name, phase.first_start, phase.cycles, hz ? (phase.cycles * 1000000) / hz : 0, phase.count);
+	}
+
+	return pos;
+}
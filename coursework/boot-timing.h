@@ -0,0 +1,76 @@
+/*
+ * Boot Timing Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_BOOT_TIMING_H
+#define COURSEWORK_BOOT_TIMING_H
+
+#include "spinlock.h"
+#include "stats.h"
+#include "tsc.h"
+
+namespace coursework {
+
+	/**
+	 * How long each phase of boot took, in TSC cycles.  A phase that runs more than
+	 * once (such as reserving a page) adds up, and phases can nest, so the total
+	 * is the TSC at the end of boot, which counts from reset.  The breakdown is
+	 * logged, longest first, once the root filesystem is mounted, and is published
+	 * as /.stats/boot.
+	 */
+	class BootTiming {
+	public:
+		static const unsigned int MAX_PHASES = 32;
+
+		BootTiming();
+
+		/* Adds a run of a phase, creating the phase the first time it is seen */
+		void record(const char *name, uint64_t start, uint64_t end);
+
+		/* Logs the breakdown.  Only the first call does anything */
+		void report();
+
+	private:
+		struct Phase {
+			const char *name;
+			uint64_t first_start, cycles, count;
+		};
+
+		unsigned int sorted(unsigned int *order);
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+
+		SpinLock _lock;
+		Phase _phases[MAX_PHASES];
+		unsigned int _nr_phases;
+
+		bool _reported;
+		uint64_t _boot_end;
+
+		StatsEntry _stats;
+	};
+
+	extern BootTiming boot_timing;
+
+	/**
+	 * Times the enclosing scope as a boot phase.
+	 */
+	class BootPhase {
+	public:
+		BootPhase(const char *name) : _name(name), _start(rdtsc()) {
+		}
+
+		~BootPhase() {
+			boot_timing.record(_name, _start, rdtsc());
+		}
+
+	private:
+		const char *_name;
+		uint64_t _start;
+	};
+}
+
+#endif /* COURSEWORK_BOOT_TIMING_H */
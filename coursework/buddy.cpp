@@ -13,6 +13,10 @@
 #include <infos/util/math.h>
 #include <infos/util/printf.h>
 
+#include "boot-timing.h"
+#include "klog.h"
+#include "trace.h"
+
 using namespace infos::kernel;
 using namespace infos::mm;
 using namespace infos::util;
@@ -154,6 +158,8 @@ private:
 		// Get the base address of right-hand-side sub-block in source order
 		PageDescriptor *pgd_right_block = (*block_pointer) + nr_ppb;
 		
+		TRACE(PageAlloc, PageSplit, sys.mm().pgalloc().pgd_to_pfn(*block_pointer), source_order);
+
 		// Remove the block from the free list of its source order
 		remove_block(*block_pointer, source_order);
 		
@@ -188,6 +194,8 @@ private:
 		// Get the base address of the source block and its buddy
 		PageDescriptor *base_addr = (*block_pointer < buddy) ? *block_pointer : buddy;
 		
+		TRACE(PageAlloc, PageMerge, sys.mm().pgalloc().pgd_to_pfn(base_addr), source_order);
+
 		// Remove the source block and its buddy from the free list of their source order
 		remove_block(*block_pointer, source_order);
 		remove_block(buddy, source_order);
@@ -207,7 +215,7 @@ public:
 		for (unsigned int i = 0; i < ARRAY_SIZE(_free_areas); i++) {
 			_free_areas[i] = nullptr;
 		}
-		syslog.messagef(LogLevel::DEBUG, "Constructor has been called");
+		KLOG(syslog, DEBUG, "Constructor has been called");
 	}
 	
 	/**
@@ -234,6 +242,7 @@ public:
 		// By now the desired page descriptor is in the free list of the given source order
 		if (*block_pointer) {
 			remove_block(*block_pointer, order);
+			TRACE(PageAlloc, PageAlloc, sys.mm().pgalloc().pgd_to_pfn(*block_pointer), order);
 			return *block_pointer;
 		}
 		return nullptr;
@@ -251,6 +260,8 @@ public:
 		// illegal to free page 1 in order-1.
 		assert(is_correct_alignment_for_order(pgd, order));
 		
+		TRACE(PageAlloc, PageFree, sys.mm().pgalloc().pgd_to_pfn(pgd), order);
+		
 		// Insert page into the free list of the source order
 		insert_block(pgd, order);
 		
@@ -310,6 +321,8 @@ public:
 	 */
 	bool reserve_page(PageDescriptor *pgd)
 	{
+		coursework::BootPhase phase("pgalloc.reserve");
+
 		int order = MAX_ORDER-1;
 		PageDescriptor* current_block = nullptr;
 
@@ -372,7 +385,9 @@ public:
 	 */
 	bool init(PageDescriptor *page_descriptors, uint64_t nr_page_descriptors) override
 	{
-		mm_log.messagef(LogLevel::DEBUG, "Buddy Allocator Initialising pd=%p, nr=0x%lx", page_descriptors, nr_page_descriptors);
+		coursework::BootPhase phase("pgalloc.init");
+
+		KLOG(mm_log, DEBUG, "Buddy Allocator Initialising pd=%p, nr=0x%lx", page_descriptors, nr_page_descriptors);
 				
 		// Get the number of pages in the maximum order block
 		uint64_t block_size = pages_per_block(MAX_ORDER-1);
@@ -403,8 +418,13 @@ public:
 	 */
 	void dump_state() const override
 	{
+		// The free lists are only walked if the output is going anywhere.
+		if (!KLOG_ENABLED(DEBUG)) {
+			return;
+		}
+
 		// Print out a header, so we can find the output in the logs.
-		mm_log.messagef(LogLevel::DEBUG, "BUDDY STATE:");
+		KLOG(mm_log, DEBUG, "BUDDY STATE:");
 		
 		// Iterate over each free area.
 		for (unsigned int i = 0; i < ARRAY_SIZE(_free_areas); i++) {
@@ -419,7 +439,7 @@ public:
 				pg = pg->next_free;
 			}
 			
-			mm_log.messagef(LogLevel::DEBUG, "%s", buffer);
+			KLOG(mm_log, DEBUG, "%s", buffer);
 		}
 	}
 
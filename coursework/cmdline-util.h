@@ -0,0 +1,85 @@
+/*
+ * Command-line Argument Helpers
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_CMDLINE_UTIL_H
+#define COURSEWORK_CMDLINE_UTIL_H
+
+#include <infos/define.h>
+
+namespace coursework {
+
+	/**
+	 * Parses the decimal number at the start of a command-line value, stopping at
+	 * the first character that isn't a digit.
+	 * @param value The value given for the argument.
+	 * @return Returns the number, or zero if the value doesn't start with one.
+	 */
+	static inline uint64_t parse_cmdline_number(const char *value)
+	{
+		uint64_t number = 0;
+		for (const char *p = value; *p >= '0' && *p <= '9'; p++) {
+			number = (number * 10) + (*p - '0');
+		}
+
+		return number;
+	}
+
+	static inline bool is_control_space(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\n';
+	}
+
+	/**
+	 * Parses an unsigned decimal number from a write to a control file, skipping
+	 * any spaces in front of it.  The number has to be followed by whitespace or
+	 * the end of the write, so "3abc" is rejected rather than read as 3.
+	 * @param buffer The data written, which isn't NUL-terminated.
+	 * @param size The number of bytes written.
+	 * @param i Where to start, which is left just after the number.
+	 * @param value Set to the number.
+	 * @return Returns FALSE if there isn't a well-formed number there, or it
+	 * doesn't fit in 64 bits.
+	 */
+	static inline bool parse_control_number(const char *buffer, size_t size, size_t& i, uint64_t& value)
+	{
+		while (i < size && buffer[i] == ' ') {
+			i++;
+		}
+
+		size_t start = i;
+		value = 0;
+
+		for (; i < size && buffer[i] >= '0' && buffer[i] <= '9'; i++) {
+			uint64_t digit = buffer[i] - '0';
+			if (value > (~0ULL - digit) / 10) {
+				return false;
+			}
+
+			value = (value * 10) + digit;
+		}
+
+		return i != start && (i == size || is_control_space(buffer[i]));
+	}
+
+	/**
+	 * Checks that there is nothing but whitespace (such as the newline that echo
+	 * adds) left in a write to a control file.
+	 * @param i Where to start looking.
+	 */
+	static inline bool control_at_end(const char *buffer, size_t size, size_t i)
+	{
+		for (; i < size; i++) {
+			if (!is_control_space(buffer[i])) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+#endif /* COURSEWORK_CMDLINE_UTIL_H */
@@ -7,100 +7,214 @@
  * STUDENT NUMBER: s1894401
  */
 #include <infos/drivers/timer/rtc.h>
-#include <infos/util/lock.h>
-#include <arch/x86/pio.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/irq.h>
+#include <infos/kernel/log.h>
+#include <arch/x86/x86-arch.h>
 
+#include "boot-timing.h"
+#include "cmos.h"
+#include "profiler.h"
+#include "seqcount.h"
+#include "stats.h"
+#include "tsc.h"
+#include "tsc-clock.h"
+
+using namespace infos::kernel;
 using namespace infos::drivers;
 using namespace infos::drivers::timer;
 using namespace infos::arch::x86;
-using namespace infos::util;
+using namespace coursework;
+
+#define RTC_IRQ		8
 
+/**
+ * The CMOS RTC, which raises its update-ended interrupt once a second, just after
+ * it has moved on to the next second.  The time registers then hold still for
+ * almost a whole second, so the handler reads them once, without checking for
+ * an update, and caches the time under a sequence counter.  Reading the time is
+ * then a copy of the cache, which never touches the hardware.  The RTC's periodic
+ * interrupt arrives on the same irq, and drives the sampling profiler.
+ *
+ * If the interrupt can't be had, or it stops arriving (the cache is more than
+ * MAX_CACHE_AGE_S seconds old), the time comes from the TSC clock instead.
+ */
 class CMOSRTC : public RTC {
 public:
 	static const DeviceClass CMOSRTCDeviceClass;
-	
-	private:
-	int const CMOS_ADDRESS = 0x70;
-	int const CMOS_DATA = 0x71;
-	
-	uint8_t get_RTC_register(int reg) 
+
+	// How long the cache can go without an update-ended interrupt before it is
+	// no longer trusted.  They should come every second.
+	static const uint64_t MAX_CACHE_AGE_S = 2;
+
+	CMOSRTC() : irq_enabled(false), nr_updates(0), last_update_tsc(0), nr_stale_reads(0), stats("rtc", read_stats, NULL, this)
 	{
-		__outb(CMOS_ADDRESS, reg);
-		return __inb(CMOS_DATA);
 	}
-	
-	bool get_update_in_progress_flag() 
+
+	const DeviceClass& device_class() const override
 	{
-		// bit 7 from status register A is non-zero if
-		// an update is in progress
-      		return (get_RTC_register(0x0A) & 0x80);
+		return CMOSRTCDeviceClass;
 	}
-	
-	bool timepoints_are_equal(RTCTimePoint tp1, RTCTimePoint tp2)
-	{	
-		// all fields of both timepoints must be the same if both timepoints are equal
-		return (tp1.seconds == tp2.seconds) && (tp1.minutes == tp2.minutes) && (tp1.hours == tp2.hours) && (tp1.day_of_month == tp2.day_of_month) && (tp1.month == tp2.month) && (tp1.year == tp2.year);
+
+	/**
+	 * Calibrates the TSC clock, fills the cache from the RTC, and then enables
+	 * the update-ended interrupt to keep it up to date.
+	 */
+	bool init(Kernel& owner) override
+	{
+		BootPhase phase("device.cmos-rtc");
+
+		// This takes at most the PIT's 50 ms, which is better spent here than by
+		// the first thread to ask for the time.  Doing it before the interrupt is
+		// enabled means every update-ended interrupt finds the clock calibrated.
+		tsc_clock.ensure_calibrated();
+
+		RTCTimePoint tp;
+		cmos_read_timepoint(tp);
+		update_cache(tp);
+
+		if (!x86arch.request_physical_irq(RTC_IRQ, rtc_irq_handler, this)) {
+			syslog.messagef(LogLevel::WARNING, "rtc: unable to request irq %u, reading the time from the tsc", RTC_IRQ);
+			return true;
+		}
+
+		// clear anything already pending, or the interrupt never fires
+		cmos_read(CMOS_STATUS_C);
+		cmos_update(CMOS_STATUS_B, 0, CMOS_B_UPDATE_ENDED);
+
+		__atomic_store_n(&last_update_tsc, rdtsc(), __ATOMIC_RELAXED);
+		__atomic_store_n(&irq_enabled, true, __ATOMIC_RELEASE);
+
+		// the periodic interrupt shares the irq, and is the profiler's to use
+		profiler.rtc_ready();
+
+		return true;
 	}
-	
-	void get_current_time(RTCTimePoint& tp) 
+
+	/**
+	 * Interrogates the RTC to read the current date & time.
+	 * @param tp Populates the tp structure with the current data & time, as
+	 * given by the CMOS RTC device.
+	 */
+	void read_timepoint(RTCTimePoint& tp) override
 	{
-		// read values from various each register
-		// pertaining to each field
-		tp.seconds = get_RTC_register(0x00);
-		tp.minutes = get_RTC_register(0x02);
-	        tp.hours = get_RTC_register(0x04);
-	        tp.day_of_month = get_RTC_register(0x07);
-	        tp.month = get_RTC_register(0x08);
-	        tp.year = get_RTC_register(0x09);
+		if (!__atomic_load_n(&irq_enabled, __ATOMIC_ACQUIRE) || cache_stale()) {
+			TSCClock::to_timepoint(tsc_clock.wall_ns(), tp);
+			return;
+		}
+
+		unsigned int seq;
+		do {
+			seq = cache_seq.read_begin();
+			tp = cached;
+		} while (cache_seq.read_retry(seq));
 	}
-	
-	const DeviceClass& device_class() const override
+
+private:
+	/**
+	 * Returns TRUE if the update-ended interrupts have stopped coming, e.g.
+	 * because something else reprogrammed the RTC.  Without a calibrated TSC
+	 * there is no telling, and no better clock to use either.
+	 */
+	bool cache_stale()
 	{
-		return CMOSRTCDeviceClass;
+		uint64_t hz = tsc_clock.calibrated() ? tsc_clock.frequency() : 0;
+		if (!hz) {
+			return false;
+		}
+
+		uint64_t age = rdtsc() - __atomic_load_n(&last_update_tsc, __ATOMIC_RELAXED);
+		if (age <= MAX_CACHE_AGE_S * hz) {
+			return false;
+		}
+
+		__atomic_add_fetch(&nr_stale_reads, 1, __ATOMIC_RELAXED);
+		return true;
 	}
 
-	
-	 // Interrogates the RTC to read the current date & time.
-	 // @param tp Populates the tp structure with the current data & time, as
-	 // given by the CMOS RTC device.
-	 
-	void read_timepoint(RTCTimePoint& tp) override
+	static void rtc_irq_handler(const IRQ *irq, void *priv)
 	{
-		RTCTimePoint prev_tp;
-	        unsigned short registerB;      
- 
-      	// This uses the "read registers until you get the same values twice in a row" technique
-      	// to avoid getting dodgy/inconsistent values due to RTC updates
- 
-	      while (get_update_in_progress_flag());  // Make sure an update isn't in progress
-	      get_current_time(tp);
- 		
-	      	do {
-		    prev_tp = tp;
-		    while (get_update_in_progress_flag());  // Make sure an update isn't in progress
-		    get_current_time(tp);
-	      	} while (!timepoints_are_equal(prev_tp, tp));
- 		
-      		registerB = get_RTC_register(0x0B);
- 
-	      // Convert BCD to binary values if necessary
-	 
-	      if (!(registerB & 0x04)) {
-		    tp.seconds = (tp.seconds & 0x0F) + ((tp.seconds / 16) * 10);
-		    tp.minutes = (tp.minutes & 0x0F) + ((tp.minutes / 16) * 10);
-		    tp.hours = ( (tp.hours & 0x0F) + (((tp.hours & 0x70) / 16) * 10) ) | (tp.hours & 0x80);
-		    tp.day_of_month = (tp.day_of_month & 0x0F) + ((tp.day_of_month / 16) * 10);
-		    tp.month = (tp.month & 0x0F) + ((tp.month / 16) * 10);
-		    tp.year = (tp.year & 0x0F) + ((tp.year / 16) * 10);
-	      }
- 
-	       // Convert 12 hour clock to 24 hour clock if necessary
-	       // (i.e. if we are in 12-hour mode and the PM bit is set)
-	 
-	      if (!(registerB & 0x02) && (tp.hours & 0x80)) {
-		    tp.hours = ((tp.hours & 0x7F) + 12) % 24;
-	      }
+		uint64_t tsc = rdtsc();
+		((CMOSRTC *)priv)->handle_irq(tsc, __builtin_frame_address(0));
 	}
+
+	/**
+	 * Handles the RTC's interrupt, given the TSC value it arrived at, and the
+	 * handler's frame, which the profiler searches up from.  Both the periodic
+	 * and the update-ended interrupt can be behind it.
+	 */
+	void handle_irq(uint64_t tsc, const void *handler_frame)
+	{
+		// reading status register C acknowledges the interrupt
+		uint8_t status_c = cmos_read(CMOS_STATUS_C);
+
+		if (status_c & CMOS_C_PERIODIC) {
+			profiler.sample(handler_frame);
+		}
+
+		if (status_c & CMOS_C_UPDATE_ENDED) {
+			update_ended(tsc);
+		}
+	}
+
+	/**
+	 * Caches the time at the start of the new second.
+	 */
+	void update_ended(uint64_t tsc)
+	{
+
+		RTCTimePoint tp;
+		cmos_read_registers(tp);
+		cmos_convert_timepoint(tp, cmos_read(CMOS_STATUS_B));
+
+		update_cache(tp);
+		nr_updates++;
+		__atomic_store_n(&last_update_tsc, tsc, __ATOMIC_RELAXED);
+
+		tsc_clock.rtc_second(tsc, TSCClock::from_timepoint(tp));
+	}
+
+	/**
+	 * Replaces the cached time.  Only init() and then the interrupt handler
+	 * write it, so writes never overlap.
+	 */
+	void update_cache(const RTCTimePoint& tp)
+	{
+		cache_seq.write_begin();
+		cached = tp;
+		cache_seq.write_end();
+	}
+
+	static size_t read_stats(char *buffer, size_t size, void *arg)
+	{
+		CMOSRTC *rtc = (CMOSRTC *)arg;
+		size_t pos = 0;
+
+		RTCTimePoint tp;
+		rtc->read_timepoint(tp);
+
+		stats_printf(buffer, size, pos, "irq %u\n", rtc->irq_enabled ? 1 : 0);
+		stats_printf(buffer, size, pos, "updates %lu\n", rtc->nr_updates);
+		stats_printf(buffer, size, pos, "stale_reads %lu\n", rtc->nr_stale_reads);
+		stats_printf(buffer, size, pos, "time 20%02u-%02u-%02u %02u:%02u:%02u\n",
+			tp.year, tp.month, tp.day_of_month, tp.hours, tp.minutes, tp.seconds);
+
+		return pos;
+	}
+
+	bool irq_enabled;
+
+	// The time at the start of the current second, as the RTC gave it.
+	RTCTimePoint cached;
+	SeqCount cache_seq;
+
+	uint64_t nr_updates;
+
+	// The TSC at the last update of the cache.
+	uint64_t last_update_tsc;
+	uint64_t nr_stale_reads;
+
+	StatsEntry stats;
 };
 
 const DeviceClass CMOSRTC::CMOSRTCDeviceClass(RTC::RTCDeviceClass, "cmos-rtc");
@@ -0,0 +1,149 @@
+/*
+ * CMOS Real-time Clock Registers
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_CMOS_H
+#define COURSEWORK_CMOS_H
+
+#include <infos/drivers/timer/rtc.h>
+#include <arch/x86/pio.h>
+
+#include "spinlock.h"
+
+namespace coursework {
+
+	#define CMOS_ADDRESS	0x70
+	#define CMOS_DATA	0x71
+
+	#define CMOS_SECONDS		0x00
+	#define CMOS_MINUTES		0x02
+	#define CMOS_HOURS		0x04
+	#define CMOS_DAY_OF_MONTH	0x07
+	#define CMOS_MONTH		0x08
+	#define CMOS_YEAR		0x09
+	#define CMOS_STATUS_A		0x0A
+	#define CMOS_STATUS_B		0x0B
+	#define CMOS_STATUS_C		0x0C
+
+	// Status register A: the low four bits select the periodic interrupt's rate,
+	// which is 32768 >> (rate - 1) Hz.
+	#define CMOS_A_RATE_MASK	0x0F
+
+	// Status register B: the interrupt enables, and the data formats.
+	#define CMOS_B_PERIODIC		0x40
+	#define CMOS_B_UPDATE_ENDED	0x10
+	#define CMOS_B_BINARY		0x04
+	#define CMOS_B_24_HOUR		0x02
+
+	// Status register C, which says which interrupts are pending, and is cleared
+	// (acknowledging them) by reading it.
+	#define CMOS_C_PERIODIC		0x40
+	#define CMOS_C_UPDATE_ENDED	0x10
+
+	/* Serialises access to the CMOS, as each read is a pair of port accesses */
+	extern SpinLock cmos_lock;
+
+	static inline uint8_t cmos_read(uint8_t reg)
+	{
+		UniqueIRQSpinLock l(cmos_lock);
+
+		infos::arch::x86::__outb(CMOS_ADDRESS, reg);
+		return infos::arch::x86::__inb(CMOS_DATA);
+	}
+
+	static inline void cmos_write(uint8_t reg, uint8_t value)
+	{
+		UniqueIRQSpinLock l(cmos_lock);
+
+		infos::arch::x86::__outb(CMOS_ADDRESS, reg);
+		infos::arch::x86::__outb(CMOS_DATA, value);
+	}
+
+	/* Clears and then sets bits in a register, without anybody else getting in
+	between the read and the write */
+	static inline void cmos_update(uint8_t reg, uint8_t clear, uint8_t set)
+	{
+		UniqueIRQSpinLock l(cmos_lock);
+
+		infos::arch::x86::__outb(CMOS_ADDRESS, reg);
+		uint8_t value = infos::arch::x86::__inb(CMOS_DATA);
+
+		infos::arch::x86::__outb(CMOS_ADDRESS, reg);
+		infos::arch::x86::__outb(CMOS_DATA, (value & ~clear) | set);
+	}
+
+	/* Returns TRUE if the RTC is part-way through updating its time registers */
+	static inline bool cmos_update_in_progress()
+	{
+		// bit 7 of status register A is set from just before an update until
+		// it has finished
+		return cmos_read(CMOS_STATUS_A) & 0x80;
+	}
+
+	/* Reads the time registers as they are, which may be part-way through an update */
+	static inline void cmos_read_registers(infos::drivers::timer::RTCTimePoint& tp)
+	{
+		tp.seconds = cmos_read(CMOS_SECONDS);
+		tp.minutes = cmos_read(CMOS_MINUTES);
+		tp.hours = cmos_read(CMOS_HOURS);
+		tp.day_of_month = cmos_read(CMOS_DAY_OF_MONTH);
+		tp.month = cmos_read(CMOS_MONTH);
+		tp.year = cmos_read(CMOS_YEAR);
+	}
+
+	static inline bool cmos_timepoints_equal(const infos::drivers::timer::RTCTimePoint& a, const infos::drivers::timer::RTCTimePoint& b)
+	{
+		return a.seconds == b.seconds && a.minutes == b.minutes && a.hours == b.hours &&
+			a.day_of_month == b.day_of_month && a.month == b.month && a.year == b.year;
+	}
+
+	/**
+	 * Converts time registers read from the RTC to binary and 24-hour time, if
+	 * status register B says they are in BCD or 12-hour time.
+	 */
+	static inline void cmos_convert_timepoint(infos::drivers::timer::RTCTimePoint& tp, uint8_t status_b)
+	{
+		// convert BCD to binary values if necessary
+		if (!(status_b & CMOS_B_BINARY)) {
+			tp.seconds = (tp.seconds & 0x0F) + ((tp.seconds / 16) * 10);
+			tp.minutes = (tp.minutes & 0x0F) + ((tp.minutes / 16) * 10);
+			tp.hours = ((tp.hours & 0x0F) + (((tp.hours & 0x70) / 16) * 10)) | (tp.hours & 0x80);
+			tp.day_of_month = (tp.day_of_month & 0x0F) + ((tp.day_of_month / 16) * 10);
+			tp.month = (tp.month & 0x0F) + ((tp.month / 16) * 10);
+			tp.year = (tp.year & 0x0F) + ((tp.year / 16) * 10);
+		}
+
+		// convert 12 hour clock to 24 hour clock if necessary (i.e. if we are in
+		// 12-hour mode and the PM bit is set)
+		if (!(status_b & CMOS_B_24_HOUR) && (tp.hours & 0x80)) {
+			tp.hours = ((tp.hours & 0x7F) + 12) % 24;
+		}
+	}
+
+	/**
+	 * Reads the date and time from the RTC, converted to binary and 24-hour time.
+	 * The registers are read until two reads in a row match, so that an update
+	 * part-way through can't give a mixture of old and new values.  The year is
+	 * the two digits the RTC holds.
+	 */
+	static inline void cmos_read_timepoint(infos::drivers::timer::RTCTimePoint& tp)
+	{
+		infos::drivers::timer::RTCTimePoint prev;
+
+		while (cmos_update_in_progress());
+		cmos_read_registers(tp);
+
+		do {
+			prev = tp;
+			while (cmos_update_in_progress());
+			cmos_read_registers(tp);
+		} while (!cmos_timepoints_equal(prev, tp));
+
+		cmos_convert_timepoint(tp, cmos_read(CMOS_STATUS_B));
+	}
+}
+
+#endif /* COURSEWORK_CMOS_H */
@@ -0,0 +1,38 @@
+/*
+ * Levelled Logging
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "klog.h"
+#include <infos/kernel/cmdline.h>
+
+using namespace infos::kernel;
+using namespace coursework;
+
+LogLevel::LogLevel coursework::klog_level = LogLevel::INFO;
+
+static const struct {
+	const char *name;
+	LogLevel::LogLevel level;
+} level_names[] = {
+	{ "debug", LogLevel::DEBUG },
+	{ "info", LogLevel::INFO },
+	{ "important", LogLevel::IMPORTANT },
+	{ "warning", LogLevel::WARNING },
+	{ "error", LogLevel::ERROR },
+	{ "fatal", LogLevel::FATAL },
+};
+
+RegisterCmdLineArgument(KLogLevel, "klog.level")
+{
+	for (unsigned int i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+		if (strcmp(level_names[i].name, value) == 0) {
+			klog_level = level_names[i].level;
+			return;
+		}
+	}
+
+	syslog.messagef(LogLevel::WARNING, "klog: unknown level '%s'", value);
+}
@@ -0,0 +1,43 @@
+/*
+ * Levelled Logging Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_KLOG_H
+#define COURSEWORK_KLOG_H
+
+#include <infos/kernel/log.h>
+
+// The least important level that is built in at all, e.g. -DKLOG_MIN_LEVEL=DEBUG.
+// Anything less important is removed at compile time, arguments and all.
+#ifndef KLOG_MIN_LEVEL
+#define KLOG_MIN_LEVEL INFO
+#endif
+
+namespace coursework {
+
+	/* The least important level that is logged, set by klog.level=<name> */
+	extern infos::kernel::LogLevel::LogLevel klog_level;
+}
+
+/* TRUE if messages at the given level are both built in and wanted, for guarding
+work that only exists to produce them */
+#define KLOG_ENABLED(level) \
+	(infos::kernel::LogLevel::level >= infos::kernel::LogLevel::KLOG_MIN_LEVEL && \
+	 infos::kernel::LogLevel::level >= coursework::klog_level)
+
+/**
+ * Logs a formatted message to a component log, if its level is enabled.  Both
+ * checks come before the arguments are evaluated, and the first is a constant,
+ * so a message below KLOG_MIN_LEVEL compiles to nothing.
+ */
+#define KLOG(log, level, ...) \
+	do { \
+		if (KLOG_ENABLED(level)) { \
+			(log).messagef(infos::kernel::LogLevel::level, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#endif /* COURSEWORK_KLOG_H */
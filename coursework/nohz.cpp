@@ -0,0 +1,170 @@
+/*
+ * Tickless Scheduling
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "nohz.h"
+#include "cmdline-util.h"
+#include "percpu-sched.h"
+#include "tsc.h"
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/cmdline.h>
+
+using namespace infos::kernel;
+using namespace infos::drivers::timer;
+using namespace coursework;
+
+// The longest the tick is stopped for at a time, in milliseconds, or zero to
+// never stop it.
+static uint64_t nohz_max_ms = 0;
+
+// The rate of the periodic tick, for restoring it.
+static uint64_t nohz_tick_hz = 100;
+
+RegisterCmdLineArgument(NoHZ, "sched.nohz")
+{
+	nohz_max_ms = parse_cmdline_number(value);
+}
+
+RegisterCmdLineArgument(NoHZTickRate, "sched.nohz.hz")
+{
+	uint64_t hz = parse_cmdline_number(value);
+	if (hz > 0) {
+		nohz_tick_hz = hz;
+	}
+}
+
+TickControl coursework::tick_control;
+
+TickControl::TickControl() : _timer(NULL), _stats("nohz", read_stats, NULL, this)
+{
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		_cpus[i].stopped = false;
+		_cpus[i].stopped_at = 0;
+		_cpus[i].stopped_cycles = 0;
+		_cpus[i].nr_stops = 0;
+		_cpus[i].nr_restarts = 0;
+		_cpus[i].nr_rearms = 0;
+	}
+}
+
+/**
+ * Looks up the APIC timer the first time it is needed, as it doesn't exist yet
+ * when this is constructed.
+ * @return Returns TRUE if tickless operation is enabled and possible.
+ */
+bool TickControl::find_timer()
+{
+	if (nohz_max_ms == 0) {
+		return false;
+	}
+
+	if (_timer) {
+		return true;
+	}
+
+	LAPICTimer *timer;
+	if (!sys.device_manager().try_get_device_by_class(LAPICTimer::LAPICTimerDeviceClass, timer)) {
+		syslog.messagef(LogLevel::WARNING, "nohz: no local APIC timer, leaving the tick running");
+		nohz_max_ms = 0;
+		return false;
+	}
+
+	_timer = timer;
+	return true;
+}
+
+/**
+ * Replaces the periodic tick with a single, longer one.  Called again at each
+ * pick while the tick is stopped, to push the one-shot back.
+ */
+void TickControl::stop_tick(CPU& cpu)
+{
+	_timer->stop();
+	_timer->init_oneshot((_timer->frequency() * nohz_max_ms) / 1000);
+	_timer->start();
+
+	if (cpu.stopped) {
+		cpu.nr_rearms++;
+	} else {
+		cpu.stopped = true;
+		cpu.stopped_at = rdtsc();
+		cpu.nr_stops++;
+	}
+}
+
+/**
+ * Puts the periodic tick back.
+ */
+void TickControl::restart_tick(CPU& cpu)
+{
+	_timer->stop();
+	_timer->init_periodic(_timer->frequency() / nohz_tick_hz);
+	_timer->start();
+
+	cpu.stopped = false;
+	cpu.stopped_cycles += rdtsc() - cpu.stopped_at;
+	cpu.nr_restarts++;
+}
+
+void TickControl::picked(unsigned int nr_runnable)
+{
+	if (!find_timer()) {
+		return;
+	}
+
+	CPU& cpu = _cpus[current_cpu() % NR_CPU_SLOTS];
+
+	if (nr_runnable <= 1) {
+		stop_tick(cpu);
+	} else if (cpu.stopped) {
+		restart_tick(cpu);
+	}
+}
+
+void TickControl::enqueued(unsigned int cpu)
+{
+	if (!find_timer()) {
+		return;
+	}
+
+	// only the CPU itself can reprogram its timer
+	unsigned int this_cpu = current_cpu();
+	if (cpu % NR_CPU_SLOTS != this_cpu % NR_CPU_SLOTS) {
+		return;
+	}
+
+	CPU& c = _cpus[this_cpu % NR_CPU_SLOTS];
+	if (c.stopped) {
+		restart_tick(c);
+	}
+}
+
+size_t TickControl::read_stats(char *buffer, size_t size, void *arg)
+{
+	TickControl *control = (TickControl *)arg;
+	size_t pos = 0;
+
+	stats_printf(buffer, size, pos, "max_stopped_ms %lu\n", nohz_max_ms);
+	stats_printf(buffer, size, pos, "tick_hz %lu\n", nohz_tick_hz);
+
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		const CPU& cpu = control->_cpus[i];
+		if (cpu.nr_stops == 0) {
+			continue;
+		}
+
+		stats_printf(buffer, size, pos, "cpu%u_stopped %u\n", i, cpu.stopped ? 1 : 0);
+		stats_printf(buffer, size, pos, "cpu%u_stops %lu\n", i, cpu.nr_stops);
+		stats_printf(buffer, size, pos, "cpu%u_restarts %lu\n", i, cpu.nr_restarts);
+		stats_printf(buffer, size, pos, "cpu%u_rearms %lu\n", i, cpu.nr_rearms);
+
+		// Cycles spent with the tick stopped, not counting the current stretch.
+		stats_printf(buffer, size, pos, "cpu%u_stopped_cycles %lu\n", i, cpu.stopped_cycles);
+	}
+
+	return pos;
+}
@@ -0,0 +1,69 @@
+/*
+ * Tickless Scheduling Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_NOHZ_H
+#define COURSEWORK_NOHZ_H
+
+#include <infos/drivers/timer/lapic-timer.h>
+
+#include "stats.h"
+
+namespace coursework {
+
+	/**
+	 * Stops the periodic scheduler tick on a CPU while there is nothing for it to
+	 * preempt, i.e. while at most one entity is runnable there, and restarts it as
+	 * soon as that changes.  Algorithms tell it how many entities are runnable
+	 * after each pick, and when they queue an entity.
+	 *
+	 * Other parts of the kernel (sleeping threads in particular) still rely on the
+	 * tick, so instead of stopping outright the local APIC timer is switched to a
+	 * one-shot of sched.nohz=<milliseconds>, and re-armed at each pick until the
+	 * tick is needed again.  The default of zero leaves the tick alone.
+	 *
+	 * The APIC timer is per-CPU, so a CPU only ever reprograms its own: an entity
+	 * queued on another CPU whose tick is stopped waits for that CPU's one-shot.
+	 * Counters are published as /.stats/nohz.
+	 */
+	class TickControl {
+	public:
+		static const unsigned int NR_CPU_SLOTS = 16;
+
+		TickControl();
+
+		/* An entity has been picked on the calling CPU, which now has the given
+		number of runnable entities (including the one picked).  An algorithm
+		that needs the tick for anything else passes at least two */
+		void picked(unsigned int nr_runnable);
+
+		/* An entity has been queued to run on the given CPU */
+		void enqueued(unsigned int cpu = 0);
+
+	private:
+		struct CPU {
+			bool stopped;
+			uint64_t stopped_at, stopped_cycles;
+			uint64_t nr_stops, nr_restarts, nr_rearms;
+		};
+
+		bool find_timer();
+		void stop_tick(CPU& cpu);
+		void restart_tick(CPU& cpu);
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+
+		infos::drivers::timer::LAPICTimer *_timer;
+		CPU _cpus[NR_CPU_SLOTS];
+
+		StatsEntry _stats;
+	};
+
+	/* The tick control shared by every scheduling algorithm */
+	extern TickControl tick_control;
+}
+
+#endif /* COURSEWORK_NOHZ_H */
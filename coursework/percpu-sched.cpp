@@ -0,0 +1,445 @@
+/*
+ * Per-CPU Run Queue Scheduling Framework
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "percpu-sched.h"
+#include "nohz.h"
+#include "sched-stats.h"
+#include "tsc.h"
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+
+// CPUs are numbered in the order they first ask, from their local APIC IDs.
+// Entries are the CPU index plus one, so that zero means unassigned.
+static unsigned int apic_to_cpu[256];
+static unsigned int nr_cpus;
+
+// Once numbered, a CPU keeps its index (plus one) in its TSC_AUX MSR, which
+// rdpid and rdtscp read without leaving the guest, unlike cpuid.
+#define MSR_TSC_AUX	0xc0000103
+
+enum CPUIndexSource { UnknownSource, RDPIDSource, RDTSCPSource, CPUIDSource };
+static unsigned int cpu_index_source;
+
+/**
+ * Works out the cheapest way of finding the calling CPU's index that every CPU
+ * supports.  This only runs once, so the cost of cpuid doesn't matter here.
+ */
+static unsigned int detect_cpu_index_source()
+{
+	uint32_t eax, ebx, ecx, edx;
+	unsigned int source = CPUIDSource;
+
+	cpuid(0, eax, ebx, ecx, edx);
+	if (eax >= 7) {
+		cpuid(7, eax, ebx, ecx, edx);
+		if (ecx & (1 << 22)) {
+			source = RDPIDSource;
+		}
+	}
+
+	if (source == CPUIDSource) {
+		cpuid(0x80000000, eax, ebx, ecx, edx);
+		if (eax >= 0x80000001) {
+			cpuid(0x80000001, eax, ebx, ecx, edx);
+			if (edx & (1 << 27)) {
+				source = RDTSCPSource;
+			}
+		}
+	}
+
+	__atomic_store_n(&cpu_index_source, source, __ATOMIC_RELAXED);
+	return source;
+}
+
+/**
+ * Numbers the calling CPU from its local APIC ID, which is the slow path: cpuid
+ * is serialising, and causes a VM exit under virtualisation.
+ */
+static unsigned int cpu_from_apic_id()
+{
+	uint32_t eax, ebx, ecx, edx;
+	cpuid(1, eax, ebx, ecx, edx);
+
+	unsigned int apic_id = ebx >> 24;
+
+	unsigned int cpu = __atomic_load_n(&apic_to_cpu[apic_id], __ATOMIC_ACQUIRE);
+	if (cpu) {
+		return cpu - 1;
+	}
+
+	// First time this CPU has asked.  If there are more CPUs than queues,
+	// some of them will share.
+	unsigned int assigned = (__atomic_fetch_add(&nr_cpus, 1, __ATOMIC_RELAXED) % MAX_CPUS) + 1;
+	if (!__atomic_compare_exchange_n(&apic_to_cpu[apic_id], &cpu, assigned, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		return cpu - 1;
+	}
+
+	return assigned - 1;
+}
+
+/**
+ * Returns the index of the calling CPU.  After the first call on each CPU, this
+ * is a single rdpid (or rdtscp), as long as the CPU has one of them.
+ * @return Returns a number from zero up to MAX_CPUS - 1.
+ */
+unsigned int coursework::current_cpu()
+{
+	uint64_t tsc;
+	return current_cpu_tsc(tsc);
+}
+
+/**
+ * Returns the index of the calling CPU, and reads its time stamp counter, with
+ * a single rdtscp where the CPU has it.
+ * @param tsc Receives the value of the time stamp counter.
+ * @return Returns a number from zero up to MAX_CPUS - 1.
+ */
+unsigned int coursework::current_cpu_tsc(uint64_t& tsc)
+{
+	unsigned int source = __atomic_load_n(&cpu_index_source, __ATOMIC_RELAXED);
+	if (source == UnknownSource) {
+		source = detect_cpu_index_source();
+	}
+
+	uint32_t lo, hi;
+
+	if (source == RDTSCPSource) {
+		uint32_t aux;
+		asm volatile("rdtscp" : "=a"(lo), "=d"(hi), "=c"(aux));
+		tsc = ((uint64_t)hi << 32) | lo;
+
+		if (aux) {
+			return aux - 1;
+		}
+	} else {
+		asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+		tsc = ((uint64_t)hi << 32) | lo;
+
+		if (source == RDPIDSource) {
+			uint64_t aux;
+			asm volatile("rdpid %0" : "=r"(aux));
+
+			if (aux) {
+				return aux - 1;
+			}
+		}
+	}
+
+	unsigned int cpu = cpu_from_apic_id();
+
+	// TSC_AUX starts off as zero, so this is the first time this CPU has been
+	// asked.  Leave its index where rdpid and rdtscp will find it next time.
+	if (source != CPUIDSource) {
+		asm volatile("wrmsr" : : "c"(MSR_TSC_AUX), "a"(cpu + 1), "d"(0));
+	}
+
+	return cpu;
+}
+
+/**
+ * Returns the number of CPUs that have run queues in use.
+ */
+static unsigned int nr_online_cpus()
+{
+	unsigned int n = __atomic_load_n(&nr_cpus, __ATOMIC_RELAXED);
+	return n == 0 ? 1 : __min(n, (unsigned int)MAX_CPUS);
+}
+
+PerCPUScheduler::PerCPUScheduler(const char *stats_name) : _stats(stats_name, read_stats, NULL, this)
+{
+	for (unsigned int i = 0; i < MAX_CPUS; i++) {
+		_cpus[i].current = NULL;
+		_cpus[i].picks = 0;
+		_cpus[i].nr_picks = 0;
+		_cpus[i].nr_steals = 0;
+		_cpus[i].nr_pushes = 0;
+	}
+}
+
+/**
+ * Returns the CPU with the shortest run queue.  Queue lengths are read without
+ * locking, as this is only a heuristic.
+ */
+unsigned int PerCPUScheduler::least_loaded_cpu() const
+{
+	unsigned int best = 0;
+	for (unsigned int i = 1; i < nr_online_cpus(); i++) {
+		if (_cpus[i].queue.count() < _cpus[best].queue.count()) {
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Returns the CPU with the longest run queue, other than the given one, or
+ * NO_CPU if every other queue is empty.
+ */
+unsigned int PerCPUScheduler::busiest_cpu(unsigned int except) const
+{
+	unsigned int best = NO_CPU;
+	for (unsigned int i = 0; i < nr_online_cpus(); i++) {
+		if (i == except || _cpus[i].queue.empty()) {
+			continue;
+		}
+
+		if (best == NO_CPU || _cpus[i].queue.count() > _cpus[best].queue.count()) {
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Locks the run queue that an entity is on.  The entity can be stolen whilst
+ * this is waiting for the lock, so this checks it is still on the same queue
+ * once it has it.  Must be called with interrupts disabled.
+ * @return Returns the index of the CPU whose queue is locked.
+ */
+unsigned int PerCPUScheduler::lock_queue_of(QueuedEntity& queued)
+{
+	for (;;) {
+		unsigned int cpu = __atomic_load_n(&queued.cpu, __ATOMIC_ACQUIRE);
+
+		_cpus[cpu].lock.lock();
+		if (queued.cpu == cpu) {
+			return cpu;
+		}
+		_cpus[cpu].lock.unlock();
+	}
+}
+
+/**
+ * Moves an entity that isn't running from one CPU's run queue to another's.
+ * Must be called with interrupts disabled.
+ * @return Returns TRUE if an entity was moved.
+ */
+bool PerCPUScheduler::steal(unsigned int to, unsigned int from)
+{
+	if (from == NO_CPU || from == to) {
+		return false;
+	}
+
+	lock_pair(to, from);
+
+	CPUQueue& source = _cpus[from].queue;
+
+	// The entity at the front is the one the other CPU would have run next.
+	QueuedEntity *victim = source.first();
+	while (victim && victim->running) {
+		victim = source.next(*victim);
+	}
+
+	if (victim) {
+		source.remove(*victim);
+		__atomic_store_n(&victim->cpu, to, __ATOMIC_RELEASE);
+		_cpus[to].queue.enqueue(*victim);
+		_cpus[to].nr_steals++;
+	}
+
+	unlock_pair(to, from);
+
+	return victim != NULL;
+}
+
+/**
+ * Locks the run queues of two CPUs, which may be the same one.  They are always
+ * locked in the same order, so that two CPUs locking each other's queues can't
+ * deadlock.  Must be called with interrupts disabled.
+ */
+void PerCPUScheduler::lock_pair(unsigned int a, unsigned int b)
+{
+	_cpus[__min(a, b)].lock.lock();
+	if (a != b) {
+		_cpus[__max(a, b)].lock.lock();
+	}
+}
+
+void PerCPUScheduler::unlock_pair(unsigned int a, unsigned int b)
+{
+	if (a != b) {
+		_cpus[__max(a, b)].lock.unlock();
+	}
+	_cpus[__min(a, b)].lock.unlock();
+}
+
+/**
+ * Called when a scheduling entity becomes eligible for running.  The entity
+ * goes back onto the CPU it last ran on, unless that CPU is overloaded.
+ * @param entity
+ */
+void PerCPUScheduler::add_to_runqueue(SchedulingEntity& entity)
+{
+	// grow the tables now if they need to, as they can't with interrupts disabled
+	_entities.reserve();
+	sched_stats.reserve(entity);
+
+	// disabling interrupts
+	UniqueIRQLock l;
+
+	_entities_lock.lock();
+	QueuedEntity *queued = _entities.get(entity);
+
+	// a new entity starts out belonging to the CPU that woke it
+	if (queued && queued->cpu == NO_CPU) {
+		__atomic_store_n(&queued->cpu, current_cpu(), __ATOMIC_RELEASE);
+	}
+
+	_entities_lock.unlock();
+
+	if (!queued) {
+		syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+		return;
+	}
+
+	unsigned int target;
+	for (;;) {
+		unsigned int home = __atomic_load_n(&queued->cpu, __ATOMIC_ACQUIRE);
+		unsigned int least = least_loaded_cpu();
+
+		target = home;
+		if (_cpus[home].queue.count() > _cpus[least].queue.count() + IMBALANCE_THRESHOLD) {
+			target = least;
+		}
+
+		// The entity's queued state and CPU only change with its home CPU's lock
+		// held, so with that lock, a concurrent wakeup (or a steal) can't also
+		// be putting it on a queue.
+		lock_pair(home, target);
+
+		if (queued->cpu != home) {
+			unlock_pair(home, target);
+			continue;
+		}
+
+		if (queued->link.queued()) {
+			unlock_pair(home, target);
+			return;
+		}
+
+		__atomic_store_n(&queued->cpu, target, __ATOMIC_RELEASE);
+		_cpus[target].queue.enqueue(*queued);
+		if (target != home) {
+			_cpus[target].nr_pushes++;
+		}
+
+		unlock_pair(home, target);
+		break;
+	}
+
+	sched_stats.enqueued(entity);
+	tick_control.enqueued(target);
+}
+
+/**
+ * Called when a scheduling entity is no longer eligible for running.
+ * @param entity
+ */
+void PerCPUScheduler::remove_from_runqueue(SchedulingEntity& entity)
+{
+	// disabling interrupts
+	UniqueIRQLock l;
+
+	_entities_lock.lock();
+	QueuedEntity *queued = _entities.find(entity);
+	_entities_lock.unlock();
+
+	if (!queued || queued->cpu == NO_CPU) {
+		return;
+	}
+
+	unsigned int cpu = lock_queue_of(*queued);
+
+	if (queued->link.queued()) {
+		_cpus[cpu].queue.remove(*queued);
+	}
+
+	if (_cpus[cpu].current == queued) {
+		_cpus[cpu].current = NULL;
+		queued->running = false;
+	}
+
+	_cpus[cpu].lock.unlock();
+
+	sched_stats.dequeued(entity);
+
+	// a stopped entity never runs again, so its queue entry can go
+	if (entity.stopped()) {
+		_entities_lock.lock();
+		_entities.release(queued);
+		_entities_lock.unlock();
+	}
+}
+
+/**
+ * Called every time a scheduling event occurs on a CPU, to choose what it runs
+ * next.  Each CPU round-robins through its own queue, pulling work over from the
+ * busiest CPU when it has none, or periodically when the two are out of balance.
+ */
+SchedulingEntity *PerCPUScheduler::pick_next_entity()
+{
+	// disabling interrupts
+	UniqueIRQLock l;
+
+	unsigned int this_cpu = current_cpu();
+	CPU& cpu = _cpus[this_cpu];
+
+	if (cpu.queue.empty()) {
+		steal(this_cpu, busiest_cpu(this_cpu));
+	} else if ((++cpu.picks % BALANCE_INTERVAL) == 0) {
+		unsigned int busiest = busiest_cpu(this_cpu);
+		if (busiest != NO_CPU && _cpus[busiest].queue.count() > cpu.queue.count() + IMBALANCE_THRESHOLD) {
+			steal(this_cpu, busiest);
+		}
+	}
+
+	cpu.lock.lock();
+
+	if (cpu.current) {
+		cpu.current->running = false;
+	}
+
+	QueuedEntity *next = cpu.queue.first();
+	if (next) {
+		cpu.queue.rotate();
+		next->running = true;
+		cpu.nr_picks++;
+	}
+
+	cpu.current = next;
+	unsigned int nr_runnable = cpu.queue.count();
+
+	cpu.lock.unlock();
+
+	sched_stats.picked(next ? next->entity : NULL, this_cpu);
+	tick_control.picked(nr_runnable);
+
+	return next ? next->entity : NULL;
+}
+
+size_t PerCPUScheduler::read_stats(char *buffer, size_t size, void *arg)
+{
+	PerCPUScheduler *sched = (PerCPUScheduler *)arg;
+	size_t pos = 0;
+
+	for (unsigned int i = 0; i < nr_online_cpus(); i++) {
+		const CPU& cpu = sched->_cpus[i];
+
+		stats_printf(buffer, size, pos, "cpu%u_queued %u\n", i, cpu.queue.count());
+		stats_printf(buffer, size, pos, "cpu%u_picks %lu\n", i, cpu.nr_picks);
+		stats_printf(buffer, size, pos, "cpu%u_steals %lu\n", i, cpu.nr_steals);
+		stats_printf(buffer, size, pos, "cpu%u_pushes %lu\n", i, cpu.nr_pushes);
+	}
+
+	return pos;
+}
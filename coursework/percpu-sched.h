@@ -0,0 +1,104 @@
+/*
+ * Per-CPU Run Queue Scheduling Framework Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_PERCPU_SCHED_H
+#define COURSEWORK_PERCPU_SCHED_H
+
+#include <infos/kernel/sched.h>
+
+#include "runqueue.h"
+#include "spinlock.h"
+#include "stats.h"
+
+namespace coursework {
+
+	/* The most CPUs the framework keeps run queues for */
+	#define MAX_CPUS 16
+
+	/* Returns the index of the calling CPU, from zero up to MAX_CPUS - 1 */
+	unsigned int current_cpu();
+
+	/* Returns the index of the calling CPU, and reads its time stamp counter */
+	unsigned int current_cpu_tsc(uint64_t& tsc);
+
+	/**
+	 * A scheduling framework with a round-robin run queue per CPU, so that CPUs
+	 * only contend with each other when work moves between them.
+	 *
+	 * - Affinity: an entity is queued on the CPU it last ran on, to keep its cache
+	 *   warm, unless that CPU is clearly busier than the least loaded one, in which
+	 *   case the entity is pushed there instead.
+	 * - Stealing: a CPU that runs out of work pulls an entity from the busiest run
+	 *   queue, and every BALANCE_INTERVAL picks a CPU also pulls from the busiest
+	 *   queue if the two are out of balance.
+	 *
+	 * Entities that are running are never moved.  Derived schedulers provide the
+	 * name, and may override the balancing parameters.
+	 */
+	class PerCPUScheduler : public infos::kernel::SchedulingAlgorithm {
+	public:
+		/* How much longer one queue must be than another before work moves */
+		static const unsigned int IMBALANCE_THRESHOLD = 2;
+
+		/* The number of picks between periodic balancing checks */
+		static const unsigned int BALANCE_INTERVAL = 16;
+
+		PerCPUScheduler(const char *stats_name);
+
+		void add_to_runqueue(infos::kernel::SchedulingEntity& entity) override;
+		void remove_from_runqueue(infos::kernel::SchedulingEntity& entity) override;
+		infos::kernel::SchedulingEntity *pick_next_entity() override;
+
+	private:
+		struct QueuedEntity {
+			QueuedEntity() : entity(NULL), cpu(NO_CPU), running(false) { }
+
+			infos::kernel::SchedulingEntity *entity;
+			RunQueueLink link;
+
+			// The CPU whose queue the entity is on, or last ran on if it isn't
+			// queued.  This, and whether the entity is queued, only change with
+			// that CPU's lock held.
+			unsigned int cpu;
+
+			// Whether the entity is the one its CPU is currently running.
+			bool running;
+		};
+
+		typedef RunQueue<QueuedEntity, &QueuedEntity::link> CPUQueue;
+
+		struct CPU {
+			SpinLock lock;
+			CPUQueue queue;
+			QueuedEntity *current;
+			unsigned int picks;
+
+			uint64_t nr_picks, nr_steals, nr_pushes;
+		};
+
+		static const unsigned int NO_CPU = ~0u;
+
+		unsigned int least_loaded_cpu() const;
+		unsigned int busiest_cpu(unsigned int except) const;
+		bool steal(unsigned int to, unsigned int from);
+		unsigned int lock_queue_of(QueuedEntity& queued);
+		void lock_pair(unsigned int a, unsigned int b);
+		void unlock_pair(unsigned int a, unsigned int b);
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+
+		// Protects the entity table, and the cpu field of entities that are new.
+		SpinLock _entities_lock;
+		EntityTable<QueuedEntity> _entities;
+
+		CPU _cpus[MAX_CPUS];
+
+		StatsEntry _stats;
+	};
+}
+
+#endif /* COURSEWORK_PERCPU_SCHED_H */
@@ -0,0 +1,372 @@
+/*
+ * Sampling Profiler
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "profiler.h"
+#include "cmdline-util.h"
+#include "cmos.h"
+#include "percpu-sched.h"
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/cmdline.h>
+
+using namespace infos::kernel;
+using namespace coursework;
+
+// The rate to start sampling at once the RTC is ready, or zero to wait to be told.
+static unsigned int profile_hz;
+
+RegisterCmdLineArgument(Profile, "profile")
+{
+	profile_hz = parse_cmdline_number(value);
+}
+
+Profiler coursework::profiler;
+
+Profiler::Profiler() : _ready(false), _running(false), _hz(0), _stats("profile", read_stats, write_stats, this)
+{
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		_cpus[i].samples = NULL;
+		_cpus[i].count = 0;
+		_cpus[i].nr_dropped = 0;
+		_cpus[i].nr_unknown = 0;
+	}
+}
+
+void Profiler::rtc_ready()
+{
+	_ready = true;
+
+	if (profile_hz) {
+		start(profile_hz);
+	}
+}
+
+// How far up the stack from the handler's frame to look for the interrupt frame,
+// in words.  The entry path and the irq dispatch only take a few hundred bytes.
+#define MAX_FRAME_SEARCH	256
+
+#define RFLAGS_RESERVED		(1ULL << 1)
+#define RFLAGS_IF		(1ULL << 9)
+
+static inline bool is_kernel_address(uint64_t addr)
+{
+	return addr >= 0xffff800000000000ULL;
+}
+
+static inline bool is_user_address(uint64_t addr)
+{
+	return addr < 0x0000800000000000ULL;
+}
+
+/**
+ * Finds the instruction the interrupt arrived at, by searching up the stack from
+ * the handler's frame for what the CPU pushed on entry: rip, cs, rflags, rsp and
+ * ss.  The frames of the entry path in between belong to the infos submodule, so
+ * there is no fixed offset to take the frame from, and the search goes by what is
+ * always true of a frame pushed by an external interrupt: RFLAGS has its reserved
+ * bit set, and interrupts enabled; the selectors have the same privilege level,
+ * of 0 or 3; and the frame sits where the CPU would have put it.  For the kernel,
+ * the CPU pushes it onto the interrupted stack after aligning that to 16 bytes,
+ * so the saved rsp rounded down to 16 bytes is the address just above the frame.
+ * For user mode, it is pushed at the top of the (aligned) kernel stack.
+ *
+ * Stale words further up the stack can still happen to look like such a frame, in
+ * which case the sample is attributed to the wrong address, so the histogram is a
+ * guide rather than an exact count.
+ * @return Returns the interrupted instruction pointer, or zero if no frame
+ * was found.
+ */
+static uintptr_t interrupted_rip(const void *handler_frame)
+{
+	const uint64_t *stack = (const uint64_t *)handler_frame;
+
+	for (unsigned int i = 0; i < MAX_FRAME_SEARCH; i++) {
+		const uint64_t *frame = &stack[i];
+		uint64_t rip = frame[0], cs = frame[1], rflags = frame[2], rsp = frame[3], ss = frame[4];
+
+		if (cs == 0 || cs > 0xffff || (rflags >> 22) != 0 || !(rflags & RFLAGS_RESERVED) || !(rflags & RFLAGS_IF)) {
+			continue;
+		}
+
+		if (ss > 0xffff || (ss & 3) != (cs & 3)) {
+			continue;
+		}
+
+		if ((cs & 3) == 0) {
+			if (is_kernel_address(rip) && is_kernel_address(rsp) && (rsp & ~15ULL) == (uintptr_t)&frame[5]) {
+				return rip;
+			}
+		} else if ((cs & 3) == 3) {
+			if (is_user_address(rip) && is_user_address(rsp) && ss != 0 && ((uintptr_t)&frame[5] & 15) == 0) {
+				return rip;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Records one sample.  Only ever called from the RTC interrupt, so nothing else
+ * writes to this CPU's buffer at the same time.
+ */
+void Profiler::sample(const void *handler_frame)
+{
+	if (!__atomic_load_n(&_running, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	CPU& cpu = _cpus[current_cpu() % NR_CPU_SLOTS];
+	if (cpu.count == NR_SAMPLES) {
+		cpu.nr_dropped++;
+		return;
+	}
+
+	Sample& sample = cpu.samples[cpu.count];
+	sample.rip = interrupted_rip(handler_frame);
+	if (!sample.rip) {
+		cpu.nr_unknown++;
+	}
+	sample.thread = &Thread::current();
+
+	__atomic_store_n(&cpu.count, cpu.count + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Programs the RTC's periodic interrupt rate.  The RTC can only divide its 32 kHz
+ * clock by powers of two, and anything faster than 8 kHz isn't reliable.
+ */
+void Profiler::set_rate(unsigned int hz)
+{
+	if (hz < MIN_HZ) hz = MIN_HZ;
+	if (hz > MAX_HZ) hz = MAX_HZ;
+
+	// round down to a power of two, which is 2^(16 - rate)
+	unsigned int log2_hz = 31 - __builtin_clz(hz);
+	_hz = 1u << log2_hz;
+
+	cmos_update(CMOS_STATUS_A, CMOS_A_RATE_MASK, 16 - log2_hz);
+}
+
+void Profiler::set_running(bool running)
+{
+	__atomic_store_n(&_running, running, __ATOMIC_RELEASE);
+
+	if (running) {
+		cmos_update(CMOS_STATUS_B, 0, CMOS_B_PERIODIC);
+	} else {
+		cmos_update(CMOS_STATUS_B, CMOS_B_PERIODIC, 0);
+	}
+}
+
+bool Profiler::start(unsigned int hz)
+{
+	if (!_ready) {
+		syslog.messagef(LogLevel::ERROR, "profile: the rtc interrupt isn't available");
+		return false;
+	}
+
+	// the buffers are only allocated the first time the profiler is started
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		if (!_cpus[i].samples) {
+			_cpus[i].samples = new Sample[NR_SAMPLES];
+		}
+	}
+
+	set_rate(hz);
+	set_running(true);
+
+	syslog.messagef(LogLevel::INFO, "profile: sampling at %u Hz", _hz);
+	return true;
+}
+
+void Profiler::stop()
+{
+	if (_ready) {
+		set_running(false);
+	}
+}
+
+void Profiler::reset()
+{
+	bool was_running = _running;
+	stop();
+
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		_cpus[i].count = 0;
+		_cpus[i].nr_dropped = 0;
+		_cpus[i].nr_unknown = 0;
+	}
+
+	if (was_running) {
+		set_running(true);
+	}
+}
+
+static bool sample_less(uintptr_t rip_a, const void *thread_a, uintptr_t rip_b, const void *thread_b)
+{
+	return rip_a < rip_b || (rip_a == rip_b && thread_a < thread_b);
+}
+
+/**
+ * Writes a histogram of every sample, by address and thread, to the debug console.
+ * Sampling is paused while the buffers are read.
+ */
+void Profiler::dump()
+{
+	bool was_running = _running;
+	stop();
+
+	unsigned int total = 0;
+	uint64_t dropped = 0;
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		total += _cpus[i].count;
+		dropped += _cpus[i].nr_dropped;
+	}
+
+	char line[128];
+	size_t pos = 0;
+
+	stats_printf(line, sizeof(line), pos, "PROFILE start hz=%u samples=%u\n", _hz, total);
+	console_write(line, pos);
+
+	if (total) {
+		Sample *all = new Sample[total];
+
+		unsigned int n = 0;
+		for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+			for (unsigned int j = 0; j < _cpus[i].count; j++) {
+				all[n++] = _cpus[i].samples[j];
+			}
+		}
+
+		// sort by address and thread (a shell sort, as there are only a few
+		// thousand), so that identical samples are next to each other
+		for (unsigned int gap = n / 2; gap > 0; gap /= 2) {
+			for (unsigned int i = gap; i < n; i++) {
+				Sample s = all[i];
+				unsigned int j = i;
+				for (; j >= gap && sample_less(s.rip, s.thread, all[j - gap].rip, all[j - gap].thread); j -= gap) {
+					all[j] = all[j - gap];
+				}
+				all[j] = s;
+			}
+		}
+
+		// collapse each run into its first sample, with the run's length
+		unsigned int *counts = new unsigned int[n];
+		unsigned int runs = 0;
+		for (unsigned int i = 0; i < n; i++) {
+			if (runs && all[runs - 1].rip == all[i].rip && all[runs - 1].thread == all[i].thread) {
+				counts[runs - 1]++;
+			} else {
+				all[runs] = all[i];
+				counts[runs++] = 1;
+			}
+		}
+
+		// and print them most frequent first
+		for (unsigned int printed = 0; printed < runs; printed++) {
+			unsigned int best = 0;
+			for (unsigned int i = 1; i < runs; i++) {
+				if (counts[i] > counts[best]) {
+					best = i;
+				}
+			}
+
+			pos = 0;
+			stats_printf(line, sizeof(line), pos, "PROFILE %p %p %u\n", (void *)all[best].rip, all[best].thread, counts[best]);
+			console_write(line, pos);
+
+			counts[best] = 0;
+		}
+
+		delete[] counts;
+		delete[] all;
+	}
+
+	pos = 0;
+	stats_printf(line, sizeof(line), pos, "PROFILE done samples=%u dropped=%lu\n", total, dropped);
+	console_write(line, pos);
+
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		_cpus[i].count = 0;
+		_cpus[i].nr_dropped = 0;
+		_cpus[i].nr_unknown = 0;
+	}
+
+	if (was_running) {
+		set_running(true);
+	}
+}
+
+size_t Profiler::read_stats(char *buffer, size_t size, void *arg)
+{
+	Profiler *profiler = (Profiler *)arg;
+	size_t pos = 0;
+
+	stats_printf(buffer, size, pos, "ready %u\n", profiler->_ready ? 1 : 0);
+	stats_printf(buffer, size, pos, "running %u\n", profiler->_running ? 1 : 0);
+	stats_printf(buffer, size, pos, "hz %u\n", profiler->_hz);
+
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		const CPU& cpu = profiler->_cpus[i];
+		if (cpu.count || cpu.nr_dropped) {
+			stats_printf(buffer, size, pos, "cpu%u samples %u dropped %lu unknown_rip %lu\n", i, cpu.count, cpu.nr_dropped, cpu.nr_unknown);
+		}
+	}
+
+	return pos;
+}
+
+static bool command_is(const char *buffer, size_t size, const char *command, size_t& end)
+{
+	size_t len = strlen(command);
+	if (size < len || strncmp(buffer, command, len) != 0) {
+		return false;
+	}
+
+	if (size > len && buffer[len] != ' ' && buffer[len] != '\n') {
+		return false;
+	}
+
+	end = len;
+	return true;
+}
+
+int Profiler::write_stats(const char *buffer, size_t size, void *arg)
+{
+	Profiler *profiler = (Profiler *)arg;
+	size_t end;
+
+	if (command_is(buffer, size, "start", end)) {
+		uint64_t hz = 0;
+		if (!control_at_end(buffer, size, end)) {
+			if (!parse_control_number(buffer, size, end, hz) || !control_at_end(buffer, size, end)) {
+				return -1;
+			}
+		}
+
+		if (hz > ~0u) {
+			return -1;
+		}
+
+		return profiler->start(hz ? hz : DEFAULT_HZ) ? (int)size : -1;
+	}
+
+	if (command_is(buffer, size, "stop", end)) {
+		profiler->stop();
+	} else if (command_is(buffer, size, "dump", end)) {
+		profiler->dump();
+	} else if (command_is(buffer, size, "reset", end)) {
+		profiler->reset();
+	} else {
+		return -1;
+	}
+
+	return size;
+}
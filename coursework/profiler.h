@@ -0,0 +1,89 @@
+/*
+ * Sampling Profiler Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_PROFILER_H
+#define COURSEWORK_PROFILER_H
+
+#include "stats.h"
+
+namespace coursework {
+
+	/**
+	 * A statistical profiler, driven by the CMOS RTC's periodic interrupt.  Each
+	 * interrupt records where it arrived, and which thread it interrupted, in a
+	 * buffer for the CPU that took it, which only that CPU writes to, so sampling
+	 * takes no locks.  A buffer that fills up drops further samples.
+	 *
+	 * Writing "start [hz]", "stop", "dump" or "reset" to /.stats/profile controls
+	 * it, as does profile=<hz> on the command line, which starts it as soon as the
+	 * RTC is ready.  The rate is a power of two from 2 Hz to 8 kHz (1 kHz if
+	 * none is given).  A dump writes a histogram of the samples to the debug
+	 * console, most frequent first, as
+	 *
+	 *	PROFILE <rip> <thread> <samples>
+	 *
+	 * lines, which tools/profile-fold.py symbolises against the kernel image and
+	 * folds into flame graph input.
+	 *
+	 * The RTC interrupt is routed to a single CPU, so only that CPU is sampled.
+	 */
+	class Profiler {
+	public:
+		static const unsigned int NR_CPU_SLOTS = 16;
+		static const unsigned int NR_SAMPLES = 4096;
+
+		static const unsigned int MIN_HZ = 2;
+		static const unsigned int MAX_HZ = 8192;
+		static const unsigned int DEFAULT_HZ = 1024;
+
+		Profiler();
+
+		/* Called by the RTC driver once its interrupt is available */
+		void rtc_ready();
+
+		/* Called from the RTC's periodic interrupt, with the handler's frame
+		address, from which the interrupted instruction is found */
+		void sample(const void *handler_frame);
+
+		/* Starts sampling at (the power of two at or below) the given rate */
+		bool start(unsigned int hz);
+		void stop();
+
+		/* Writes the histogram to the debug console, and then empties the buffers */
+		void dump();
+		void reset();
+
+	private:
+		struct Sample {
+			uintptr_t rip;
+			const void *thread;
+		};
+
+		struct CPU {
+			Sample *samples;
+			unsigned int count;
+			uint64_t nr_dropped, nr_unknown;
+		};
+
+		void set_rate(unsigned int hz);
+		void set_running(bool running);
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+		static int write_stats(const char *buffer, size_t size, void *arg);
+
+		bool _ready, _running;
+		unsigned int _hz;
+
+		CPU _cpus[NR_CPU_SLOTS];
+
+		StatsEntry _stats;
+	};
+
+	extern Profiler profiler;
+}
+
+#endif /* COURSEWORK_PROFILER_H */
@@ -0,0 +1,678 @@
+/*
+ * Intrusive Run Queues
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_RUNQUEUE_H
+#define COURSEWORK_RUNQUEUE_H
+
+#include <infos/kernel/sched.h>
+
+#include "spinlock.h"
+
+namespace coursework {
+
+	/**
+	 * The link fields for one run queue, embedded in the object being queued.
+	 * A link that isn't on a queue has a NULL next pointer.
+	 */
+	struct RunQueueLink {
+		RunQueueLink *prev, *next;
+
+		RunQueueLink() : prev(NULL), next(NULL) {
+		}
+
+		bool queued() const {
+			return next != NULL;
+		}
+	};
+
+	/**
+	 * A doubly-linked, circular run queue threaded through a link field of T, so
+	 * that adding, removing and rotating are all O(1), and never allocate.
+	 * @tparam T The type of the queued objects.
+	 * @tparam Link The member of T that holds its link fields.
+	 */
+	template<typename T, RunQueueLink T::*Link>
+	class RunQueue {
+	public:
+		RunQueue() : _count(0) {
+			_head.prev = &_head;
+			_head.next = &_head;
+		}
+
+		bool empty() const {
+			return _count == 0;
+		}
+
+		unsigned int count() const {
+			return _count;
+		}
+
+		/* Returns the object at the front of the queue, or NULL if it is empty */
+		T *first() const {
+			return empty() ? NULL : container_of(_head.next);
+		}
+
+		/* Returns the object after the given one, or NULL if it is the last */
+		T *next(T& item) const {
+			RunQueueLink *link = (item.*Link).next;
+			return link == &_head ? NULL : container_of(link);
+		}
+
+		void enqueue(T& item) {
+			insert_before(&_head, item);
+		}
+
+		void push_front(T& item) {
+			insert_before(_head.next, item);
+		}
+
+		/* Removes an object, which must be on this queue */
+		void remove(T& item) {
+			RunQueueLink& link = item.*Link;
+
+			link.prev->next = link.next;
+			link.next->prev = link.prev;
+			link.prev = NULL;
+			link.next = NULL;
+
+			_count--;
+		}
+
+		/* Removes and returns the object at the front of the queue */
+		T *dequeue() {
+			T *item = first();
+			if (item) {
+				remove(*item);
+			}
+
+			return item;
+		}
+
+		/* Moves the object at the front of the queue to the back */
+		void rotate() {
+			if (_count < 2) {
+				return;
+			}
+
+			RunQueueLink *link = _head.next;
+
+			// Unlink the front...
+			_head.next = link->next;
+			link->next->prev = &_head;
+
+			// ...and splice it in before the head.
+			link->prev = _head.prev;
+			link->next = &_head;
+			_head.prev->next = link;
+			_head.prev = link;
+		}
+
+	private:
+		void insert_before(RunQueueLink *pos, T& item) {
+			RunQueueLink& link = item.*Link;
+
+			link.prev = pos->prev;
+			link.next = pos;
+			pos->prev->next = &link;
+			pos->prev = &link;
+
+			_count++;
+		}
+
+		static T *container_of(RunQueueLink *link) {
+			// The offset of the link within T, worked out from the member pointer.
+			size_t offset = (size_t)&(((T *)0)->*Link);
+			return (T *)((uintptr_t)link - offset);
+		}
+
+		RunQueueLink _head;
+		unsigned int _count;
+	};
+
+	/**
+	 * Memory for a table's next growth, set aside ahead of time so that the table
+	 * itself never allocates: it is used by callers that have interrupts disabled,
+	 * or hold a spinlock.  The memory is allocated by reserve() (before the caller
+	 * takes its lock), handed over under the reserve's own lock, and whatever a
+	 * growth replaced is kept here until the next reserve() frees it.
+	 * @tparam S The type of the memory, which has a "size" member (how big the
+	 * table is with it), a "next" pointer, and frees what it holds when deleted.
+	 */
+	template<typename S>
+	class GrowthReserve {
+	public:
+		GrowthReserve() : _spare(NULL), _retired(NULL) {
+		}
+
+		~GrowthReserve() {
+			delete _spare;
+			free_list(_retired);
+		}
+
+		/* Frees the memory earlier growths replaced.  Must be called with
+		interrupts enabled. */
+		void free_retired() {
+			S *retired;
+			{
+				UniqueIRQSpinLock l(_lock);
+				retired = _retired;
+				_retired = NULL;
+			}
+
+			free_list(retired);
+		}
+
+		/* Returns TRUE if the spare is enough to grow the table to at least size */
+		bool has(unsigned int size) {
+			UniqueIRQSpinLock l(_lock);
+			return _spare && _spare->size >= size;
+		}
+
+		/* Keeps a newly allocated spare, unless there's already one at least as
+		big, and frees whichever isn't kept.  Must be called with interrupts
+		enabled. */
+		void offer(S *spare) {
+			{
+				UniqueIRQSpinLock l(_lock);
+				if (!_spare || _spare->size < spare->size) {
+					S *old = _spare;
+					_spare = spare;
+					spare = old;
+				}
+			}
+
+			delete spare;
+		}
+
+		/* Takes the spare, if it is enough to grow the table to at least size,
+		or returns NULL */
+		S *take(unsigned int size) {
+			UniqueIRQSpinLock l(_lock);
+
+			S *spare = _spare;
+			if (!spare || spare->size < size) {
+				return NULL;
+			}
+
+			_spare = NULL;
+			return spare;
+		}
+
+		/* Hands back what a growth replaced, for free_retired() to free */
+		void retire(S *retired) {
+			UniqueIRQSpinLock l(_lock);
+			retired->next = _retired;
+			_retired = retired;
+		}
+
+	private:
+		static void free_list(S *list) {
+			while (list) {
+				S *next = list->next;
+				delete list;
+				list = next;
+			}
+		}
+
+		SpinLock _lock;
+		S *_spare;
+		S *_retired;
+	};
+
+	/**
+	 * A binary min-heap of T, ordered by a key field of T.  Each object records its
+	 * own position in the heap, so any object (not just the top) can be removed in
+	 * O(log n).  The first N objects fit in the heap itself.  Beyond that, its
+	 * array is doubled, with memory that reserve() set aside once the heap was
+	 * more than half full, so inserting never allocates.
+	 * @tparam T The type of the objects in the heap.
+	 * @tparam Key The member of T the heap is ordered by.
+	 * @tparam Index The member of T that holds its position in the heap.
+	 * @tparam N The number of objects the heap holds without allocating.
+	 */
+	template<typename T, uint64_t T::*Key, unsigned int T::*Index, unsigned int N = 1024>
+	class RunHeap {
+	public:
+		/* The index of an object that isn't in a heap */
+		static const unsigned int NOT_QUEUED = ~0u;
+
+		RunHeap() : _items(_inline_items), _capacity(N), _count(0) {
+		}
+
+		~RunHeap() {
+			if (_items != _inline_items) {
+				delete[] _items;
+			}
+		}
+
+		bool empty() const {
+			return _count == 0;
+		}
+
+		unsigned int count() const {
+			return _count;
+		}
+
+		/* Returns the object with the smallest key, or NULL if the heap is empty */
+		T *top() const {
+			return empty() ? NULL : _items[0];
+		}
+
+		/* Returns the object at the given position, for walking the whole heap */
+		T *at(unsigned int index) const {
+			return _items[index];
+		}
+
+		/**
+		 * Sets aside the memory for the heap's next growth, once it is more than
+		 * half full.  Called before taking the lock that protects the heap, and
+		 * does nothing if interrupts are already disabled.
+		 */
+		void reserve() {
+			if (!interrupts_enabled()) {
+				return;
+			}
+
+			_reserve.free_retired();
+
+			unsigned int capacity = __atomic_load_n(&_capacity, __ATOMIC_RELAXED);
+			if (__atomic_load_n(&_count, __ATOMIC_RELAXED) <= capacity / 2 || _reserve.has(capacity * 2)) {
+				return;
+			}
+
+			Spare *spare = new Spare(capacity * 2);
+			if (spare && spare->items) {
+				_reserve.offer(spare);
+			} else {
+				delete spare;
+			}
+		}
+
+		/* Adds an object, and returns FALSE if the heap was full and couldn't grow */
+		bool insert(T& item) {
+			if (_count == _capacity && !grow()) {
+				return false;
+			}
+
+			_items[_count] = &item;
+			item.*Index = _count;
+			sift_up(_count++);
+
+			return true;
+		}
+
+		/* Removes an object, which must be in this heap */
+		void remove(T& item) {
+			unsigned int index = item.*Index;
+			item.*Index = NOT_QUEUED;
+
+			if (index == --_count) {
+				return;
+			}
+
+			// Fill the hole with the last object, which could belong either above
+			// or below it.
+			_items[index] = _items[_count];
+			_items[index]->*Index = index;
+
+			sift_up(index);
+			sift_down(_items[index]->*Index);
+		}
+
+	private:
+		struct Spare {
+			T **items;
+			unsigned int size;
+			Spare *next;
+
+			Spare(unsigned int capacity) : items(new T *[capacity]), size(capacity), next(NULL) {
+			}
+
+			~Spare() {
+				delete[] items;
+			}
+		};
+
+		/* Doubles the array, with the memory reserve() set aside */
+		bool grow() {
+			Spare *spare = _reserve.take(_capacity * 2);
+			if (!spare) {
+				return false;
+			}
+
+			T **items = spare->items;
+			unsigned int capacity = spare->size;
+			for (unsigned int i = 0; i < _count; i++) {
+				items[i] = _items[i];
+			}
+
+			// the old array goes back in the spare's place, to be freed later
+			spare->items = (_items != _inline_items) ? _items : NULL;
+			_reserve.retire(spare);
+
+			_items = items;
+			__atomic_store_n(&_capacity, capacity, __ATOMIC_RELAXED);
+
+			return true;
+		}
+
+		void swap(unsigned int a, unsigned int b) {
+			T *tmp = _items[a];
+			_items[a] = _items[b];
+			_items[b] = tmp;
+
+			_items[a]->*Index = a;
+			_items[b]->*Index = b;
+		}
+
+		void sift_up(unsigned int index) {
+			while (index > 0) {
+				unsigned int parent = (index - 1) / 2;
+				if (_items[parent]->*Key <= _items[index]->*Key) {
+					break;
+				}
+
+				swap(index, parent);
+				index = parent;
+			}
+		}
+
+		void sift_down(unsigned int index) {
+			for (;;) {
+				unsigned int smallest = index;
+				unsigned int left = (index * 2) + 1, right = left + 1;
+
+				if (left < _count && _items[left]->*Key < _items[smallest]->*Key) {
+					smallest = left;
+				}
+
+				if (right < _count && _items[right]->*Key < _items[smallest]->*Key) {
+					smallest = right;
+				}
+
+				if (smallest == index) {
+					break;
+				}
+
+				swap(index, smallest);
+				index = smallest;
+			}
+		}
+
+		T **_items;
+		unsigned int _capacity, _count;
+		GrowthReserve<Spare> _reserve;
+
+		T *_inline_items[N];
+	};
+
+	/**
+	 * Per-entity scheduler state, for when it can't live in the SchedulingEntity
+	 * itself.  This is a pool of T, with an open-addressed hash table from entity
+	 * to pool slot.  The first N entries are part of the table itself, so finding
+	 * or adding an entity's state doesn't allocate until there are more than N
+	 * entities at once.  Beyond that, the pool grows by another N entries at a
+	 * time (and the hash table grows with it), with memory that reserve() set aside
+	 * once the pool was more than half full.  Callers reserve before taking their
+	 * lock, when a thread is created or woken with interrupts enabled, so get()
+	 * itself never allocates.  Entries never move once created, so pointers to them
+	 * stay valid until they are released.  T must have a "SchedulingEntity *entity"
+	 * member.
+	 *
+	 * Entries aren't tied to the lifetime of the entity, so schedulers release them
+	 * once an entity has stopped, at which point it never runs again.
+	 * @tparam T The per-entity state.
+	 * @tparam N The number of entities that can have state without allocating,
+	 * and the number the pool grows by.
+	 */
+	template<typename T, unsigned int N = 1024>
+	class EntityTable {
+	public:
+		EntityTable() : _slots(_inline_slots), _nr_slots(N * 2), _nr_chunks(1), _nr_used(0), _free(EMPTY) {
+			for (unsigned int i = 0; i < _nr_slots; i++) {
+				_slots[i] = EMPTY;
+			}
+
+			_chunks[0] = &_first_chunk;
+			init_chunk(_first_chunk, 0);
+		}
+
+		~EntityTable() {
+			for (unsigned int i = 1; i < _nr_chunks; i++) {
+				delete _chunks[i];
+			}
+
+			if (_slots != _inline_slots) {
+				delete[] _slots;
+			}
+		}
+
+		/* Returns the state for an entity, or NULL if it doesn't have any */
+		T *find(const infos::kernel::SchedulingEntity& entity) {
+			for (unsigned int slot = hash(&entity); _slots[slot] != EMPTY; slot = (slot + 1) % _nr_slots) {
+				if (entry(_slots[slot]).entity == &entity) {
+					return &entry(_slots[slot]);
+				}
+			}
+
+			return NULL;
+		}
+
+		/**
+		 * Sets aside the memory for the table's next growth, once the pool is
+		 * more than half full.  Called before taking the lock that protects the
+		 * table, and does nothing if interrupts are already disabled.
+		 */
+		void reserve() {
+			if (!interrupts_enabled()) {
+				return;
+			}
+
+			_reserve.free_retired();
+
+			unsigned int nr_chunks = __atomic_load_n(&_nr_chunks, __ATOMIC_RELAXED);
+			if (nr_chunks == MAX_CHUNKS || __atomic_load_n(&_nr_used, __ATOMIC_RELAXED) + (N / 2) < nr_chunks * N) {
+				return;
+			}
+
+			// the hash table stays twice the size of the pool
+			unsigned int nr_slots = (nr_chunks + 1) * N * 2;
+			if (_reserve.has(nr_slots)) {
+				return;
+			}
+
+			Spare *spare = new Spare(nr_slots);
+			if (spare && spare->chunk && spare->slots) {
+				_reserve.offer(spare);
+			} else {
+				delete spare;
+			}
+		}
+
+		/* Returns the state for an entity, creating it if it doesn't have any
+		yet.  Returns NULL only if the table was full, and nothing had been
+		reserved for it to grow */
+		T *get(infos::kernel::SchedulingEntity& entity) {
+			T *existing = find(entity);
+			if (existing) {
+				return existing;
+			}
+
+			if (_free == EMPTY && !grow()) {
+				return NULL;
+			}
+
+			uint32_t index = _free;
+			_free = next_free(index);
+			__atomic_store_n(&_nr_used, _nr_used + 1, __ATOMIC_RELAXED);
+
+			entry(index) = T();
+			entry(index).entity = &entity;
+			insert_slot(index);
+
+			return &entry(index);
+		}
+
+		/* Calls fn on the state of every entity that has some */
+		template<typename F>
+		void for_each(F fn) {
+			for (unsigned int c = 0; c < _nr_chunks; c++) {
+				for (unsigned int i = 0; i < N; i++) {
+					if (_chunks[c]->entries[i].entity) {
+						fn(_chunks[c]->entries[i]);
+					}
+				}
+			}
+		}
+
+		/* Releases the state for an entity */
+		void release(T *released) {
+			unsigned int slot = hash(released->entity);
+			while (&entry(_slots[slot]) != released) {
+				slot = (slot + 1) % _nr_slots;
+			}
+
+			uint32_t index = _slots[slot];
+			_slots[slot] = EMPTY;
+
+			// Shift any later entries in the same probe run back, so that lookups
+			// never need tombstones.
+			for (unsigned int next = (slot + 1) % _nr_slots; _slots[next] != EMPTY; next = (next + 1) % _nr_slots) {
+				unsigned int home = hash(entry(_slots[next]).entity);
+
+				// The entry can move into the hole only if its home slot isn't in
+				// the (cyclic) range between the hole and where it is now.
+				bool between = (slot <= next) ? (home > slot && home <= next) : (home > slot || home <= next);
+				if (!between) {
+					_slots[slot] = _slots[next];
+					_slots[next] = EMPTY;
+					slot = next;
+				}
+			}
+
+			entry(index).entity = NULL;
+			next_free(index) = _free;
+			_free = index;
+			__atomic_store_n(&_nr_used, _nr_used - 1, __ATOMIC_RELAXED);
+		}
+
+	private:
+		static const uint32_t EMPTY = 0xffffffff;
+
+		// How many times the pool can grow, which is far more entities than there
+		// can be threads.
+		static const unsigned int MAX_CHUNKS = 64;
+
+		struct Chunk {
+			T entries[N];
+			uint32_t next_free[N];
+		};
+
+		struct Spare {
+			Chunk *chunk;
+			uint32_t *slots;
+			unsigned int size;
+			Spare *next;
+
+			Spare(unsigned int nr_slots) : chunk(new Chunk()), slots(new uint32_t[nr_slots]), size(nr_slots), next(NULL) {
+			}
+
+			~Spare() {
+				delete chunk;
+				delete[] slots;
+			}
+		};
+
+		T& entry(uint32_t index) {
+			return _chunks[index / N]->entries[index % N];
+		}
+
+		uint32_t& next_free(uint32_t index) {
+			return _chunks[index / N]->next_free[index % N];
+		}
+
+		/* Puts every entry of a fresh chunk on the free list */
+		void init_chunk(Chunk& chunk, uint32_t base) {
+			for (unsigned int i = 0; i < N; i++) {
+				chunk.entries[i].entity = NULL;
+				chunk.next_free[i] = (i + 1 < N) ? base + i + 1 : _free;
+			}
+
+			_free = base;
+		}
+
+		/* Adds another chunk of entries, and rebuilds the hash table to keep it
+		at most half full, with the memory reserve() set aside */
+		bool grow() {
+			if (_nr_chunks == MAX_CHUNKS) {
+				return false;
+			}
+
+			Spare *spare = _reserve.take((_nr_chunks + 1) * N * 2);
+			if (!spare) {
+				return false;
+			}
+
+			Chunk *chunk = spare->chunk;
+			uint32_t *slots = spare->slots;
+			unsigned int nr_slots = spare->size;
+
+			// the old hash table goes back in the spare's place, to be freed later
+			spare->chunk = NULL;
+			spare->slots = (_slots != _inline_slots) ? _slots : NULL;
+			_reserve.retire(spare);
+
+			_slots = slots;
+			_nr_slots = nr_slots;
+			for (unsigned int i = 0; i < _nr_slots; i++) {
+				_slots[i] = EMPTY;
+			}
+
+			// Every entry's home slot has moved, so they all go back in.
+			for (uint32_t index = 0; index < _nr_chunks * N; index++) {
+				if (entry(index).entity) {
+					insert_slot(index);
+				}
+			}
+
+			_chunks[_nr_chunks] = chunk;
+			init_chunk(*chunk, _nr_chunks * N);
+			__atomic_store_n(&_nr_chunks, _nr_chunks + 1, __ATOMIC_RELAXED);
+
+			return true;
+		}
+
+		void insert_slot(uint32_t index) {
+			unsigned int slot = hash(entry(index).entity);
+			while (_slots[slot] != EMPTY) {
+				slot = (slot + 1) % _nr_slots;
+			}
+
+			_slots[slot] = index;
+		}
+
+		unsigned int hash(const infos::kernel::SchedulingEntity *entity) const {
+			// Entities are heap objects, so the low bits carry no information.
+			uint64_t key = (uint64_t)(uintptr_t)entity >> 4;
+			return (unsigned int)((key * 0x9e3779b97f4a7c15ULL) >> 32) % _nr_slots;
+		}
+
+		uint32_t *_slots;
+		unsigned int _nr_slots;
+
+		Chunk *_chunks[MAX_CHUNKS];
+		unsigned int _nr_chunks, _nr_used;
+		uint32_t _free;
+
+		GrowthReserve<Spare> _reserve;
+
+		Chunk _first_chunk;
+		uint32_t _inline_slots[N * 2];
+	};
+}
+
+#endif /* COURSEWORK_RUNQUEUE_H */
@@ -0,0 +1,517 @@
+/*
+ * Earliest Deadline First Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "cmdline-util.h"
+#include "nohz.h"
+#include "runqueue.h"
+#include "sched-stats.h"
+#include "stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+
+/**
+ * An earliest-deadline-first scheduling algorithm.  A thread joins the deadline
+ * class by writing "runtime period [deadline]" (in microseconds) to /.stats/edf,
+ * which reserves runtime of CPU time in every period, to be used by the relative
+ * deadline (which defaults to the period).  Reservations are only accepted while
+ * their total density (runtime over relative deadline) stays under
+ * MAX_UTILISATION, which on one CPU is enough for EDF to meet every deadline in
+ * theory.  In practice jobs can still finish late, because budgets are only
+ * checked when the scheduler runs and interrupts take time nobody reserved, so
+ * misses are counted.  Writing "0" leaves the class again.
+ *
+ * Runnable deadline threads are kept in a heap ordered by absolute deadline, and
+ * always run ahead of everything else.  A thread that uses up its runtime before
+ * the end of its period is throttled until the next period starts, so it can't
+ * take more than it reserved.  Other threads share what is left round-robin.
+ */
+class EDFScheduler : public SchedulingAlgorithm
+{
+public:
+	// The share of the CPU that reservations can add up to, in parts per million.
+	// The rest is kept back for threads outside the deadline class.
+	static const uint64_t MAX_UTILISATION = 950000;
+
+	EDFScheduler()
+	: current(NULL),
+	utilisation(0),
+	nr_jobs(0),
+	nr_misses(0),
+	nr_throttles(0),
+	stats("edf", read_stats, write_stats, this)
+	{
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "edf"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		// grow the tables now if they need to, as they can't with interrupts disabled
+		entities.reserve();
+		ready.reserve();
+		throttled.reserve();
+		sched_stats.reserve(entity);
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+			return;
+		}
+
+		if (queued->runnable) {
+			return;
+		}
+
+		queued->runnable = true;
+		enqueue(*queued, now());
+
+		sched_stats.enqueued(entity);
+		tick_control.enqueued();
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.  For a
+	 * deadline thread, this is the end of its current job.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.find(entity);
+		if (!queued) {
+			return;
+		}
+
+		if (queued == current) {
+			charge(*queued);
+			current = NULL;
+		}
+
+		if (queued->runnable) {
+			queued->runnable = false;
+			dequeue(*queued);
+
+			if (queued->is_deadline()) {
+				complete(*queued, now());
+			}
+		}
+
+		sched_stats.dequeued(entity);
+
+		// a stopped entity never runs again, so its reservation and queue entry can go
+		if (entity.stopped()) {
+			utilisation -= queued->utilisation();
+			entities.release(queued);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is the deadline thread with the earliest deadline, or, if
+	 * there isn't one ready, the next thread in the round-robin queue.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		SchedulingEntity *next = pick();
+		sched_stats.picked(next);
+
+		// Budgets and releases are only checked here, so while there are deadline
+		// threads the tick has to keep going, even for a lone one: otherwise it
+		// could overrun its budget, or a throttled thread miss its release.
+		if (ready.empty() && throttled.empty()) {
+			tick_control.picked(background.count());
+		} else {
+			tick_control.picked(__max(2U, ready.count() + throttled.count() + background.count()));
+		}
+
+		return next;
+	}
+
+private:
+	// The queue entry for an entity, which is kept for as long as it can run.
+	struct QueuedEntity {
+		QueuedEntity()
+		: entity(NULL),
+		heap_index(DeadlineHeap::NOT_QUEUED),
+		runtime(0),
+		period(0),
+		deadline(0),
+		abs_deadline(0),
+		release(0),
+		budget(0),
+		last_runtime(0),
+		runnable(false),
+		throttled(false),
+		nr_jobs(0),
+		nr_misses(0) { }
+
+		SchedulingEntity *entity;
+
+		// Threads outside the deadline class are on the round-robin queue, and
+		// deadline threads are in one of the two heaps.
+		RunQueueLink link;
+		unsigned int heap_index;
+
+		// The reservation, in nanoseconds.  A zero runtime means the thread isn't
+		// in the deadline class.
+		uint64_t runtime, period, deadline;
+
+		// The absolute deadline of the current job, and the time the next period
+		// starts (which is when a throttled thread gets its budget back).
+		uint64_t abs_deadline, release;
+
+		// How much runtime the current job has left, and the entity's CPU time
+		// when that was last worked out.
+		int64_t budget;
+		SchedulingEntity::EntityRuntime last_runtime;
+
+		bool runnable, throttled;
+
+		uint64_t nr_jobs, nr_misses;
+
+		bool is_deadline() const {
+			return runtime != 0;
+		}
+
+		/* Returns the share of the CPU reserved, in parts per million.  This is
+		the density, which is the same as the utilisation unless the deadline is
+		shorter than the period, when it is what has to fit for EDF */
+		uint64_t utilisation() const {
+			return is_deadline() ? density(runtime / 1000, deadline / 1000) : 0;
+		}
+	};
+
+	/* Returns the density of a reservation, in parts per million */
+	static uint64_t density(uint64_t runtime_us, uint64_t deadline_us)
+	{
+		return runtime_us * 1000000 / deadline_us;
+	}
+
+	typedef RunHeap<QueuedEntity, &QueuedEntity::abs_deadline, &QueuedEntity::heap_index> DeadlineHeap;
+	typedef RunHeap<QueuedEntity, &QueuedEntity::release, &QueuedEntity::heap_index> ReleaseHeap;
+
+	/* Returns the time since boot, in nanoseconds */
+	static uint64_t now()
+	{
+		return sys.runtime().count();
+	}
+
+	/**
+	 * Starts a new job for a deadline thread, with a full budget, in a period
+	 * that starts at the given time.
+	 */
+	static void start_job(QueuedEntity& queued, uint64_t start)
+	{
+		queued.abs_deadline = start + queued.deadline;
+		queued.release = start + queued.period;
+		queued.budget = queued.runtime;
+	}
+
+	/**
+	 * Puts a runnable entity in the right place: deadline threads go in the ready
+	 * heap, or the throttled heap if they've used their budget for this period,
+	 * and everything else goes on the back of the round-robin queue.  Must be
+	 * called with interrupts disabled.
+	 */
+	void enqueue(QueuedEntity& queued, uint64_t time)
+	{
+		if (!queued.is_deadline()) {
+			background.enqueue(queued);
+			return;
+		}
+
+		// A thread waking up after its deadline has passed starts a new job,
+		// rather than running late with what was left of the old one.  If its
+		// period hasn't ended yet, the new job waits for it, so that waking up
+		// late can't be used to get more than the reservation.
+		if (time >= queued.abs_deadline) {
+			if (time >= queued.release) {
+				start_job(queued, time);
+			} else {
+				queued.budget = 0;
+			}
+		}
+
+		if (queued.budget > 0) {
+			queued.throttled = false;
+			ready.insert(queued);
+		} else {
+			queued.throttled = true;
+			throttled.insert(queued);
+		}
+	}
+
+	/**
+	 * Takes a runnable entity out of whichever queue it is in.  Must be called
+	 * with interrupts disabled.
+	 */
+	void dequeue(QueuedEntity& queued)
+	{
+		if (queued.link.queued()) {
+			background.remove(queued);
+		} else if (queued.heap_index != DeadlineHeap::NOT_QUEUED) {
+			if (queued.throttled) {
+				throttled.remove(queued);
+			} else {
+				ready.remove(queued);
+			}
+		}
+	}
+
+	/**
+	 * Called when a deadline thread's job ends, i.e. when it blocks.
+	 */
+	void complete(QueuedEntity& queued, uint64_t time)
+	{
+		queued.nr_jobs++;
+		nr_jobs++;
+
+		if (time > queued.abs_deadline) {
+			queued.nr_misses++;
+			nr_misses++;
+		}
+	}
+
+	/**
+	 * Takes the CPU time a deadline thread has used since it was last charged out
+	 * of its budget.  Must be called with interrupts disabled.
+	 */
+	void charge(QueuedEntity& queued)
+	{
+		SchedulingEntity::EntityRuntime runtime = queued.entity->cpu_runtime();
+
+		if (queued.is_deadline()) {
+			queued.budget -= (int64_t)(runtime - queued.last_runtime);
+		}
+
+		queued.last_runtime = runtime;
+	}
+
+	/**
+	 * Chooses the entity to run next.  Must be called with interrupts disabled.
+	 */
+	SchedulingEntity *pick()
+	{
+		uint64_t time = now();
+
+		// throttle the running thread if it has used up its budget
+		if (current) {
+			charge(*current);
+
+			if (current->is_deadline() && current->budget <= 0 && !current->throttled && current->runnable) {
+				ready.remove(*current);
+				current->throttled = true;
+				throttled.insert(*current);
+				nr_throttles++;
+			}
+		}
+
+		// give throttled threads whose next period has started a new job
+		while (!throttled.empty() && throttled.top()->release <= time) {
+			QueuedEntity *queued = throttled.top();
+
+			// if the period started long enough ago that the new job's deadline
+			// has gone too, start it from now instead
+			throttled.remove(*queued);
+			start_job(*queued, (queued->release + queued->deadline > time) ? queued->release : time);
+			queued->throttled = false;
+			ready.insert(*queued);
+		}
+
+		// a ready thread whose deadline has passed has missed it, and carries on
+		// with a new job rather than pushing everything else late too
+		while (!ready.empty() && ready.top()->abs_deadline < time) {
+			QueuedEntity *queued = ready.top();
+
+			queued->nr_misses++;
+			nr_misses++;
+
+			ready.remove(*queued);
+			start_job(*queued, time);
+			ready.insert(*queued);
+		}
+
+		QueuedEntity *next = ready.top();
+		if (!next) {
+			next = background.first();
+			background.rotate();
+		}
+
+		if (next && next != current) {
+			next->last_runtime = next->entity->cpu_runtime();
+		}
+
+		current = next;
+
+		return next ? next->entity : NULL;
+	}
+
+	/**
+	 * Changes the reservation of an entity, if the total still fits.
+	 * @return Returns FALSE if the reservation was rejected.
+	 */
+	bool set_reservation(SchedulingEntity& entity, uint64_t runtime_us, uint64_t period_us, uint64_t deadline_us)
+	{
+		entities.reserve();
+		ready.reserve();
+		throttled.reserve();
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			return false;
+		}
+
+		uint64_t old_utilisation = queued->utilisation();
+		uint64_t new_utilisation = runtime_us ? density(runtime_us, deadline_us) : 0;
+
+		// admission control
+		if (utilisation - old_utilisation + new_utilisation > MAX_UTILISATION) {
+			return false;
+		}
+
+		utilisation = utilisation - old_utilisation + new_utilisation;
+
+		if (queued == current) {
+			charge(*queued);
+		}
+
+		if (queued->runnable) {
+			dequeue(*queued);
+		}
+
+		queued->runtime = runtime_us * 1000;
+		queued->period = period_us * 1000;
+		queued->deadline = deadline_us * 1000;
+
+		// the new reservation starts with a fresh job
+		queued->abs_deadline = 0;
+		queued->release = 0;
+		queued->budget = 0;
+		queued->throttled = false;
+
+		if (queued->runnable) {
+			enqueue(*queued, now());
+		}
+
+		return true;
+	}
+
+	static size_t read_stats(char *buffer, size_t size, void *arg)
+	{
+		EDFScheduler *sched = (EDFScheduler *)arg;
+		size_t pos = 0;
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		stats_printf(buffer, size, pos, "utilisation_ppm %lu\n", sched->utilisation);
+		stats_printf(buffer, size, pos, "max_utilisation_ppm %lu\n", MAX_UTILISATION);
+		stats_printf(buffer, size, pos, "ready %u\n", sched->ready.count());
+		stats_printf(buffer, size, pos, "throttled %u\n", sched->throttled.count());
+		stats_printf(buffer, size, pos, "background %u\n", sched->background.count());
+		stats_printf(buffer, size, pos, "jobs %lu\n", sched->nr_jobs);
+		stats_printf(buffer, size, pos, "missed_deadlines %lu\n", sched->nr_misses);
+		stats_printf(buffer, size, pos, "throttles %lu\n", sched->nr_throttles);
+
+		sched->entities.for_each([&](const QueuedEntity& queued) {
+			if (queued.is_deadline()) {
+				stats_printf(buffer, size, pos, "thread %p runtime_us %lu period_us %lu deadline_us %lu jobs %lu missed %lu\n",
+					queued.entity, queued.runtime / 1000, queued.period / 1000, queued.deadline / 1000, queued.nr_jobs, queued.nr_misses);
+			}
+		});
+
+		return pos;
+	}
+
+	static int write_stats(const char *buffer, size_t size, void *arg)
+	{
+		EDFScheduler *sched = (EDFScheduler *)arg;
+
+		uint64_t runtime = 0, period = 0, deadline = 0;
+		size_t i = 0;
+
+		if (!parse_control_number(buffer, size, i, runtime)) {
+			return -1;
+		}
+
+		if (runtime != 0) {
+			if (!parse_control_number(buffer, size, i, period)) {
+				return -1;
+			}
+
+			// the deadline is optional, and defaults to the period
+			if (control_at_end(buffer, size, i)) {
+				deadline = period;
+			} else if (!parse_control_number(buffer, size, i, deadline)) {
+				return -1;
+			}
+
+			// the runtime has to fit before the deadline, which has to be within the period
+			if (runtime > deadline || deadline > period) {
+				return -1;
+			}
+		}
+
+		if (!control_at_end(buffer, size, i)) {
+			return -1;
+		}
+
+		if (!sched->set_reservation(Thread::current(), runtime, period, deadline)) {
+			return -1;
+		}
+
+		return size;
+	}
+
+	// The queue entries for every entity that is (or may become) runnable.
+	EntityTable<QueuedEntity> entities;
+
+	// Deadline threads that can run, by deadline, and those waiting for their
+	// next period, by when it starts.  Everything else is in the background queue.
+	DeadlineHeap ready;
+	ReleaseHeap throttled;
+	RunQueue<QueuedEntity, &QueuedEntity::link> background;
+
+	QueuedEntity *current;
+
+	// The total of every reservation, in parts per million.
+	uint64_t utilisation;
+
+	uint64_t nr_jobs, nr_misses, nr_throttles;
+
+	StatsEntry stats;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(EDFScheduler);
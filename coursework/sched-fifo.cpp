@@ -9,11 +9,15 @@
 #include <infos/kernel/sched.h>
 #include <infos/kernel/thread.h>
 #include <infos/kernel/log.h>
-#include <infos/util/list.h>
 #include <infos/util/lock.h>
 
+#include "nohz.h"
+#include "runqueue.h"
+#include "sched-stats.h"
+
 using namespace infos::kernel;
 using namespace infos::util;
+using namespace coursework;
 
 /**
  * A FIFO scheduling algorithm
@@ -32,10 +36,14 @@ public:
 	 */
 	void add_to_runqueue(SchedulingEntity& entity) override
 	{
-		// disable interrupts
+		// grow the tables now if they need to, as they can't with interrupts disabled
+		entities.reserve();
+		sched_stats.reserve(entity);
+
+		// disabling interrupts
 		UniqueIRQLock l;
 		
-		runqueue.enqueue(&entity);
+		enqueue(entity);
 	}
 
 	/**
@@ -47,7 +55,21 @@ public:
 		// disabling interrupts
 		UniqueIRQLock l;
 		
-		runqueue.remove(&entity);
+		QueuedEntity *queued = entities.find(entity);
+		if (!queued) {
+			return;
+		}
+		
+		if (queued->link.queued()) {
+			runqueue.remove(*queued);
+		}
+		
+		sched_stats.dequeued(entity);
+
+		// a stopped entity never runs again, so its queue entry can go
+		if (entity.stopped()) {
+			entities.release(queued);
+		}
 	}
 
 	/**
@@ -59,33 +81,75 @@ public:
 	{
 		// disabling interrupts
 		UniqueIRQLock l;
-		
+
+		SchedulingEntity *next = pick();
+		sched_stats.picked(next);
+		tick_control.picked(runqueue.count());
+
+		return next;
+	}
+
+private:
+	/**
+	 * Chooses the entity to run next.  Must be called with interrupts disabled.
+	 */
+	SchedulingEntity *pick()
+	{
 		// return nothing if queue is empty
-		if (runqueue.count() == 0) {
+		if (runqueue.empty()) {
 			return NULL;
 		}
 		// pick first task if only one task is present
 		if (runqueue.count() == 1) {
-			return runqueue.first();
+			return runqueue.first()->entity;
 		}
 		
-		auto entity = runqueue.first();
+		auto queued = runqueue.first();
 		// if the current task has completed
-		if (entity->stopped()) {
+		if (queued->entity->stopped()) {
 			// remove it from the queue
-			runqueue.dequeue();
+			runqueue.remove(*queued);
+			sched_stats.dequeued(*queued->entity);
+			entities.release(queued);
 			// and pick the next element
-			return runqueue.first();
+			return runqueue.first()->entity;
 		} else {
 			// keep running the current task
-			return entity;
+			return queued->entity;
 		}
 		
 	}
 
-private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
+	// The queue entry for an entity, which is kept for as long as it can run.
+	struct QueuedEntity {
+		SchedulingEntity *entity;
+		RunQueueLink link;
+	};
+
+	/**
+	 * Adds an entity to the back of the runqueue, unless it is already on it.
+	 * Must be called with interrupts disabled.
+	 */
+	void enqueue(SchedulingEntity& entity)
+	{
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+			return;
+		}
+		
+		if (!queued->link.queued()) {
+			runqueue.enqueue(*queued);
+			sched_stats.enqueued(entity);
+			tick_control.enqueued();
+		}
+	}
+
+	// The queue entries for every entity that is (or may become) runnable.
+	EntityTable<QueuedEntity> entities;
+
+	// The current runqueue, threaded through the queue entries.
+	RunQueue<QueuedEntity, &QueuedEntity::link> runqueue;
 };
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
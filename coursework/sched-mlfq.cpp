@@ -0,0 +1,323 @@
+/*
+ * Multi-level Feedback Queue Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/cmdline.h>
+#include <infos/util/lock.h>
+
+#include "cmdline-util.h"
+#include "nohz.h"
+#include "runqueue.h"
+#include "sched-stats.h"
+#include "stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+
+// The timeslice at the top level, in microseconds of CPU time.  Each level down
+// gets twice as long as the one above it.
+static uint64_t mlfq_quantum_us = 2000;
+
+// How often every entity is moved back up to the top level, in milliseconds.
+static uint64_t mlfq_boost_ms = 1000;
+
+RegisterCmdLineArgument(MLFQQuantum, "sched.mlfq.quantum")
+{
+	uint64_t quantum = parse_cmdline_number(value);
+	if (quantum > 0) {
+		mlfq_quantum_us = quantum;
+	}
+}
+
+RegisterCmdLineArgument(MLFQBoost, "sched.mlfq.boost")
+{
+	uint64_t boost = parse_cmdline_number(value);
+	if (boost > 0) {
+		mlfq_boost_ms = boost;
+	}
+}
+
+/**
+ * A multi-level feedback queue scheduling algorithm.  Every entity starts at the
+ * top level, and drops a level each time it uses up a whole timeslice there, so
+ * CPU-bound threads sink while threads that block early (interactive and I/O-bound
+ * ones) stay near the top and run first when they wake.  Time used before
+ * blocking counts towards the slice, so a thread can't stay at the top by
+ * blocking just before its slice runs out.  Lower levels have longer slices,
+ * and the most important non-empty level always runs, round-robin.
+ *
+ * So that the threads at the bottom are never starved completely, everything is
+ * periodically boosted back to the top level.
+ */
+class MLFQScheduler : public SchedulingAlgorithm
+{
+public:
+	static const unsigned int NR_LEVELS = 8;
+
+	MLFQScheduler() : bitmap(0), current(NULL), last_boost(0), nr_demotions(0), nr_boosts(0), stats("mlfq", read_stats, NULL, this)
+	{
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "mlfq"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		// grow the tables now if they need to, as they can't with interrupts disabled
+		entities.reserve();
+		sched_stats.reserve(entity);
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+			return;
+		}
+
+		if (!queued->link.queued()) {
+			enqueue(*queued);
+			sched_stats.enqueued(entity);
+			tick_control.enqueued();
+		}
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.find(entity);
+		if (!queued) {
+			return;
+		}
+
+		// if it was running, bank the part of its slice it has used
+		if (queued == current) {
+			account(*queued);
+			current = NULL;
+		}
+
+		if (queued->link.queued()) {
+			dequeue(*queued);
+		}
+
+		sched_stats.dequeued(entity);
+
+		// a stopped entity never runs again, so its queue entry can go
+		if (entity.stopped()) {
+			entities.release(queued);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  The running entity carries on until its slice is up, unless an
+	 * entity at a more important level has become runnable.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		SchedulingEntity *next = pick();
+		sched_stats.picked(next);
+		tick_control.picked(nr_runnable());
+
+		return next;
+	}
+
+private:
+	/**
+	 * Chooses the entity to run next.  Must be called with interrupts disabled.
+	 */
+	SchedulingEntity *pick()
+	{
+		uint64_t now = sys.runtime().count();
+		if (now - last_boost >= mlfq_boost_ms * 1000000) {
+			boost();
+			last_boost = now;
+		}
+
+		// demote the running entity if its slice is up, which also puts it at
+		// the back of its new level
+		if (current) {
+			account(*current);
+
+			if (current->slice_used >= quantum(current->level)) {
+				dequeue(*current);
+
+				if (current->level < NR_LEVELS - 1) {
+					current->level++;
+					nr_demotions++;
+				}
+
+				current->slice_used = 0;
+				enqueue(*current);
+			}
+		}
+
+		// return nothing if every level is empty
+		if (bitmap == 0) {
+			current = NULL;
+			return NULL;
+		}
+
+		// the lowest set bit is the most important non-empty level, and the
+		// entity at its front is the one that is part-way through its slice
+		current = levels[__builtin_ctz(bitmap)].first();
+		current->slice_start = current->entity->cpu_runtime();
+
+		return current->entity;
+	}
+
+	// The queue entry for an entity, which is kept for as long as it can run.
+	struct QueuedEntity {
+		QueuedEntity() : entity(NULL), level(0), slice_start(0), slice_used(0) { }
+
+		SchedulingEntity *entity;
+		RunQueueLink link;
+
+		unsigned int level;
+
+		// The entity's runtime when it last started running, and how much of its
+		// slice at this level it had already used by then.
+		SchedulingEntity::EntityRuntime slice_start;
+		uint64_t slice_used;
+	};
+
+	typedef RunQueue<QueuedEntity, &QueuedEntity::link> LevelQueue;
+
+	/* Returns the length of a slice at the given level, in nanoseconds */
+	static uint64_t quantum(unsigned int level)
+	{
+		return (mlfq_quantum_us * 1000) << level;
+	}
+
+	/**
+	 * Adds the CPU time an entity has used since it started running to its slice.
+	 */
+	static void account(QueuedEntity& queued)
+	{
+		SchedulingEntity::EntityRuntime now = queued.entity->cpu_runtime();
+
+		queued.slice_used += now - queued.slice_start;
+		queued.slice_start = now;
+	}
+
+	/**
+	 * Returns the number of runnable entities, across every level.
+	 */
+	unsigned int nr_runnable() const
+	{
+		unsigned int count = 0;
+		for (uint32_t levels_left = bitmap; levels_left; levels_left &= levels_left - 1) {
+			count += levels[__builtin_ctz(levels_left)].count();
+		}
+
+		return count;
+	}
+
+	/**
+	 * Adds an entity to the back of its level.  Must be called with interrupts disabled.
+	 */
+	void enqueue(QueuedEntity& queued)
+	{
+		levels[queued.level].enqueue(queued);
+		bitmap |= (1u << queued.level);
+	}
+
+	/**
+	 * Removes an entity from its level.  Must be called with interrupts disabled.
+	 */
+	void dequeue(QueuedEntity& queued)
+	{
+		levels[queued.level].remove(queued);
+		if (levels[queued.level].empty()) {
+			bitmap &= ~(1u << queued.level);
+		}
+	}
+
+	/**
+	 * Moves every entity back to the top level with a fresh slice.  Entities are
+	 * moved in level order, so the ones that were most important still run first.
+	 * Must be called with interrupts disabled.
+	 */
+	void boost()
+	{
+		for (unsigned int level = 1; level < NR_LEVELS; level++) {
+			while (QueuedEntity *queued = levels[level].dequeue()) {
+				queued->level = 0;
+				levels[0].enqueue(*queued);
+			}
+		}
+
+		if (bitmap) {
+			bitmap = 1;
+		}
+
+		// entities that aren't runnable move up too, for when they wake
+		entities.for_each([](QueuedEntity& queued) {
+			queued.level = 0;
+			queued.slice_used = 0;
+		});
+
+		nr_boosts++;
+	}
+
+	static size_t read_stats(char *buffer, size_t size, void *arg)
+	{
+		MLFQScheduler *sched = (MLFQScheduler *)arg;
+		size_t pos = 0;
+
+		stats_printf(buffer, size, pos, "quantum_us %lu\n", mlfq_quantum_us);
+		stats_printf(buffer, size, pos, "boost_ms %lu\n", mlfq_boost_ms);
+
+		for (unsigned int i = 0; i < NR_LEVELS; i++) {
+			stats_printf(buffer, size, pos, "queued%u %u\n", i, sched->levels[i].count());
+		}
+
+		stats_printf(buffer, size, pos, "demotions %lu\n", sched->nr_demotions);
+		stats_printf(buffer, size, pos, "boosts %lu\n", sched->nr_boosts);
+
+		return pos;
+	}
+
+	// The queue entries for every entity that is (or may become) runnable.
+	EntityTable<QueuedEntity> entities;
+
+	// A round-robin queue for each level, and a bit for each non-empty one.
+	LevelQueue levels[NR_LEVELS];
+	uint32_t bitmap;
+
+	QueuedEntity *current;
+
+	// When everything was last boosted, in nanoseconds since boot.
+	uint64_t last_boost;
+
+	uint64_t nr_demotions, nr_boosts;
+
+	StatsEntry stats;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(MLFQScheduler);
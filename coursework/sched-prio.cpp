@@ -0,0 +1,272 @@
+/*
+ * Multi-level Priority Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "cmdline-util.h"
+#include "nohz.h"
+#include "runqueue.h"
+#include "sched-stats.h"
+#include "stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+
+/**
+ * A priority scheduling algorithm, with a round-robin queue for each priority
+ * level, and a bitmap of the levels that have runnable entities.  Level zero is
+ * the most important.  Entities start at a level based on their priority class,
+ * and a thread can move itself to another level by writing the level number to
+ * /.stats/prio (and reading the file tells it what level it is at).
+ */
+class PriorityScheduler : public SchedulingAlgorithm
+{
+public:
+	static const unsigned int NR_LEVELS = 32;
+
+	PriorityScheduler() : bitmap(0), stats("prio", read_stats, write_stats, this)
+	{
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "prio"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		// grow the tables now if they need to, as they can't with interrupts disabled
+		entities.reserve();
+		sched_stats.reserve(entity);
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+			return;
+		}
+
+		if (!queued->link.queued()) {
+			enqueue(*queued);
+			sched_stats.enqueued(entity);
+			tick_control.enqueued();
+		}
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.find(entity);
+		if (!queued) {
+			return;
+		}
+
+		if (queued->link.queued()) {
+			dequeue(*queued);
+		}
+
+		sched_stats.dequeued(entity);
+
+		// a stopped entity never runs again, so its queue entry can go
+		if (entity.stopped()) {
+			entities.release(queued);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is the entity at the front of the most important non-empty
+	 * level, which is then moved to the back of its level.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		SchedulingEntity *next = pick();
+		sched_stats.picked(next);
+		tick_control.picked(nr_runnable());
+
+		return next;
+	}
+
+private:
+	/**
+	 * Chooses the entity to run next.  Must be called with interrupts disabled.
+	 */
+	SchedulingEntity *pick()
+	{
+		// return nothing if every level is empty
+		if (bitmap == 0) {
+			return NULL;
+		}
+
+		// the lowest set bit is the most important non-empty level
+		auto& level = levels[__builtin_ctz(bitmap)];
+
+		auto queued = level.first();
+		level.rotate();
+
+		return queued->entity;
+	}
+
+	// The queue entry for an entity, which is kept for as long as it can run.
+	struct QueuedEntity {
+		QueuedEntity() : entity(NULL), level(NR_LEVELS) { }
+
+		SchedulingEntity *entity;
+		RunQueueLink link;
+
+		// The level the entity runs at, or NR_LEVELS if it hasn't been set yet.
+		unsigned int level;
+	};
+
+	typedef RunQueue<QueuedEntity, &QueuedEntity::link> LevelQueue;
+
+	/**
+	 * Returns the level an entity starts at, spreading the priority classes out so
+	 * that threads can be placed in between them.
+	 */
+	static unsigned int default_level(const SchedulingEntity& entity)
+	{
+		switch (entity.priority()) {
+		case SchedulingEntityPriority::REALTIME: return 0;
+		case SchedulingEntityPriority::INTERACTIVE: return 8;
+		case SchedulingEntityPriority::NORMAL: return 16;
+		case SchedulingEntityPriority::DAEMON: return 24;
+		default: return NR_LEVELS - 1;
+		}
+	}
+
+	/**
+	 * Returns the number of runnable entities, across every level.
+	 */
+	unsigned int nr_runnable() const
+	{
+		unsigned int count = 0;
+		for (uint32_t levels_left = bitmap; levels_left; levels_left &= levels_left - 1) {
+			count += levels[__builtin_ctz(levels_left)].count();
+		}
+
+		return count;
+	}
+
+	/**
+	 * Adds an entity to the back of its level.  Must be called with interrupts disabled.
+	 */
+	void enqueue(QueuedEntity& queued)
+	{
+		if (queued.level >= NR_LEVELS) {
+			queued.level = default_level(*queued.entity);
+		}
+
+		levels[queued.level].enqueue(queued);
+		bitmap |= (1u << queued.level);
+	}
+
+	/**
+	 * Removes an entity from its level.  Must be called with interrupts disabled.
+	 */
+	void dequeue(QueuedEntity& queued)
+	{
+		levels[queued.level].remove(queued);
+		if (levels[queued.level].empty()) {
+			bitmap &= ~(1u << queued.level);
+		}
+	}
+
+	/**
+	 * Moves an entity to another level, re-queueing it if it is runnable.
+	 */
+	void set_level(SchedulingEntity& entity, unsigned int level)
+	{
+		entities.reserve();
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			return;
+		}
+
+		if (queued->link.queued()) {
+			dequeue(*queued);
+			queued->level = level;
+			enqueue(*queued);
+		} else {
+			queued->level = level;
+		}
+	}
+
+	static size_t read_stats(char *buffer, size_t size, void *arg)
+	{
+		PriorityScheduler *sched = (PriorityScheduler *)arg;
+		size_t pos = 0;
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		SchedulingEntity& current = Thread::current();
+		QueuedEntity *queued = sched->entities.find(current);
+
+		unsigned int level = (queued && queued->level < NR_LEVELS) ? queued->level : default_level(current);
+		stats_printf(buffer, size, pos, "level %u\n", level);
+
+		for (unsigned int i = 0; i < NR_LEVELS; i++) {
+			if (!sched->levels[i].empty()) {
+				stats_printf(buffer, size, pos, "queued%u %u\n", i, sched->levels[i].count());
+			}
+		}
+
+		return pos;
+	}
+
+	static int write_stats(const char *buffer, size_t size, void *arg)
+	{
+		PriorityScheduler *sched = (PriorityScheduler *)arg;
+
+		uint64_t level;
+		size_t i = 0;
+
+		if (!parse_control_number(buffer, size, i, level) || !control_at_end(buffer, size, i) || level >= NR_LEVELS) {
+			return -1;
+		}
+
+		sched->set_level(Thread::current(), level);
+		return size;
+	}
+
+	// The queue entries for every entity that is (or may become) runnable.
+	EntityTable<QueuedEntity> entities;
+
+	// A round-robin queue for each level, and a bit for each non-empty one.
+	LevelQueue levels[NR_LEVELS];
+	uint32_t bitmap;
+
+	StatsEntry stats;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(PriorityScheduler);
@@ -9,18 +9,43 @@
 #include <infos/kernel/sched.h>
 #include <infos/kernel/thread.h>
 #include <infos/kernel/log.h>
-#include <infos/util/list.h>
+#include <infos/kernel/cmdline.h>
 #include <infos/util/lock.h>
 
+#include "cmdline-util.h"
+#include "nohz.h"
+#include "runqueue.h"
+#include "sched-stats.h"
+#include "stats.h"
+
 using namespace infos::kernel;
 using namespace infos::util;
+using namespace coursework;
+
+// The length of a timeslice, in microseconds of CPU time.
+static uint64_t rr_quantum_us = 10000;
+
+RegisterCmdLineArgument(RRQuantum, "sched.rr.quantum")
+{
+	uint64_t quantum = parse_cmdline_number(value);
+	if (quantum > 0) {
+		rr_quantum_us = quantum;
+	}
+}
 
 /**
- * A round-robin scheduling algorithm
+ * A round-robin scheduling algorithm.  Each entity runs until it has used up a
+ * whole timeslice of CPU time (or blocks), and only then goes to the back of the
+ * queue.  An entity that blocks part-way through its slice keeps what is left of
+ * it for when it is woken.
  */
 class RoundRobinScheduler : public SchedulingAlgorithm
 {
 public:
+	RoundRobinScheduler() : current(NULL), nr_switches(0), nr_expiries(0), stats("rr", read_stats, NULL, this)
+	{
+	}
+
 	/**
 	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
 	 */
@@ -32,10 +57,14 @@ public:
 	 */
 	void add_to_runqueue(SchedulingEntity& entity) override
 	{
+		// grow the tables now if they need to, as they can't with interrupts disabled
+		entities.reserve();
+		sched_stats.reserve(entity);
+
 		// disabling interrupts
 		UniqueIRQLock l;
-		
-		runqueue.enqueue(&entity);
+
+		enqueue(entity);
 	}
 
 	/**
@@ -46,8 +75,28 @@ public:
 	{
 		// disabling interrupts
 		UniqueIRQLock l;
-		
-		runqueue.remove(&entity);
+
+		QueuedEntity *queued = entities.find(entity);
+		if (!queued) {
+			return;
+		}
+
+		// if it was running, bank the part of its slice it has used
+		if (queued == current) {
+			queued->slice_used += entity.cpu_runtime() - queued->slice_start;
+			current = NULL;
+		}
+
+		if (queued->link.queued()) {
+			runqueue.remove(*queued);
+		}
+
+		sched_stats.dequeued(entity);
+
+		// a stopped entity never runs again, so its queue entry can go
+		if (entity.stopped()) {
+			entities.release(queued);
+		}
 	}
 
 	/**
@@ -59,28 +108,109 @@ public:
 	{
 		// disabling interrupts
 		UniqueIRQLock l;
-		
+
+		SchedulingEntity *next = pick();
+		sched_stats.picked(next);
+		tick_control.picked(runqueue.count());
+
+		return next;
+	}
+
+private:
+	/**
+	 * Chooses the entity to run next.  Must be called with interrupts disabled.
+	 */
+	SchedulingEntity *pick()
+	{
 		// return nothing if queue is empty
-		if (runqueue.count() == 0) {
+		if (runqueue.empty()) {
+			current = NULL;
 			return NULL;
 		}
-		// pick first task if only one task is present
-		if (runqueue.count() == 1) {
-			return runqueue.first();
+
+		// the running task stays at the front of the queue until its slice is up
+		if (current) {
+			SchedulingEntity::EntityRuntime now = current->entity->cpu_runtime();
+			uint64_t used = current->slice_used + (now - current->slice_start);
+
+			if (used < rr_quantum_us * 1000) {
+				return current->entity;
+			}
+
+			nr_expiries++;
+
+			// start a fresh slice, at the back of the queue
+			current->slice_used = 0;
+			current->slice_start = now;
+			runqueue.rotate();
 		}
-		
-		// remove the task at the front of the queue...
-		auto entity = runqueue.dequeue();
-		// and add it to the back of the queue
-		runqueue.enqueue(entity);
-		
-		return entity;
-		
+
+		auto next = runqueue.first();
+		if (next != current) {
+			next->slice_start = next->entity->cpu_runtime();
+			current = next;
+			nr_switches++;
+		}
+
+		return next->entity;
 	}
 
-private:
-	// A list containing the current runqueue.
-	List<SchedulingEntity *> runqueue;
+	// The queue entry for an entity, which is kept for as long as it can run.
+	struct QueuedEntity {
+		QueuedEntity() : entity(NULL), slice_start(0), slice_used(0) { }
+
+		SchedulingEntity *entity;
+		RunQueueLink link;
+
+		// The entity's runtime when it last started running, and how much of its
+		// slice it had already used by then.
+		SchedulingEntity::EntityRuntime slice_start;
+		uint64_t slice_used;
+	};
+
+	/**
+	 * Adds an entity to the back of the runqueue, unless it is already on it.
+	 * Must be called with interrupts disabled.
+	 */
+	void enqueue(SchedulingEntity& entity)
+	{
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+			return;
+		}
+
+		if (!queued->link.queued()) {
+			runqueue.enqueue(*queued);
+			sched_stats.enqueued(entity);
+			tick_control.enqueued();
+		}
+	}
+
+	static size_t read_stats(char *buffer, size_t size, void *arg)
+	{
+		RoundRobinScheduler *sched = (RoundRobinScheduler *)arg;
+		size_t pos = 0;
+
+		stats_printf(buffer, size, pos, "quantum_us %lu\n", rr_quantum_us);
+		stats_printf(buffer, size, pos, "runnable %u\n", sched->runqueue.count());
+		stats_printf(buffer, size, pos, "switches %lu\n", sched->nr_switches);
+		stats_printf(buffer, size, pos, "expiries %lu\n", sched->nr_expiries);
+
+		return pos;
+	}
+
+	// The queue entries for every entity that is (or may become) runnable.
+	EntityTable<QueuedEntity> entities;
+
+	// The current runqueue, threaded through the queue entries.  The entity that
+	// is running is at the front.
+	RunQueue<QueuedEntity, &QueuedEntity::link> runqueue;
+	QueuedEntity *current;
+
+	uint64_t nr_switches, nr_expiries;
+
+	StatsEntry stats;
 };
 
 /* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
@@ -0,0 +1,30 @@
+/*
+ * SMP Round-robin Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "percpu-sched.h"
+
+using namespace infos::kernel;
+using namespace coursework;
+
+/**
+ * A round-robin scheduling algorithm with a run queue per CPU, and work stealing
+ * between them.  See percpu-sched.h for the balancing policy.
+ */
+class SMPRoundRobinScheduler : public PerCPUScheduler
+{
+public:
+	SMPRoundRobinScheduler() : PerCPUScheduler("smp") { }
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "smp"; }
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(SMPRoundRobinScheduler);
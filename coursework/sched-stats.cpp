@@ -0,0 +1,266 @@
+/*
+ * Scheduler Instrumentation
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "sched-stats.h"
+#include "cmdline-util.h"
+#include "percpu-sched.h"
+#include "tsc.h"
+#include <infos/kernel/cmdline.h>
+
+using namespace infos::kernel;
+using namespace coursework;
+
+bool coursework::sched_stats_enabled;
+
+SchedStats coursework::sched_stats;
+
+RegisterCmdLineArgument(SchedStats, "sched.stats")
+{
+	sched_stats_enabled = parse_cmdline_number(value) != 0;
+}
+
+SchedStats::SchedStats()
+: _nr_runnable(0),
+_max_runnable(0),
+_first_event(0),
+_stats("sched", read_stats, write_stats, this)
+{
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		CPUStats& cpu = _cpus[i];
+
+		cpu.current = NULL;
+		cpu.nr_voluntary = 0;
+		cpu.nr_involuntary = 0;
+		cpu.nr_picks = 0;
+		cpu.runnable_delta = 0;
+		cpu.runnable_area = 0;
+		cpu.last_event = 0;
+
+		for (unsigned int b = 0; b < NR_LATENCY_BUCKETS; b++) {
+			cpu.latency[b] = 0;
+		}
+	}
+}
+
+/**
+ * Changes the runnable count on behalf of the calling CPU, adding the time since
+ * the CPU's last change to its share of the integral first.
+ */
+void SchedStats::account_runnable(int delta)
+{
+	CPUStats& cpu = _cpus[current_cpu() % NR_CPU_SLOTS];
+
+	{
+		UniqueIRQSpinLock l(cpu.lock);
+		uint64_t now = rdtsc();
+
+		if (cpu.last_event) {
+			cpu.runnable_area += cpu.runnable_delta * (int64_t)(now - cpu.last_event);
+		}
+
+		cpu.last_event = now;
+		cpu.runnable_delta += delta;
+
+		uint64_t first = 0;
+		__atomic_compare_exchange_n(&_first_event, &first, now, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	unsigned int runnable = __atomic_add_fetch(&_nr_runnable, delta, __ATOMIC_RELAXED);
+
+	unsigned int max = __atomic_load_n(&_max_runnable, __ATOMIC_RELAXED);
+	while (delta > 0 && runnable > max) {
+		if (__atomic_compare_exchange_n(&_max_runnable, &max, runnable, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+}
+
+void SchedStats::record_enqueued(SchedulingEntity& entity)
+{
+	uint64_t now = rdtsc();
+	ThreadShard& shard = shard_of(entity);
+
+	{
+		UniqueIRQSpinLock l(shard.lock);
+
+		ThreadStats *thread = shard.threads.get(entity);
+		if (!thread || thread->runnable) {
+			return;
+		}
+
+		thread->runnable = true;
+		thread->wake_time = now;
+		thread->nr_wakeups++;
+	}
+
+	account_runnable(1);
+}
+
+void SchedStats::record_dequeued(SchedulingEntity& entity)
+{
+	ThreadShard& shard = shard_of(entity);
+	bool was_runnable = false;
+
+	{
+		UniqueIRQSpinLock l(shard.lock);
+
+		ThreadStats *thread = shard.threads.find(entity);
+		if (!thread) {
+			return;
+		}
+
+		if (thread->runnable) {
+			thread->runnable = false;
+			thread->wake_time = 0;
+			was_runnable = true;
+		}
+
+		// Stopped threads never come back, so there's no point keeping their counters.
+		if (entity.stopped()) {
+			shard.threads.release(thread);
+		}
+	}
+
+	if (was_runnable) {
+		account_runnable(-1);
+	}
+}
+
+void SchedStats::record_picked(SchedulingEntity *next, unsigned int cpu_index)
+{
+	uint64_t now = rdtsc();
+
+	// The CPU's slot is always locked before any thread shard, never after.
+	CPUStats& cpu = _cpus[cpu_index % NR_CPU_SLOTS];
+	UniqueIRQSpinLock l(cpu.lock);
+
+	cpu.nr_picks++;
+
+	SchedulingEntity *prev = cpu.current;
+	if (prev == next) {
+		return;
+	}
+
+	cpu.current = next;
+
+	// Switching away from an entity that could have carried on is a preemption.
+	if (prev) {
+		ThreadShard& shard = shard_of(*prev);
+		UniqueIRQSpinLock sl(shard.lock);
+
+		ThreadStats *prev_thread = shard.threads.find(*prev);
+
+		if (prev_thread && prev_thread->runnable) {
+			prev_thread->nr_involuntary++;
+			cpu.nr_involuntary++;
+		} else {
+			if (prev_thread) {
+				prev_thread->nr_voluntary++;
+			}
+			cpu.nr_voluntary++;
+		}
+	}
+
+	if (!next) {
+		return;
+	}
+
+	ThreadShard& shard = shard_of(*next);
+	UniqueIRQSpinLock sl(shard.lock);
+
+	ThreadStats *thread = shard.threads.find(*next);
+	if (thread && thread->wake_time) {
+		uint64_t latency = now - thread->wake_time;
+		thread->wake_time = 0;
+
+		if (latency > thread->max_latency) {
+			thread->max_latency = latency;
+		}
+
+		unsigned int bucket = latency ? (63 - __builtin_clzll(latency)) : 0;
+		cpu.latency[__min(bucket, NR_LATENCY_BUCKETS - 1)]++;
+	}
+}
+
+size_t SchedStats::read_stats(char *buffer, size_t size, void *arg)
+{
+	SchedStats *stats = (SchedStats *)arg;
+	size_t pos = 0;
+
+	uint64_t now = rdtsc();
+
+	uint64_t latency[NR_LATENCY_BUCKETS] = { 0 };
+	uint64_t nr_voluntary = 0, nr_involuntary = 0, nr_picks = 0;
+	int64_t area = 0;
+
+	for (unsigned int i = 0; i < NR_CPU_SLOTS; i++) {
+		CPUStats& cpu = stats->_cpus[i];
+		UniqueIRQSpinLock l(cpu.lock);
+
+		nr_voluntary += cpu.nr_voluntary;
+		nr_involuntary += cpu.nr_involuntary;
+		nr_picks += cpu.nr_picks;
+
+		area += cpu.runnable_area;
+		if (cpu.last_event) {
+			area += cpu.runnable_delta * (int64_t)(now - cpu.last_event);
+		}
+
+		for (unsigned int b = 0; b < NR_LATENCY_BUCKETS; b++) {
+			latency[b] += cpu.latency[b];
+		}
+	}
+
+	uint64_t first = __atomic_load_n(&stats->_first_event, __ATOMIC_RELAXED);
+	uint64_t elapsed = first ? now - first : 0;
+
+	// The per-CPU shares are read at slightly different times, so the sum can
+	// be a little off, but never negative.
+	uint64_t total = area > 0 ? area : 0;
+
+	stats_printf(buffer, size, pos, "enabled %u\n", sched_stats_enabled ? 1 : 0);
+	stats_printf(buffer, size, pos, "picks %lu\n", nr_picks);
+	stats_printf(buffer, size, pos, "voluntary_switches %lu\n", nr_voluntary);
+	stats_printf(buffer, size, pos, "involuntary_switches %lu\n", nr_involuntary);
+	stats_printf(buffer, size, pos, "runnable %u\n", __atomic_load_n(&stats->_nr_runnable, __ATOMIC_RELAXED));
+	stats_printf(buffer, size, pos, "runnable_max %u\n", __atomic_load_n(&stats->_max_runnable, __ATOMIC_RELAXED));
+
+	// Scaled by a thousand, to keep it to integers.
+	stats_printf(buffer, size, pos, "runnable_avg_milli %lu\n", elapsed ? (total / elapsed) * 1000 + ((total % elapsed) * 1000) / elapsed : 0);
+
+	// Bucket N counts latencies of 2^N up to 2^(N+1) cycles.
+	for (unsigned int i = 0; i < NR_LATENCY_BUCKETS; i++) {
+		if (latency[i]) {
+			stats_printf(buffer, size, pos, "wake_latency_%u %lu\n", i, latency[i]);
+		}
+	}
+
+	for (unsigned int i = 0; i < NR_THREAD_SHARDS; i++) {
+		ThreadShard& shard = stats->_shards[i];
+		UniqueIRQSpinLock l(shard.lock);
+
+		shard.threads.for_each([&](const ThreadStats& thread) {
+			stats_printf(buffer, size, pos, "thread %p runtime %lu wakeups %lu voluntary %lu involuntary %lu max_wake_latency %lu\n",
+				thread.entity, thread.entity->cpu_runtime(), thread.nr_wakeups, thread.nr_voluntary, thread.nr_involuntary, thread.max_latency);
+		});
+	}
+
+	return pos;
+}
+
+int SchedStats::write_stats(const char *buffer, size_t size, void *arg)
+{
+	if (size >= 6 && strncmp(buffer, "enable", 6) == 0) {
+		__atomic_store_n(&sched_stats_enabled, true, __ATOMIC_RELAXED);
+	} else if (size >= 7 && strncmp(buffer, "disable", 7) == 0) {
+		__atomic_store_n(&sched_stats_enabled, false, __ATOMIC_RELAXED);
+	} else {
+		return -1;
+	}
+
+	return size;
+}
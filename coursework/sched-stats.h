@@ -0,0 +1,144 @@
+/*
+ * Scheduler Instrumentation Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_SCHED_STATS_H
+#define COURSEWORK_SCHED_STATS_H
+
+#include <infos/kernel/sched.h>
+
+#include "runqueue.h"
+#include "spinlock.h"
+#include "stats.h"
+#include "trace.h"
+
+namespace coursework {
+
+	/* Whether the scheduler hooks record anything.  Only the hooks read this */
+	extern bool sched_stats_enabled;
+
+	/**
+	 * Counters for whichever scheduling algorithm is in use, published as
+	 * /.stats/sched.  Algorithms call the hooks from their add_to_runqueue (with
+	 * reserve() before they disable interrupts), remove_from_runqueue and
+	 * pick_next_entity paths, and this works out:
+	 *
+	 * - wakeup-to-run latency, as a histogram with power-of-two buckets (in TSC
+	 *   cycles), both globally and the worst case per thread,
+	 * - the number of runnable entities, averaged over time, and its maximum,
+	 * - voluntary (the previous entity had blocked) and involuntary (it was still
+	 *   runnable) context switches, globally and per thread,
+	 * - CPU time per thread.
+	 *
+	 * Like a tracepoint, each hook is a single branch until it is turned on, with
+	 * sched.stats=1 or by writing "enable" to /.stats/sched.  Once on, the global
+	 * counters are kept per CPU, and the per-thread ones in tables sharded by
+	 * entity, so that CPUs only contend when they touch the same thread.
+	 */
+	class SchedStats {
+	public:
+		static const unsigned int NR_LATENCY_BUCKETS = 40;
+		static const unsigned int NR_CPU_SLOTS = 16;
+		static const unsigned int NR_THREAD_SHARDS = 16;
+
+		SchedStats();
+
+		/* An entity may be about to be enqueued.  Called before the algorithm
+		disables interrupts, so that its thread's table can grow ahead of time */
+		void reserve(infos::kernel::SchedulingEntity& entity) {
+			if (__builtin_expect(sched_stats_enabled, 0)) {
+				shard_of(entity).threads.reserve();
+			}
+		}
+
+		/* An entity has been added to a run queue */
+		void enqueued(infos::kernel::SchedulingEntity& entity) {
+			TRACE(Sched, SchedEnqueue, &entity, 0);
+
+			if (__builtin_expect(sched_stats_enabled, 0)) {
+				record_enqueued(entity);
+			}
+		}
+
+		/* An entity has been taken off the run queues */
+		void dequeued(infos::kernel::SchedulingEntity& entity) {
+			TRACE(Sched, SchedDequeue, &entity, 0);
+
+			if (__builtin_expect(sched_stats_enabled, 0)) {
+				record_dequeued(entity);
+			}
+		}
+
+		/* The given entity (or nothing, if NULL) has been picked to run next */
+		void picked(infos::kernel::SchedulingEntity *next, unsigned int cpu = 0) {
+			TRACE(Sched, SchedPick, next, cpu);
+
+			if (__builtin_expect(sched_stats_enabled, 0)) {
+				record_picked(next, cpu);
+			}
+		}
+
+	private:
+		struct ThreadStats {
+			ThreadStats() : entity(NULL), runnable(false), wake_time(0), nr_wakeups(0), nr_voluntary(0), nr_involuntary(0), max_latency(0) { }
+
+			infos::kernel::SchedulingEntity *entity;
+
+			bool runnable;
+			uint64_t wake_time;
+
+			uint64_t nr_wakeups, nr_voluntary, nr_involuntary;
+			uint64_t max_latency;
+		};
+
+		struct ThreadShard {
+			SpinLock lock;
+			EntityTable<ThreadStats, 64> threads;
+		};
+
+		// Only the CPU (or CPUs, if there are more than slots) that the slot
+		// belongs to updates it, so its lock is normally uncontended.
+		struct CPUStats {
+			SpinLock lock;
+			infos::kernel::SchedulingEntity *current;
+
+			uint64_t latency[NR_LATENCY_BUCKETS];
+			uint64_t nr_voluntary, nr_involuntary, nr_picks;
+
+			// The change in the runnable count made on this CPU, and its integral
+			// over time.  Summed over every CPU, these give the real count and the
+			// real integral.
+			int64_t runnable_delta, runnable_area;
+			uint64_t last_event;
+		} __attribute__((aligned(64)));
+
+		void record_enqueued(infos::kernel::SchedulingEntity& entity);
+		void record_dequeued(infos::kernel::SchedulingEntity& entity);
+		void record_picked(infos::kernel::SchedulingEntity *next, unsigned int cpu);
+
+		ThreadShard& shard_of(const infos::kernel::SchedulingEntity& entity) {
+			return _shards[((uintptr_t)&entity >> 4) % NR_THREAD_SHARDS];
+		}
+
+		void account_runnable(int delta);
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+		static int write_stats(const char *buffer, size_t size, void *arg);
+
+		CPUStats _cpus[NR_CPU_SLOTS];
+		ThreadShard _shards[NR_THREAD_SHARDS];
+
+		unsigned int _nr_runnable, _max_runnable;
+		uint64_t _first_event;
+
+		StatsEntry _stats;
+	};
+
+	/* The instrumentation shared by every scheduling algorithm */
+	extern SchedStats sched_stats;
+}
+
+#endif /* COURSEWORK_SCHED_STATS_H */
@@ -0,0 +1,284 @@
+/*
+ * Stride Scheduling Algorithm
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/log.h>
+#include <infos/util/lock.h>
+
+#include "cmdline-util.h"
+#include "nohz.h"
+#include "runqueue.h"
+#include "sched-stats.h"
+#include "stats.h"
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+
+/**
+ * A stride (proportional-share) scheduling algorithm.  Each entity holds a number
+ * of tickets, and its stride is inversely proportional to them.  An entity's pass
+ * advances by its stride for every microsecond of CPU time it uses, and the
+ * runnable entity with the lowest pass always runs next, so over time each one
+ * gets CPU time in proportion to its tickets.  Runnable entities are kept in a
+ * heap ordered by pass.
+ *
+ * A thread sets its own tickets by writing the number to /.stats/stride, and
+ * reading the file tells it how many it has, along with every entity's share.
+ */
+class StrideScheduler : public SchedulingAlgorithm
+{
+public:
+	// The stride of an entity with one ticket, which is also the most tickets an
+	// entity can have.
+	static const uint64_t STRIDE1 = 1 << 20;
+	static const uint64_t DEFAULT_TICKETS = 100;
+
+	StrideScheduler() : current(NULL), global_pass(0), stats("stride", read_stats, write_stats, this)
+	{
+	}
+
+	/**
+	 * Returns the friendly name of the algorithm, for debugging and selection purposes.
+	 */
+	const char* name() const override { return "stride"; }
+
+	/**
+	 * Called when a scheduling entity becomes eligible for running.  An entity
+	 * that has been asleep can't have built up credit in the meantime, so its
+	 * pass is brought up to that of the runnable entities.
+	 * @param entity
+	 */
+	void add_to_runqueue(SchedulingEntity& entity) override
+	{
+		// grow the tables now if they need to, as they can't with interrupts disabled
+		entities.reserve();
+		runqueue.reserve();
+		sched_stats.reserve(entity);
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			syslog.messagef(LogLevel::ERROR, "%s: too many entities to schedule", name());
+			return;
+		}
+
+		if (queued->heap_index != PassHeap::NOT_QUEUED) {
+			return;
+		}
+
+		if (queued->pass < global_pass) {
+			queued->pass = global_pass;
+		}
+
+		runqueue.insert(*queued);
+		sched_stats.enqueued(entity);
+		tick_control.enqueued();
+	}
+
+	/**
+	 * Called when a scheduling entity is no longer eligible for running.
+	 * @param entity
+	 */
+	void remove_from_runqueue(SchedulingEntity& entity) override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.find(entity);
+		if (!queued) {
+			return;
+		}
+
+		if (queued->heap_index != PassHeap::NOT_QUEUED) {
+			runqueue.remove(*queued);
+		}
+
+		if (queued == current) {
+			charge(*queued);
+			current = NULL;
+		}
+
+		sched_stats.dequeued(entity);
+
+		// a stopped entity never runs again, so its queue entry can go
+		if (entity.stopped()) {
+			entities.release(queued);
+		}
+	}
+
+	/**
+	 * Called every time a scheduling event occurs, to cause the next eligible entity
+	 * to be chosen.  This is the runnable entity with the lowest pass, once the
+	 * running entity has been charged for the time it has used.
+	 */
+	SchedulingEntity *pick_next_entity() override
+	{
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		SchedulingEntity *next = pick();
+		sched_stats.picked(next);
+		tick_control.picked(runqueue.count());
+
+		return next;
+	}
+
+private:
+	// The queue entry for an entity, which is kept for as long as it can run.
+	struct QueuedEntity {
+		QueuedEntity()
+		: entity(NULL),
+		heap_index(PassHeap::NOT_QUEUED),
+		tickets(DEFAULT_TICKETS),
+		stride(STRIDE1 / DEFAULT_TICKETS),
+		pass(0),
+		last_runtime(0) { }
+
+		SchedulingEntity *entity;
+		unsigned int heap_index;
+
+		uint64_t tickets, stride, pass;
+
+		// The entity's runtime up to which it has been charged.
+		SchedulingEntity::EntityRuntime last_runtime;
+	};
+
+	typedef RunHeap<QueuedEntity, &QueuedEntity::pass, &QueuedEntity::heap_index> PassHeap;
+
+	/**
+	 * Advances an entity's pass for the CPU time it has used since it was last
+	 * charged.  Only whole microseconds are charged, and the remainder is carried
+	 * over to next time, so that no time goes uncounted.  The entity must not be
+	 * in the heap, as this changes its key.
+	 */
+	static void charge(QueuedEntity& queued)
+	{
+		SchedulingEntity::EntityRuntime runtime = queued.entity->cpu_runtime();
+		uint64_t used_us = (runtime - queued.last_runtime) / 1000;
+
+		queued.pass += used_us * queued.stride;
+		queued.last_runtime += used_us * 1000;
+	}
+
+	/**
+	 * Chooses the entity to run next.  Must be called with interrupts disabled.
+	 */
+	SchedulingEntity *pick()
+	{
+		if (current) {
+			runqueue.remove(*current);
+			charge(*current);
+			runqueue.insert(*current);
+		}
+
+		QueuedEntity *next = runqueue.top();
+		if (!next) {
+			current = NULL;
+			return NULL;
+		}
+
+		if (next != current) {
+			next->last_runtime = next->entity->cpu_runtime();
+		}
+
+		// the lowest pass of any runnable entity only ever goes up, and is where
+		// entities waking up start from
+		if (next->pass > global_pass) {
+			global_pass = next->pass;
+		}
+
+		current = next;
+
+		return next->entity;
+	}
+
+	/**
+	 * Changes the number of tickets an entity holds.  Its pass isn't changed, so
+	 * the new share applies from the time it is next charged.
+	 */
+	void set_tickets(SchedulingEntity& entity, uint64_t tickets)
+	{
+		entities.reserve();
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = entities.get(entity);
+		if (!queued) {
+			return;
+		}
+
+		// charge what it has used so far at the old rate
+		if (queued == current) {
+			runqueue.remove(*queued);
+			charge(*queued);
+			runqueue.insert(*queued);
+		}
+
+		queued->tickets = tickets;
+		queued->stride = STRIDE1 / tickets;
+	}
+
+	static size_t read_stats(char *buffer, size_t size, void *arg)
+	{
+		StrideScheduler *sched = (StrideScheduler *)arg;
+		size_t pos = 0;
+
+		// disabling interrupts
+		UniqueIRQLock l;
+
+		QueuedEntity *queued = sched->entities.find(Thread::current());
+		stats_printf(buffer, size, pos, "tickets %lu\n", queued ? queued->tickets : DEFAULT_TICKETS);
+		stats_printf(buffer, size, pos, "runnable %u\n", sched->runqueue.count());
+		stats_printf(buffer, size, pos, "global_pass %lu\n", sched->global_pass);
+
+		sched->entities.for_each([&](const QueuedEntity& queued) {
+			stats_printf(buffer, size, pos, "thread %p tickets %lu pass %lu runtime %lu\n",
+				queued.entity, queued.tickets, queued.pass, queued.entity->cpu_runtime());
+		});
+
+		return pos;
+	}
+
+	static int write_stats(const char *buffer, size_t size, void *arg)
+	{
+		StrideScheduler *sched = (StrideScheduler *)arg;
+
+		uint64_t tickets;
+		size_t i = 0;
+
+		if (!parse_control_number(buffer, size, i, tickets) || !control_at_end(buffer, size, i)) {
+			return -1;
+		}
+
+		if (tickets == 0 || tickets > STRIDE1) {
+			return -1;
+		}
+
+		sched->set_tickets(Thread::current(), tickets);
+		return size;
+	}
+
+	// The queue entries for every entity that is (or may become) runnable.
+	EntityTable<QueuedEntity> entities;
+
+	// The runnable entities, by pass.  The running entity stays in the heap.
+	PassHeap runqueue;
+	QueuedEntity *current;
+
+	uint64_t global_pass;
+
+	StatsEntry stats;
+};
+
+/* --- DO NOT CHANGE ANYTHING BELOW THIS LINE --- */
+
+RegisterScheduler(StrideScheduler);
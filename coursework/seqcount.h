@@ -0,0 +1,63 @@
+/*
+ * Sequence Counters
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_SEQCOUNT_H
+#define COURSEWORK_SEQCOUNT_H
+
+namespace coursework {
+
+	/**
+	 * A sequence counter, for data with a single writer that is read far more
+	 * often than it is written.  The count is odd while a write is in progress,
+	 * and readers never block the writer: they copy the data, and retry if the
+	 * count was odd or has changed since they started.
+	 *
+	 *	unsigned int seq;
+	 *	do {
+	 *		seq = counter.read_begin();
+	 *		copy = data;
+	 *	} while (counter.read_retry(seq));
+	 *
+	 * Writers must be serialised by other means, such as only ever writing from
+	 * one interrupt handler.
+	 */
+	class SeqCount {
+	public:
+		SeqCount() : _sequence(0) {
+		}
+
+		/* Starts a read, waiting for any write in progress to finish */
+		unsigned int read_begin() const {
+			unsigned int seq;
+			while ((seq = __atomic_load_n(&_sequence, __ATOMIC_ACQUIRE)) & 1) {
+				asm volatile("pause");
+			}
+
+			return seq;
+		}
+
+		/* Returns TRUE if the data read since read_begin() may be torn */
+		bool read_retry(unsigned int seq) const {
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			return __atomic_load_n(&_sequence, __ATOMIC_RELAXED) != seq;
+		}
+
+		void write_begin() {
+			__atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_RELEASE);
+		}
+
+		void write_end() {
+			__atomic_store_n(&_sequence, _sequence + 1, __ATOMIC_RELEASE);
+		}
+
+	private:
+		unsigned int _sequence;
+	};
+}
+
+#endif /* COURSEWORK_SEQCOUNT_H */
@@ -0,0 +1,71 @@
+/*
+ * Interrupt-safe Spinlocks
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_SPINLOCK_H
+#define COURSEWORK_SPINLOCK_H
+
+#include <infos/util/lock.h>
+
+namespace coursework {
+
+	/* Returns TRUE if interrupts are enabled on this CPU */
+	static inline bool interrupts_enabled()
+	{
+		uint64_t rflags;
+		asm volatile("pushfq; popq %0" : "=r"(rflags));
+
+		return (rflags & (1 << 9)) != 0;
+	}
+
+	/**
+	 * A test-and-test-and-set spinlock.  It is only ever taken through
+	 * UniqueIRQSpinLock, so the holder can't be interrupted (and then preempted)
+	 * whilst other CPUs spin on it.
+	 */
+	class SpinLock {
+	public:
+		SpinLock() : _locked(false) {
+		}
+
+		void lock() {
+			while (__atomic_exchange_n(&_locked, true, __ATOMIC_ACQUIRE)) {
+				while (__atomic_load_n(&_locked, __ATOMIC_RELAXED)) {
+					asm volatile("pause");
+				}
+			}
+		}
+
+		void unlock() {
+			__atomic_store_n(&_locked, false, __ATOMIC_RELEASE);
+		}
+
+	private:
+		bool _locked;
+	};
+
+	/**
+	 * Disables interrupts, and then takes a spinlock, for the lifetime of the object.
+	 */
+	class UniqueIRQSpinLock {
+	public:
+		UniqueIRQSpinLock(SpinLock& lock) : _lock(lock) {
+			_lock.lock();
+		}
+
+		~UniqueIRQSpinLock() {
+			_lock.unlock();
+		}
+
+	private:
+		// Declared first, so that interrupts are disabled before the lock is
+		// taken, and only re-enabled after it has been released.
+		infos::util::UniqueIRQLock _irq;
+		SpinLock& _lock;
+	};
+}
+
+#endif /* COURSEWORK_SPINLOCK_H */
@@ -0,0 +1,279 @@
+/*
+ * Kernel Statistics Files
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "stats.h"
+#include <infos/util/printf.h>
+#include <arch/x86/pio.h>
+
+using namespace infos::fs;
+using namespace infos::util;
+using namespace infos::arch::x86;
+using namespace coursework;
+
+// Every registered entry.  Entries are usually static objects, so this has to
+// be usable before any constructors have run, which it is, as it is zeroed.
+static SpinLock entries_lock;
+static StatsEntry *entries;
+
+StatsEntry::StatsEntry(const char *name, StatsReadFn read, StatsWriteFn write, void *arg)
+: _name(name),
+_read(read),
+_write(write),
+_arg(arg)
+{
+	UniqueIRQSpinLock l(entries_lock);
+
+	_next = entries;
+	entries = this;
+}
+
+StatsEntry::~StatsEntry()
+{
+	UniqueIRQSpinLock l(entries_lock);
+
+	StatsEntry **slot = &entries;
+	while (*slot && *slot != this) {
+		slot = &(*slot)->_next;
+	}
+
+	if (*slot) {
+		*slot = _next;
+	}
+}
+
+StatsEntry *StatsEntry::find(const String& name)
+{
+	UniqueIRQSpinLock l(entries_lock);
+
+	StatsEntry *entry = entries;
+	while (entry && !(String(entry->_name) == name)) {
+		entry = entry->_next;
+	}
+
+	return entry;
+}
+
+unsigned int StatsEntry::list(StatsEntry **out, unsigned int max)
+{
+	UniqueIRQSpinLock l(entries_lock);
+
+	unsigned int count = 0;
+	for (StatsEntry *entry = entries; entry && count < max; entry = entry->_next) {
+		out[count++] = entry;
+	}
+
+	return count;
+}
+
+void coursework::stats_printf(char *buffer, size_t size, size_t& pos, const char *fmt, ...)
+{
+	if (pos + 1 >= size) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buffer + pos, size - pos, fmt, args);
+	va_end(args);
+
+	if (n > 0) {
+		// Output that didn't fit is cut short, rather than overrunning the buffer.
+		pos = __min(pos + n, size - 1);
+	}
+}
+
+namespace coursework {
+
+	/**
+	 * An open stats file.  The contents are produced once, when the file is
+	 * opened, so that a reader sees a consistent snapshot however it reads it.
+	 */
+	class StatsFile : public File {
+	public:
+		StatsFile(StatsEntry& entry) : _entry(entry), _data(NULL), _size(0), _cur_pos(0) {
+			_data = new char[StatsEntry::MAX_SIZE];
+			_size = _entry.read(_data, StatsEntry::MAX_SIZE);
+		}
+
+		virtual ~StatsFile() {
+			delete[] _data;
+		}
+
+		void close() override {
+		}
+
+		int read(void *buffer, size_t size) override {
+			uint64_t pos = __atomic_load_n(&_cur_pos, __ATOMIC_RELAXED);
+			uint64_t end;
+			do {
+				end = pos + __min((uint64_t)size, pos < _size ? _size - pos : 0);
+			} while (!__atomic_compare_exchange_n(&_cur_pos, &pos, end, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+			return pread(buffer, end - pos, pos);
+		}
+
+		int pread(void *buffer, size_t size, off_t off) override {
+			if (off < 0 || (uint64_t)off >= _size) return 0;
+
+			size = __min((uint64_t)size, _size - off);
+			memcpy(buffer, _data + off, size);
+			return size;
+		}
+
+		int write(const void *buffer, size_t size) override {
+			return _entry.write((const char *)buffer, size);
+		}
+
+		void seek(off_t offset, SeekType type) override {
+			if (type == File::SeekAbsolute) {
+				__atomic_store_n(&_cur_pos, offset, __ATOMIC_RELAXED);
+			} else if (type == File::SeekRelative) {
+				__atomic_add_fetch(&_cur_pos, offset, __ATOMIC_RELAXED);
+			}
+		}
+
+	private:
+		StatsEntry& _entry;
+		char *_data;
+		uint64_t _size, _cur_pos;
+	};
+
+	/**
+	 * Lists the stats files that existed when the directory was opened.
+	 */
+	class StatsDirectory : public Directory {
+	public:
+		static const unsigned int MAX_ENTRIES = 64;
+
+		StatsDirectory() : _nr_entries(0), _cur_entry(0) {
+			StatsEntry *entries[MAX_ENTRIES];
+			_nr_entries = StatsEntry::list(entries, MAX_ENTRIES);
+
+			for (unsigned int i = 0; i < _nr_entries; i++) {
+				_entries[i].name = entries[i]->name();
+				_entries[i].size = 0;
+			}
+		}
+
+		bool read_entry(DirectoryEntry& entry) override {
+			unsigned int cur = __atomic_fetch_add(&_cur_entry, 1, __ATOMIC_RELAXED);
+
+			if (cur < _nr_entries) {
+				entry = _entries[cur];
+				return true;
+			} else {
+				__atomic_store_n(&_cur_entry, _nr_entries, __ATOMIC_RELAXED);
+				return false;
+			}
+		}
+
+		void close() override {
+		}
+
+	private:
+		DirectoryEntry _entries[MAX_ENTRIES];
+		unsigned int _nr_entries, _cur_entry;
+	};
+
+	/**
+	 * The node for a single stats file.
+	 */
+	class StatsNode : public PFSNode {
+	public:
+		StatsNode(PFSNode *parent, Filesystem& owner, StatsEntry& entry) : PFSNode(parent, owner), _entry(entry) {
+		}
+
+		File* open() override {
+			return new StatsFile(_entry);
+		}
+
+		Directory* opendir() override {
+			return NULL;
+		}
+
+		PFSNode* get_child(const String& name) override {
+			return NULL;
+		}
+
+		PFSNode* mkdir(const String& name) override {
+			return NULL;
+		}
+
+	private:
+		StatsEntry& _entry;
+	};
+}
+
+StatsDirectoryNode::StatsDirectoryNode(PFSNode *parent, Filesystem& owner) : PFSNode(parent, owner)
+{
+}
+
+StatsDirectoryNode::~StatsDirectoryNode()
+{
+	for (const auto& node : _nodes) {
+		delete node.value;
+	}
+}
+
+Directory* StatsDirectoryNode::opendir()
+{
+	return new StatsDirectory();
+}
+
+/**
+ * Looks up a stats file.  Nodes are created the first time a file is looked up,
+ * and kept for the lifetime of the directory.
+ * @param name The name of the stats file.
+ * @return Returns the node for the file, or NULL if there is no such file.
+ */
+PFSNode* StatsDirectoryNode::get_child(const String& name)
+{
+	StatsEntry *entry = StatsEntry::find(name);
+	if (!entry) {
+		return NULL;
+	}
+
+	UniqueIRQSpinLock l(_lock);
+
+	PFSNode *node;
+	if (!_nodes.try_get_value(name.get_hash(), node)) {
+		node = new StatsNode(this, owner(), *entry);
+		_nodes.add(name.get_hash(), node);
+	}
+
+	return node;
+}
+
+void coursework::console_write(const char *text, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		__outb(0xe9, text[i]);
+	}
+}
+
+/**
+ * Lets user programs write to the debug console, so that their results end up
+ * on the host's standard output.
+ */
+static int console_entry_write(const char *buffer, size_t size, void *arg)
+{
+	console_write(buffer, size);
+	return size;
+}
+
+static StatsEntry console_entry("console", NULL, console_entry_write);
+
+/**
+ * Discards everything written to it, so that copies can be timed without the
+ * cost of a real destination.
+ */
+static int null_entry_write(const char *buffer, size_t size, void *arg)
+{
+	return size;
+}
+
+static StatsEntry null_entry("null", NULL, null_entry_write);
@@ -0,0 +1,117 @@
+/*
+ * Kernel Statistics Files Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_STATS_H
+#define COURSEWORK_STATS_H
+
+#include <infos/fs/pfs-node.h>
+#include <infos/fs/file.h>
+#include <infos/fs/directory.h>
+
+#include <infos/util/string.h>
+#include <infos/util/map.h>
+
+#include "spinlock.h"
+
+namespace coursework {
+
+	/* Fills the buffer with the current contents of a stats file, and returns
+	the number of bytes written */
+	typedef size_t (*StatsReadFn)(char *buffer, size_t size, void *arg);
+
+	/* Handles a write to a stats file, and returns the number of bytes consumed,
+	or a negative number if the write was rejected */
+	typedef int (*StatsWriteFn)(const char *buffer, size_t size, void *arg);
+
+	/**
+	 * A named statistics file, which user programs can read (and, if it has a
+	 * write handler, write to) under the /.stats directory of the root filesystem.
+	 * Entries add themselves to the list of stats files when they are constructed,
+	 * so components normally just declare one as a static object or a member.  An
+	 * entry must outlive any open handles to its file.
+	 */
+	class StatsEntry {
+	public:
+		/* The largest amount of data a read handler can produce */
+		static const size_t MAX_SIZE = 8192;
+
+		StatsEntry(const char *name, StatsReadFn read, StatsWriteFn write = NULL, void *arg = NULL);
+		~StatsEntry();
+
+		const char *name() const {
+			return _name;
+		}
+
+		size_t read(char *buffer, size_t size) const {
+			return _read ? _read(buffer, size, _arg) : 0;
+		}
+
+		int write(const char *buffer, size_t size) const {
+			return _write ? _write(buffer, size, _arg) : -1;
+		}
+
+		/* Returns the entry with the given name, or NULL if there isn't one */
+		static StatsEntry *find(const infos::util::String& name);
+
+		/* Copies up to max entries into the array, and returns the number copied */
+		static unsigned int list(StatsEntry **entries, unsigned int max);
+
+	private:
+		const char *_name;
+		StatsReadFn _read;
+		StatsWriteFn _write;
+		void *_arg;
+
+		StatsEntry *_next;
+	};
+
+	/**
+	 * Appends formatted text to a buffer, never overrunning it.  Read handlers use
+	 * this to build their output.
+	 * @param buffer The buffer passed to the read handler.
+	 * @param size The size of the buffer.
+	 * @param pos The current length of the output, which is advanced.
+	 */
+	void stats_printf(char *buffer, size_t size, size_t& pos, const char *fmt, ...);
+
+	/**
+	 * Writes straight to the QEMU debug console (-debugcon), regardless of where
+	 * the system log is going, for output that is collected on the host.
+	 */
+	void console_write(const char *text, size_t size);
+
+	/**
+	 * The /.stats directory.  It doesn't belong to any particular filesystem, but
+	 * has to be attached to one to be reachable, so whichever filesystem is
+	 * mounted at the root creates one and returns it as a child of its root node.
+	 */
+	class StatsDirectoryNode : public infos::fs::PFSNode {
+	public:
+		StatsDirectoryNode(infos::fs::PFSNode *parent, infos::fs::Filesystem& owner);
+		virtual ~StatsDirectoryNode();
+
+		infos::fs::File* open() override {
+			return NULL;
+		}
+
+		infos::fs::Directory* opendir() override;
+
+		PFSNode* get_child(const infos::util::String& name) override;
+
+		PFSNode* mkdir(const infos::util::String& name) override {
+			return NULL;
+		}
+
+	private:
+		typedef infos::util::Map<infos::util::String::hash_type, PFSNode *> StatsNodeMap;
+
+		SpinLock _lock;
+		StatsNodeMap _nodes;
+	};
+}
+
+#endif /* COURSEWORK_STATS_H */
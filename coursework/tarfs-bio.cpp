@@ -0,0 +1,225 @@
+/*
+ * TAR File-system Block I/O Queue
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "tarfs-bio.h"
+#include "trace.h"
+#include <infos/kernel/log.h>
+#include <infos/util/string.h>
+
+using namespace infos::drivers::block;
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+using namespace tarfs;
+
+void BlockIORequest::prepare(uint64_t block, size_t count, void *buffer, BlockIOCompletion completion, void *arg)
+{
+	// A request cannot be re-used whilst it is still queued.
+	assert(_state == Idle || _state == Done);
+
+	this->block = block;
+	this->count = count;
+	this->buffer = buffer;
+	this->completion = completion;
+	this->completion_arg = arg;
+
+	_next = NULL;
+	_state = Idle;
+	_ok = false;
+}
+
+BlockIOQueue::BlockIOQueue(BlockDevice& bdev)
+: _bdev(bdev),
+_pending(NULL),
+_dispatching(false),
+_staging(NULL),
+_nr_device_reads(0),
+_nr_merged(0)
+{
+}
+
+BlockIOQueue::~BlockIOQueue()
+{
+	// There must not be anybody still waiting on a request.
+	assert(_pending == NULL);
+
+	delete[] _staging;
+}
+
+/**
+ * Adds a request to the pending list.  The list is kept sorted by starting block,
+ * so that requests for adjacent ranges sit next to each other and can be merged.
+ * @param rq The request to queue.
+ */
+void BlockIOQueue::submit(BlockIORequest& rq)
+{
+	assert(rq.count > 0);
+
+	UniqueIRQSpinLock l(_lock);
+
+	assert(rq._state == BlockIORequest::Idle);
+	rq._state = BlockIORequest::Pending;
+
+	// Find the slot in which the request should be inserted.
+	BlockIORequest **slot = &_pending;
+	while (*slot && (*slot)->block <= rq.block) {
+		slot = &(*slot)->_next;
+	}
+
+	rq._next = *slot;
+	*slot = &rq;
+}
+
+/**
+ * Runs the queue until the given request has completed.
+ * @param rq The request to wait for.  It must have been submitted.
+ * @return Returns TRUE if the request completed successfully, FALSE otherwise.
+ */
+bool BlockIOQueue::wait(BlockIORequest& rq)
+{
+	assert(rq._state != BlockIORequest::Idle);
+
+	while (!rq.done()) {
+		run();
+
+		// If the request is still not done, it is in flight on behalf of somebody
+		// else who is currently running the queue.
+		if (!rq.done()) {
+			asm volatile("pause");
+		}
+	}
+
+	return rq.ok();
+}
+
+/**
+ * Dispatches every pending request to the device.  Only one context runs the queue
+ * at a time; anybody else returns immediately, and picks up their completion later.
+ */
+void BlockIOQueue::run()
+{
+	for (;;) {
+		BlockIORequest *first;
+		size_t nr_blocks;
+
+		{
+			UniqueIRQSpinLock l(_lock);
+
+			if (_dispatching || _pending == NULL) {
+				return;
+			}
+
+			_dispatching = true;
+
+			// Take the first pending request, and then keep taking requests while
+			// they continue on from the end of the range collected so far.
+			first = _pending;
+			nr_blocks = first->count;
+
+			BlockIORequest *last = first;
+			last->_state = BlockIORequest::InFlight;
+
+			while (last->_next && last->_next->block == first->block + nr_blocks && nr_blocks + last->_next->count <= MAX_MERGE_BLOCKS) {
+				last = last->_next;
+				last->_state = BlockIORequest::InFlight;
+				nr_blocks += last->count;
+				_nr_merged++;
+			}
+
+			// Detach the collected requests from the pending list.
+			_pending = last->_next;
+			last->_next = NULL;
+		}
+
+		dispatch(first, nr_blocks);
+
+		{
+			UniqueIRQSpinLock l(_lock);
+			_dispatching = false;
+		}
+	}
+}
+
+/**
+ * Performs a single device transfer for a chain of adjacent requests, and then
+ * completes each request in the chain.
+ * @param first The first request in the chain.
+ * @param nr_blocks The total number of blocks covered by the chain.
+ */
+void BlockIOQueue::dispatch(BlockIORequest *first, size_t nr_blocks)
+{
+	const size_t block_size = _bdev.block_size();
+
+	TRACE(TarFS, TarFSBlockRead, first->block, nr_blocks);
+
+	// If every buffer in the chain follows on from the previous one, the device
+	// can transfer straight into them.  Otherwise, go via the staging buffer.
+	bool contiguous = true;
+	for (BlockIORequest *rq = first; rq->_next; rq = rq->_next) {
+		if ((uintptr_t)rq->buffer + (rq->count * block_size) != (uintptr_t)rq->_next->buffer) {
+			contiguous = false;
+			break;
+		}
+	}
+
+	bool ok;
+	if (contiguous) {
+		ok = _bdev.read_blocks(first->buffer, first->block, nr_blocks);
+	} else {
+		if (_staging == NULL) {
+			_staging = new uint8_t[MAX_MERGE_BLOCKS * block_size];
+		}
+
+		ok = _bdev.read_blocks(_staging, first->block, nr_blocks);
+
+		if (ok) {
+			size_t offset = 0;
+			for (BlockIORequest *rq = first; rq; rq = rq->_next) {
+				memcpy(rq->buffer, _staging + offset, rq->count * block_size);
+				offset += rq->count * block_size;
+			}
+		}
+	}
+
+	__atomic_add_fetch(&_nr_device_reads, 1, __ATOMIC_RELAXED);
+
+	BlockIORequest *rq = first;
+	while (rq) {
+		// The owner is free to re-use the request as soon as it is marked as done,
+		// so grab the next pointer first.
+		BlockIORequest *next = rq->_next;
+
+		rq->_next = NULL;
+		rq->_ok = ok;
+
+		// The request is marked as done before the completion runs, as the
+		// completion may hand the request back to its owner (e.g. by publishing a
+		// cache page, which can then be reclaimed and re-loaded straight away).
+		__atomic_store_n(&rq->_state, BlockIORequest::Done, __ATOMIC_RELEASE);
+
+		if (rq->completion) {
+			rq->completion(*rq, rq->completion_arg);
+		}
+
+		rq = next;
+	}
+}
+
+/**
+ * Reads a range of blocks, and waits for the data to arrive.
+ * @param buffer The buffer to read the data into.
+ * @param block The first block to read.
+ * @param count The number of blocks to read.
+ * @return Returns TRUE if the read was successful, FALSE otherwise.
+ */
+bool BlockIOQueue::read(void *buffer, uint64_t block, size_t count)
+{
+	BlockIORequest rq(block, count, buffer);
+
+	submit(rq);
+	return wait(rq);
+}
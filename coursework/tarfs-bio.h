@@ -0,0 +1,119 @@
+/*
+ * TAR File-system Block I/O Queue Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef TARFS_BIO_H
+#define TARFS_BIO_H
+
+#include <infos/drivers/block/block-device.h>
+
+#include "spinlock.h"
+
+namespace tarfs {
+
+	class BlockIORequest;
+	class BlockIOQueue;
+
+	/* Called once a request has completed, successfully or not.  The request is
+	already marked as done, so an owner that uses a completion must not re-use the
+	request on the strength of done() alone, only once the completion has run */
+	typedef void (*BlockIOCompletion)(BlockIORequest& rq, void *arg);
+
+	/**
+	 * Describes a read of a contiguous range of blocks into a buffer.  Requests are
+	 * owned by the submitter, and must stay alive until they have completed.
+	 */
+	class BlockIORequest {
+		friend class BlockIOQueue;
+
+	public:
+		BlockIORequest() : block(0), count(0), buffer(NULL), completion(NULL), completion_arg(NULL), _next(NULL), _state(Idle), _ok(false) {
+		}
+
+		BlockIORequest(uint64_t block, size_t count, void *buffer, BlockIOCompletion completion = NULL, void *arg = NULL) : _next(NULL), _state(Idle), _ok(false) {
+			prepare(block, count, buffer, completion, arg);
+		}
+
+		/* (Re-)initialises an idle request, so that it can be submitted */
+		void prepare(uint64_t block, size_t count, void *buffer, BlockIOCompletion completion = NULL, void *arg = NULL);
+
+		bool done() const {
+			return __atomic_load_n(&_state, __ATOMIC_ACQUIRE) == Done;
+		}
+
+		bool ok() const {
+			return _ok;
+		}
+
+		uint64_t block;
+		size_t count;
+		void *buffer;
+
+		BlockIOCompletion completion;
+		void *completion_arg;
+
+	private:
+		enum State { Idle, Pending, InFlight, Done };
+
+		BlockIORequest *_next;
+		volatile State _state;
+		bool _ok;
+	};
+
+	/**
+	 * A queue of outstanding block reads for a block device.  Submitting a request
+	 * never touches the device; requests are dispatched in ascending block order when
+	 * the queue is run, and adjacent ranges are merged into a single device transfer.
+	 * Any number of threads may submit and wait at once, but only one of them drives
+	 * the device at a time.
+	 */
+	class BlockIOQueue {
+	public:
+		/* The largest number of blocks that will be merged into one transfer */
+		static const size_t MAX_MERGE_BLOCKS = 128;
+
+		BlockIOQueue(infos::drivers::block::BlockDevice& bdev);
+		~BlockIOQueue();
+
+		/* Queues a request, without waiting for it to complete */
+		void submit(BlockIORequest& rq);
+
+		/* Dispatches pending requests until the given request has completed */
+		bool wait(BlockIORequest& rq);
+
+		/* Dispatches every pending request */
+		void run();
+
+		/* Synchronous helper, which submits a single request and waits for it */
+		bool read(void *buffer, uint64_t block, size_t count);
+
+		infos::drivers::block::BlockDevice& block_device() const {
+			return _bdev;
+		}
+
+		uint64_t nr_device_reads() const {
+			return __atomic_load_n(&_nr_device_reads, __ATOMIC_RELAXED);
+		}
+
+		uint64_t nr_merged_requests() const {
+			return __atomic_load_n(&_nr_merged, __ATOMIC_RELAXED);
+		}
+
+	private:
+		void dispatch(BlockIORequest *first, size_t nr_blocks);
+
+		infos::drivers::block::BlockDevice& _bdev;
+
+		coursework::SpinLock _lock;
+		BlockIORequest *_pending;
+		bool _dispatching;
+		uint8_t *_staging;
+
+		uint64_t _nr_device_reads, _nr_merged;
+	};
+}
+
+#endif /* TARFS_BIO_H */
@@ -0,0 +1,411 @@
+/*
+ * TAR File-system Page Cache
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "tarfs-cache.h"
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/mm/mm.h>
+
+using namespace infos::kernel;
+using namespace infos::mm;
+using namespace infos::util;
+using namespace coursework;
+using namespace tarfs;
+
+TarFSCache::TarFSCache(BlockIOQueue& io, uint64_t nr_blocks, unsigned int capacity)
+: _io(io),
+_nr_blocks(nr_blocks),
+_capacity(capacity),
+_pages(NULL),
+_clock_hand(0),
+_nr_loading(0),
+_frames(NULL),
+_nr_hits(0),
+_nr_misses(0)
+{
+	for (unsigned int i = 0; i < NR_BUCKETS; i++) {
+		_buckets[i].head = NULL;
+	}
+
+	// Every page starts off free.  The backing memory is only allocated when a
+	// page is first reclaimed.
+	_pages = new Page[_capacity];
+	for (unsigned int i = 0; i < _capacity; i++) {
+		Page *page = &_pages[i];
+
+		page->owner = this;
+		page->index = 0;
+		page->data = NULL;
+		page->pgd = NULL;
+		page->state = Page::Free;
+		page->refs = 0;
+		page->referenced = false;
+		page->hash_next = NULL;
+	}
+}
+
+TarFSCache::~TarFSCache()
+{
+	// Make sure nothing is still in flight before the pages go away.
+	_io.run();
+
+	for (unsigned int i = 0; i < _capacity; i++) {
+		assert(_pages[i].refs == 0);
+
+		if (_pages[i].pgd) {
+			sys.mm().pgalloc().free_pages(_pages[i].pgd, 0);
+		}
+	}
+
+	delete[] _pages;
+	delete _frames;
+}
+
+/**
+ * Switches the cache over to reading from a compressed archive.  Must be called
+ * before the filesystem is shared, and before any pages are pinned.
+ * @param frames The frame store for the archive.  The cache takes ownership of it.
+ */
+void TarFSCache::attach_frames(TarFSFrameStore *frames)
+{
+	// Any pages that were read so far came from the compressed image.
+	for (unsigned int i = 0; i < _capacity; i++) {
+		Page *page = &_pages[i];
+		assert(page->refs == 0);
+
+		if (page->state != Page::Free) {
+			Bucket& bucket = bucket_of(page->index);
+			UniqueIRQSpinLock l(bucket.lock);
+
+			unhash(bucket, page);
+			page->state = Page::Free;
+		}
+	}
+
+	_frames = frames;
+	_nr_blocks = (frames->archive_size() + 511) / 512;
+}
+
+/**
+ * Looks up a page in a hash bucket.  Must be called with the bucket locked.
+ * @param bucket The bucket the page would be in.
+ * @param index The index of the page to look up.
+ * @return Returns the page, or NULL if it is not cached.
+ */
+TarFSCache::Page *TarFSCache::lookup(Bucket& bucket, uint64_t index) const
+{
+	Page *page = bucket.head;
+	while (page && page->index != index) {
+		page = page->hash_next;
+	}
+
+	return page;
+}
+
+/**
+ * Finds a page that can be re-used, using the CLOCK algorithm: the hand sweeps
+ * round the pages, giving recently referenced pages a second chance.  Pinned pages
+ * and pages that are still being loaded are never taken.
+ * @return Returns a free, unhashed page with a single reference held on behalf of
+ * the caller, or NULL if every page is in use.
+ */
+TarFSCache::Page *TarFSCache::reclaim()
+{
+	UniqueIRQSpinLock l(_clock_lock);
+
+	// Two full turns of the hand are enough to get past every referenced bit.
+	for (unsigned int n = 0; n < _capacity * 2; n++) {
+		Page *page = &_pages[_clock_hand];
+		_clock_hand = (_clock_hand + 1) % _capacity;
+
+		if (__atomic_load_n(&page->refs, __ATOMIC_ACQUIRE) > 0 || page->state == Page::Loading) {
+			continue;
+		}
+
+		if (page->referenced) {
+			page->referenced = false;
+			continue;
+		}
+
+		if (page->data == NULL) {
+			page->pgd = sys.mm().pgalloc().alloc_pages(0);
+			if (page->pgd == NULL) {
+				return NULL;
+			}
+
+			page->data = (uint8_t *)sys.mm().pgalloc().pgd_to_vpa(page->pgd);
+		}
+
+		if (page->state == Page::Free) {
+			// Free pages are not in the hash table, and only reclaim() hands them
+			// out, so holding the clock lock is enough to claim one.
+			__atomic_store_n(&page->refs, 1, __ATOMIC_RELEASE);
+			return page;
+		}
+
+		// Otherwise the page has to come out of its bucket, and it could have been
+		// pinned by a lookup in the meantime.  A failed page could also have been
+		// dropped by release(), which only holds the bucket lock, in which case it
+		// is no longer in the bucket.
+		Bucket& bucket = bucket_of(page->index);
+		UniqueIRQSpinLock bl(bucket.lock);
+
+		if (page->refs > 0 || page->state == Page::Loading || page->state == Page::Free) {
+			continue;
+		}
+
+		if (lookup(bucket, page->index) != page) {
+			continue;
+		}
+
+		unhash(bucket, page);
+		page->state = Page::Free;
+		page->refs = 1;
+
+		return page;
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the page for an index, creating (but not loading) it if it is not cached.
+ * @param index The index of the page.
+ * @param pin Whether to take a reference to the page for the caller.
+ * @param created Set to TRUE if the page was created, in which case it is marked
+ * as loading, and the caller must start filling it.
+ * @return Returns the page, or NULL if there are no pages to spare.
+ */
+TarFSCache::Page *TarFSCache::get_or_create(uint64_t index, bool pin, bool& created)
+{
+	Bucket& bucket = bucket_of(index);
+	created = false;
+
+	{
+		UniqueIRQSpinLock l(bucket.lock);
+
+		Page *page = lookup(bucket, index);
+		if (page) {
+			if (pin) {
+				__atomic_add_fetch(&page->refs, 1, __ATOMIC_ACQUIRE);
+			}
+
+			// This is only a hint to reclaim(), so races on it don't matter.
+			page->referenced = true;
+			return page;
+		}
+	}
+
+	Page *fresh = reclaim();
+	if (!fresh) {
+		return NULL;
+	}
+
+	UniqueIRQSpinLock l(bucket.lock);
+
+	// Somebody else may have created the page whilst the bucket was unlocked, in
+	// which case the fresh page goes back to being free.
+	Page *page = lookup(bucket, index);
+	if (page) {
+		if (pin) {
+			__atomic_add_fetch(&page->refs, 1, __ATOMIC_ACQUIRE);
+		}
+
+		page->referenced = true;
+		__atomic_store_n(&fresh->refs, 0, __ATOMIC_RELEASE);
+		return page;
+	}
+
+	fresh->index = index;
+	fresh->state = Page::Loading;
+	fresh->referenced = true;
+	fresh->hash_next = bucket.head;
+	bucket.head = fresh;
+
+	// Pages that are loading can't be reclaimed, so an unpinned page is safe
+	// until its load completes.
+	__atomic_store_n(&fresh->refs, pin ? 1 : 0, __ATOMIC_RELEASE);
+
+	created = true;
+	return fresh;
+}
+
+/**
+ * Submits the read that fills a freshly created page.
+ */
+void TarFSCache::start_load(Page *page)
+{
+	uint64_t first_block = page->index * BLOCKS_PER_PAGE;
+
+	// The last page of the archive may be partial.
+	size_t nr_blocks = BLOCKS_PER_PAGE;
+	if (first_block + nr_blocks > _nr_blocks) {
+		nr_blocks = _nr_blocks - first_block;
+	}
+
+	__atomic_add_fetch(&_nr_loading, 1, __ATOMIC_RELAXED);
+
+	page->rq.prepare(first_block, nr_blocks, page->data, load_complete, page);
+	_io.submit(page->rq);
+}
+
+/**
+ * Fills a page from the compressed archive.
+ * @param page The page to fill, which must be marked as loading.
+ */
+void TarFSCache::fill_from_frames(Page *page)
+{
+	uint64_t start = page->index * PAGE_SIZE;
+	size_t length = __min((uint64_t)PAGE_SIZE, _frames->archive_size() - start);
+
+	bool ok = _frames->read(start, page->data, length);
+	if (ok && length < PAGE_SIZE) {
+		memset(page->data + length, 0, PAGE_SIZE - length);
+	}
+
+	__atomic_store_n(&page->state, ok ? Page::Ready : Page::Error, __ATOMIC_RELEASE);
+}
+
+void TarFSCache::load_complete(BlockIORequest& rq, void *arg)
+{
+	Page *page = (Page *)arg;
+
+	__atomic_store_n(&page->state, rq.ok() ? Page::Ready : Page::Error, __ATOMIC_RELEASE);
+	__atomic_sub_fetch(&page->owner->_nr_loading, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retrieves a page of the archive, reading it from the device if necessary.
+ * @param index The index of the page to retrieve.
+ * @return Returns the page, which must be released with release(), or NULL if
+ * the page could not be read.
+ */
+TarFSCache::Page *TarFSCache::get(uint64_t index)
+{
+	if (index >= nr_pages()) {
+		return NULL;
+	}
+
+	bool created;
+	Page *page = get_or_create(index, true, created);
+
+	if (!page) {
+		// Every unpinned page is still being loaded.  Complete the outstanding
+		// loads, and then have one more go.
+		_io.run();
+
+		page = get_or_create(index, true, created);
+		if (!page) {
+			return NULL;
+		}
+	}
+
+	if (created) {
+		__atomic_add_fetch(&_nr_misses, 1, __ATOMIC_RELAXED);
+
+		if (_frames) {
+			fill_from_frames(page);
+		} else {
+			start_load(page);
+		}
+	} else {
+		__atomic_add_fetch(&_nr_hits, 1, __ATOMIC_RELAXED);
+	}
+
+	// Wait for the page to arrive, whoever is loading it.  For pages coming from
+	// the device, this helps the load along by running the queue.
+	while (__atomic_load_n(&page->state, __ATOMIC_ACQUIRE) == Page::Loading) {
+		if (!_frames) {
+			_io.run();
+		}
+
+		asm volatile("pause");
+	}
+
+	if (page->state != Page::Ready) {
+		release(page);
+		return NULL;
+	}
+
+	return page;
+}
+
+/**
+ * Drops a reference to a page.  Once the last reference is dropped, the page
+ * becomes a candidate for reclaiming.
+ * @param page The page to release.
+ */
+void TarFSCache::release(Page *page)
+{
+	uint64_t index = page->index;
+
+	assert(page->refs > 0);
+	if (__atomic_sub_fetch(&page->refs, 1, __ATOMIC_RELEASE) > 0) {
+		return;
+	}
+
+	if (page->state == Page::Error) {
+		// Don't keep failed reads around, so that the next access retries.  The
+		// page may have been reclaimed (or even re-used) in the meantime, so only
+		// drop it if it is still the failed page for this index.
+		Bucket& bucket = bucket_of(index);
+		UniqueIRQSpinLock l(bucket.lock);
+
+		if (lookup(bucket, index) == page && page->refs == 0 && page->state == Page::Error) {
+			unhash(bucket, page);
+			page->state = Page::Free;
+		}
+	}
+}
+
+/**
+ * Starts reading a range of pages, without waiting for them.  Pages that are
+ * already cached are skipped, as are pages that don't fit in the cache.
+ * @param index The first page to read.
+ * @param count The number of pages to read.
+ */
+void TarFSCache::prefetch(uint64_t index, unsigned int count)
+{
+	// Compressed archives are read a frame at a time, and the frame store keeps
+	// recent frames around, so there's nothing to be gained from reading ahead.
+	if (_frames) {
+		return;
+	}
+
+	for (uint64_t i = index; i < index + count && i < nr_pages(); i++) {
+		// Leave at least half of the cache for pages that are actually wanted.
+		if (__atomic_load_n(&_nr_loading, __ATOMIC_RELAXED) >= _capacity / 2) {
+			break;
+		}
+
+		bool created;
+		Page *page = get_or_create(i, false, created);
+		if (page == NULL) {
+			break;
+		}
+
+		if (created) {
+			start_load(page);
+		}
+	}
+}
+
+/**
+ * Removes a page from its hash bucket.  Must be called with the bucket locked.
+ */
+void TarFSCache::unhash(Bucket& bucket, Page *page)
+{
+	Page **slot = &bucket.head;
+	while (*slot && *slot != page) {
+		slot = &(*slot)->hash_next;
+	}
+
+	assert(*slot == page);
+
+	*slot = page->hash_next;
+	page->hash_next = NULL;
+}
@@ -0,0 +1,138 @@
+/*
+ * TAR File-system Page Cache Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef TARFS_CACHE_H
+#define TARFS_CACHE_H
+
+#include "tarfs-bio.h"
+#include "tarfs-frames.h"
+#include "spinlock.h"
+
+#include <infos/mm/page-allocator.h>
+
+namespace tarfs {
+
+	/**
+	 * Caches page-sized chunks of the underlying archive.  Pages are identified by
+	 * their index into the archive, i.e. page N holds the bytes at N * PAGE_SIZE.
+	 *
+	 * A hit only takes the lock for the hash bucket the page lives in, and pins the
+	 * page with an atomic reference count.  Pages are reclaimed with the CLOCK
+	 * algorithm, so hits never have to touch any shared replacement state besides
+	 * the page's own referenced bit.
+	 */
+	class TarFSCache {
+	public:
+		static const unsigned int PAGE_SIZE = 4096;
+		static const unsigned int BLOCKS_PER_PAGE = PAGE_SIZE / 512;
+		static const unsigned int DEFAULT_CAPACITY = 256;
+
+		struct Page {
+			enum State { Free, Loading, Ready, Error };
+
+			TarFSCache *owner;
+			uint64_t index;
+			uint8_t *data;
+			infos::mm::PageDescriptor *pgd;
+
+			volatile State state;
+			unsigned int refs;
+			bool referenced;
+
+			Page *hash_next;
+
+			BlockIORequest rq;
+		};
+
+		TarFSCache(BlockIOQueue& io, uint64_t nr_blocks, unsigned int capacity = DEFAULT_CAPACITY);
+		~TarFSCache();
+
+		/* Returns the given page, pinned and loaded, or NULL if it could not be read */
+		Page *get(uint64_t index);
+
+		/* Unpins a page returned by get() */
+		void release(Page *page);
+
+		/* Starts loading a range of pages in the background */
+		void prefetch(uint64_t index, unsigned int count);
+
+		/* Serves pages from a compressed archive, rather than straight from the device */
+		void attach_frames(TarFSFrameStore *frames);
+
+		/* Returns the number of blocks in the (uncompressed) archive */
+		uint64_t nr_blocks() const {
+			return _nr_blocks;
+		}
+
+		/* Returns the number of pages the cache holds */
+		unsigned int capacity() const {
+			return _capacity;
+		}
+
+		/* Returns the number of pages that cover the archive */
+		uint64_t nr_pages() const {
+			return (_nr_blocks + BLOCKS_PER_PAGE - 1) / BLOCKS_PER_PAGE;
+		}
+
+		static uint64_t page_of_block(uint64_t block) {
+			return block / BLOCKS_PER_PAGE;
+		}
+
+		uint64_t nr_hits() const {
+			return __atomic_load_n(&_nr_hits, __ATOMIC_RELAXED);
+		}
+
+		uint64_t nr_misses() const {
+			return __atomic_load_n(&_nr_misses, __ATOMIC_RELAXED);
+		}
+
+		uint64_t nr_frames_decompressed() const {
+			return _frames ? _frames->nr_frames_decompressed() : 0;
+		}
+
+	private:
+		static const unsigned int NR_BUCKETS = 256;
+
+		struct Bucket {
+			coursework::SpinLock lock;
+			Page *head;
+		};
+
+		Bucket& bucket_of(uint64_t index) {
+			return _buckets[index % NR_BUCKETS];
+		}
+
+		Page *lookup(Bucket& bucket, uint64_t index) const;
+		Page *get_or_create(uint64_t index, bool pin, bool& created);
+		Page *reclaim();
+		void start_load(Page *page);
+		void fill_from_frames(Page *page);
+
+		void unhash(Bucket& bucket, Page *page);
+
+		static void load_complete(BlockIORequest& rq, void *arg);
+
+		BlockIOQueue& _io;
+		uint64_t _nr_blocks;
+
+		unsigned int _capacity;
+		Page *_pages;
+
+		Bucket _buckets[NR_BUCKETS];
+
+		coursework::SpinLock _clock_lock;
+		unsigned int _clock_hand;
+
+		unsigned int _nr_loading;
+
+		TarFSFrameStore *_frames;
+
+		uint64_t _nr_hits, _nr_misses;
+	};
+}
+
+#endif /* TARFS_CACHE_H */
@@ -0,0 +1,248 @@
+/*
+ * TAR File-system Compressed Frame Store
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "tarfs-frames.h"
+#include <infos/kernel/log.h>
+#include <infos/util/string.h>
+
+using namespace infos::kernel;
+using namespace infos::util;
+using namespace coursework;
+using namespace tarfs;
+
+#define BLOCK_SIZE 512
+
+// Frames are decompressed straight into cache pages, so they have to be a
+// whole number of pages.  The upper limit just keeps the buffers sensible.
+#define MIN_FRAME_SIZE	4096
+#define MAX_FRAME_SIZE	(1024 * 1024)
+
+/**
+ * Checks whether the device holds a compressed archive, by looking for the
+ * superblock, and loads the frame index if it does.
+ * @param io The queue for the device to probe.
+ * @return Returns a new frame store, or NULL if the device does not hold a
+ * (valid) compressed archive.
+ */
+TarFSFrameStore *TarFSFrameStore::probe(BlockIOQueue& io)
+{
+	uint8_t *buffer = new uint8_t[BLOCK_SIZE];
+	if (!io.read(buffer, 0, 1)) {
+		delete[] buffer;
+		return NULL;
+	}
+
+	struct tarfs_lz4_superblock sb;
+	memcpy(&sb, buffer, sizeof(sb));
+	delete[] buffer;
+
+	if (strncmp(sb.magic, TARFS_LZ4_MAGIC, sizeof(sb.magic)) != 0) {
+		return NULL;
+	}
+
+	if (sb.version != TARFS_LZ4_VERSION || sb.frame_size < MIN_FRAME_SIZE || sb.frame_size > MAX_FRAME_SIZE ||
+			(sb.frame_size % MIN_FRAME_SIZE) != 0 || (sb.index_offset % BLOCK_SIZE) != 0) {
+		syslog.messagef(LogLevel::ERROR, "tarfs: unsupported compressed archive (version %u, frame size %u)", sb.version, sb.frame_size);
+		return NULL;
+	}
+
+	if (sb.nr_frames != (sb.archive_size + sb.frame_size - 1) / sb.frame_size) {
+		syslog.messagef(LogLevel::ERROR, "tarfs: compressed archive has an inconsistent frame count");
+		return NULL;
+	}
+
+	// Read the whole index in one go -- it is only sixteen bytes per frame.
+	size_t index_size = sb.nr_frames * sizeof(struct tarfs_lz4_frame);
+	size_t index_blocks = (index_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	uint8_t *index = new uint8_t[index_blocks * BLOCK_SIZE];
+	if (!io.read(index, sb.index_offset / BLOCK_SIZE, index_blocks)) {
+		delete[] index;
+		return NULL;
+	}
+
+	struct tarfs_lz4_frame *frames = (struct tarfs_lz4_frame *)index;
+	for (uint64_t i = 0; i < sb.nr_frames; i++) {
+		if (frames[i].compressed_size > sb.frame_size || (frames[i].offset % BLOCK_SIZE) != 0) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: compressed archive has a corrupt index entry for frame %lu", i);
+			delete[] index;
+			return NULL;
+		}
+	}
+
+	syslog.messagef(LogLevel::INFO, "tarfs: compressed archive, %lu bytes in %lu frames", sb.archive_size, sb.nr_frames);
+
+	return new TarFSFrameStore(io, sb, frames);
+}
+
+TarFSFrameStore::TarFSFrameStore(BlockIOQueue& io, const struct tarfs_lz4_superblock& sb, struct tarfs_lz4_frame *index)
+: _io(io),
+_sb(sb),
+_index(index),
+_clock(0),
+_nr_decompressed(0)
+{
+	for (unsigned int i = 0; i < NR_CACHED_FRAMES; i++) {
+		_frames[i].index = 0;
+		_frames[i].data = new uint8_t[_sb.frame_size];
+		_frames[i].compressed = new uint8_t[_sb.frame_size];
+		_frames[i].last_used = 0;
+		_frames[i].state = Frame::Empty;
+		_frames[i].refs = 0;
+	}
+}
+
+TarFSFrameStore::~TarFSFrameStore()
+{
+	for (unsigned int i = 0; i < NR_CACHED_FRAMES; i++) {
+		delete[] _frames[i].data;
+		delete[] _frames[i].compressed;
+	}
+
+	delete[] (uint8_t *)_index;
+}
+
+/**
+ * Reads and decompresses a frame.  Each slot has its own buffer for the
+ * compressed data, so this is called without any locks held.
+ * @param frame The frame slot to decompress into.
+ * @param index The index of the frame to load.
+ * @return Returns TRUE if the frame was loaded, FALSE otherwise.
+ */
+bool TarFSFrameStore::load_frame(Frame *frame, uint64_t index)
+{
+	const struct tarfs_lz4_frame& entry = _index[index];
+
+	// The last frame is usually shorter than the rest.
+	size_t frame_len = _sb.frame_size;
+	if ((index + 1) * _sb.frame_size > _sb.archive_size) {
+		frame_len = _sb.archive_size - (index * _sb.frame_size);
+	}
+
+	size_t nr_blocks = (entry.compressed_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	if (!_io.read(frame->compressed, entry.offset / BLOCK_SIZE, nr_blocks)) {
+		return false;
+	}
+
+	if (entry.flags & TARFS_LZ4_FRAME_RAW) {
+		if (entry.compressed_size != frame_len) {
+			return false;
+		}
+
+		memcpy(frame->data, frame->compressed, frame_len);
+	} else {
+		int rc = tarfs_lz4_decompress(frame->compressed, entry.compressed_size, frame->data, frame_len);
+		if (rc != (int)frame_len) {
+			syslog.messagef(LogLevel::ERROR, "tarfs: frame %lu failed to decompress", index);
+			return false;
+		}
+	}
+
+	__atomic_add_fetch(&_nr_decompressed, 1, __ATOMIC_RELAXED);
+	return true;
+}
+
+/**
+ * Returns a decompressed frame, re-using a cached copy if there is one, and
+ * otherwise evicting the least recently used frame that nobody is reading from.
+ * If another reader is already loading the frame, this waits for it to finish.
+ * @param index The index of the frame.
+ * @return Returns the frame, which must be released with put_frame(), or NULL if
+ * it could not be loaded.
+ */
+TarFSFrameStore::Frame *TarFSFrameStore::get_frame(uint64_t index)
+{
+	Frame *frame = NULL;
+	bool load = false;
+
+	while (!frame) {
+		UniqueIRQSpinLock l(_lock);
+
+		Frame *victim = NULL;
+		for (unsigned int i = 0; i < NR_CACHED_FRAMES; i++) {
+			Frame *candidate = &_frames[i];
+
+			if (candidate->state != Frame::Empty && candidate->index == index) {
+				frame = candidate;
+				break;
+			}
+
+			if (candidate->refs == 0 && (!victim || candidate->state == Frame::Empty ||
+					(victim->state != Frame::Empty && candidate->last_used < victim->last_used))) {
+				victim = candidate;
+			}
+		}
+
+		if (!frame && victim) {
+			frame = victim;
+			frame->index = index;
+			frame->state = Frame::Loading;
+			load = true;
+		}
+
+		if (frame) {
+			frame->refs++;
+			frame->last_used = ++_clock;
+		}
+
+		// Otherwise, every slot is being read from, so go round again once one of
+		// the readers is done with theirs.
+	}
+
+	if (load) {
+		bool ok = load_frame(frame, index);
+		__atomic_store_n(&frame->state, ok ? Frame::Ready : Frame::Empty, __ATOMIC_RELEASE);
+	} else {
+		while (__atomic_load_n(&frame->state, __ATOMIC_ACQUIRE) == Frame::Loading) {
+			asm volatile("pause");
+		}
+	}
+
+	if (frame->state != Frame::Ready) {
+		put_frame(frame);
+		return NULL;
+	}
+
+	return frame;
+}
+
+/**
+ * Drops a reference to a frame returned by get_frame().
+ */
+void TarFSFrameStore::put_frame(Frame *frame)
+{
+	UniqueIRQSpinLock l(_lock);
+
+	assert(frame->refs > 0);
+	frame->refs--;
+}
+
+bool TarFSFrameStore::read(uint64_t pos, void *buffer, size_t size)
+{
+	if (pos + size > _sb.archive_size) {
+		return false;
+	}
+
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		uint64_t index = (pos + nbytes) / _sb.frame_size;
+
+		Frame *frame = get_frame(index);
+		if (!frame) {
+			return false;
+		}
+
+		size_t remainder = (pos + nbytes) % _sb.frame_size;
+		size_t dist = __min(_sb.frame_size - remainder, size - nbytes);
+		memcpy((void *)((uintptr_t)buffer + nbytes), frame->data + remainder, dist);
+		put_frame(frame);
+
+		nbytes += dist;
+	}
+
+	return true;
+}
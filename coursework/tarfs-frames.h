@@ -0,0 +1,78 @@
+/*
+ * TAR File-system Compressed Frame Store Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef TARFS_FRAMES_H
+#define TARFS_FRAMES_H
+
+#include "tarfs-bio.h"
+#include "tarfs-lz4.h"
+#include "spinlock.h"
+
+namespace tarfs {
+
+	/**
+	 * Presents a compressed archive (see tarfs-lz4.h) as the plain archive it was
+	 * made from.  Only the frames covering a read are fetched and decompressed, and
+	 * the most recently used decompressed frames are kept around.  Readers on
+	 * different CPUs may share a frame, and decompress different frames at once.
+	 */
+	class TarFSFrameStore {
+	public:
+		static const unsigned int NR_CACHED_FRAMES = 4;
+
+		/* Returns a frame store if the device holds a compressed archive,
+		or NULL if it holds anything else */
+		static TarFSFrameStore *probe(BlockIOQueue& io);
+
+		~TarFSFrameStore();
+
+		/* Copies a byte range of the uncompressed archive into the buffer.
+		Returns FALSE if any frame in the range could not be read */
+		bool read(uint64_t pos, void *buffer, size_t size);
+
+		/* Returns the size of the uncompressed archive, in bytes */
+		uint64_t archive_size() const {
+			return _sb.archive_size;
+		}
+
+		uint64_t nr_frames_decompressed() const {
+			return __atomic_load_n(&_nr_decompressed, __ATOMIC_RELAXED);
+		}
+
+	private:
+		struct Frame {
+			enum State { Empty, Loading, Ready };
+
+			uint64_t index;
+			uint8_t *data;
+			uint8_t *compressed;
+			uint64_t last_used;
+
+			volatile State state;
+			unsigned int refs;
+		};
+
+		TarFSFrameStore(BlockIOQueue& io, const struct tarfs_lz4_superblock& sb, struct tarfs_lz4_frame *index);
+
+		Frame *get_frame(uint64_t index);
+		void put_frame(Frame *frame);
+		bool load_frame(Frame *frame, uint64_t index);
+
+		BlockIOQueue& _io;
+		struct tarfs_lz4_superblock _sb;
+		struct tarfs_lz4_frame *_index;
+
+		/* Protects the frame slots, but not the frame data itself */
+		coursework::SpinLock _lock;
+		Frame _frames[NR_CACHED_FRAMES];
+		uint64_t _clock;
+
+		uint64_t _nr_decompressed;
+	};
+}
+
+#endif /* TARFS_FRAMES_H */
@@ -0,0 +1,96 @@
+/*
+ * TAR File-system LZ4 Block Decompressor
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "tarfs-lz4.h"
+#include <infos/util/string.h>
+
+using namespace infos::util;
+
+/**
+ * Reads an LZ4 length extension: after a nibble of 15, further bytes are added
+ * on until one of them is not 255.
+ * @param ip The input pointer, which is advanced past the extension.
+ * @param end The end of the input.
+ * @param length The length to add the extension to.
+ * @return Returns TRUE if the extension was read, FALSE if the input ran out.
+ */
+static inline bool read_length(const uint8_t *& ip, const uint8_t *end, size_t& length)
+{
+	uint8_t b;
+	do {
+		if (ip >= end) {
+			return false;
+		}
+
+		b = *ip++;
+		length += b;
+	} while (b == 255);
+
+	return true;
+}
+
+int tarfs_lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len)
+{
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + src_len;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_len;
+
+	while (ip < iend) {
+		// Every sequence starts with a token: the top nibble is the number of
+		// literals, and the bottom nibble is the match length (minus four).
+		uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15 && !read_length(ip, iend, literals)) {
+			return -1;
+		}
+
+		if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) {
+			return -1;
+		}
+
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		// The last sequence of a block consists of literals only.
+		if (ip == iend) {
+			break;
+		}
+
+		if (iend - ip < 2) {
+			return -1;
+		}
+
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (offset == 0 || offset > (size_t)(op - dst)) {
+			return -1;
+		}
+
+		size_t match = token & 15;
+		if (match == 15 && !read_length(ip, iend, match)) {
+			return -1;
+		}
+		match += 4;
+
+		if (match > (size_t)(oend - op)) {
+			return -1;
+		}
+
+		// The match may overlap the bytes it produces (e.g. a run of a single
+		// byte), so it has to be copied forwards one byte at a time.
+		const uint8_t *from = op - offset;
+		while (match--) {
+			*op++ = *from++;
+		}
+	}
+
+	return op - dst;
+}
@@ -0,0 +1,53 @@
+/*
+ * TAR File-system Compressed Archive Format Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef TARFS_LZ4_H
+#define TARFS_LZ4_H
+
+#include <infos/define.h>
+
+/*
+ * A compressed archive is a plain TAR file that has been cut into fixed-size
+ * frames, each of which is compressed independently as an LZ4 block.  The layout
+ * on the device is:
+ *
+ *   block 0       the superblock below
+ *   block 1...    the frame index: one tarfs_lz4_frame entry per frame
+ *   ...           the frames themselves, each starting on a block boundary
+ *
+ * All fields are little-endian.  A frame that does not get any smaller when
+ * compressed is stored as-is, and marked as such in the index.
+ */
+#define TARFS_LZ4_MAGIC			"TARFSLZ4"
+#define TARFS_LZ4_VERSION		1
+#define TARFS_LZ4_DEFAULT_FRAME_SIZE	(64 * 1024)
+
+#define TARFS_LZ4_FRAME_RAW		1
+
+struct tarfs_lz4_superblock {
+	char magic[8];
+	uint32_t version;
+	uint32_t frame_size;
+	uint64_t archive_size;
+	uint64_t nr_frames;
+	uint64_t index_offset;
+} __packed;
+
+struct tarfs_lz4_frame {
+	uint64_t offset;
+	uint32_t compressed_size;
+	uint32_t flags;
+} __packed;
+
+/*
+ * Decompresses a single LZ4 block.  The input is fully bounds-checked, so a
+ * corrupt frame produces an error rather than a wild write.  Returns the number of
+ * bytes produced, or -1 if the input is malformed or does not fit in the output.
+ */
+extern int tarfs_lz4_decompress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
+
+#endif /* TARFS_LZ4_H */
@@ -0,0 +1,216 @@
+/*
+ * TAR File-system Memory Mapping
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "tarfs-mmap.h"
+#include "tarfs.h"
+#include <infos/kernel/kernel.h>
+#include <infos/mm/mm.h>
+
+using namespace infos::kernel;
+using namespace infos::mm;
+using namespace coursework;
+using namespace tarfs;
+
+#define PAGE_SIZE	TarFSCache::PAGE_SIZE
+
+// The end of the bottom half of the address space, where user mappings live.
+#define USER_SPACE_END	0x0000800000000000ULL
+
+/* Drops the TLB entry for a page of the current address space */
+static inline void invlpg(virt_addr_t va)
+{
+	asm volatile("invlpg (%0)" : : "r"(va) : "memory");
+}
+
+TarFSMappings::TarFSMappings(TarFS& owner)
+: _owner(owner),
+_mappings(NULL),
+_nr_mappings(0),
+_nr_pinned(0)
+{
+}
+
+TarFSMappings::~TarFSMappings()
+{
+	while (_mappings) {
+		Mapping *mapping = _mappings;
+		_mappings = mapping->next;
+
+		release(mapping, mapping->nr_pages);
+	}
+}
+
+/**
+ * Maps part of a file, read-only, into an address space.  Every page is in place
+ * by the time this returns.
+ * @param vma The address space to map the file into.
+ * @param va The (page-aligned) virtual address to map the file at.
+ * @param data_offset Where the file's data starts in the archive, which must be
+ * on a page boundary.
+ * @param file_size The size of the file.
+ * @param off The (page-aligned) offset within the file to start mapping from.
+ * @param length The number of bytes to map, which must all be within the file.
+ * @return Returns TRUE if the mapping was made, FALSE otherwise.
+ */
+bool TarFSMappings::map(VMA& vma, virt_addr_t va, uint64_t data_offset, uint64_t file_size, uint64_t off, uint64_t length)
+{
+	if (length == 0 || (va % PAGE_SIZE) != 0 || (off % PAGE_SIZE) != 0 || (data_offset % PAGE_SIZE) != 0) {
+		return false;
+	}
+
+	if (off >= file_size || length > file_size - off || va >= USER_SPACE_END || length > USER_SPACE_END - va) {
+		return false;
+	}
+
+	unsigned int nr_pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+
+	// a mapping never replaces anything else
+	for (unsigned int i = 0; i < nr_pages; i++) {
+		if (vma.is_mapped(va + (i * PAGE_SIZE))) {
+			return false;
+		}
+	}
+
+	TarFSCache& cache = _owner.cache();
+
+	{
+		UniqueIRQSpinLock l(_lock);
+
+		if (_nr_pinned + nr_pages > cache.capacity() / 2) {
+			return false;
+		}
+
+		_nr_pinned += nr_pages;
+	}
+
+	Mapping *mapping = new Mapping();
+	mapping->vma = &vma;
+	mapping->base = va;
+	mapping->nr_pages = nr_pages;
+	mapping->pages = new TarFSCache::Page *[nr_pages];
+	mapping->tail = NULL;
+
+	uint64_t first = (data_offset + off) / PAGE_SIZE;
+
+	unsigned int filled = 0;
+	for (; filled < nr_pages; filled++) {
+		uint64_t pos = off + ((uint64_t)filled * PAGE_SIZE);
+
+		if (file_size - pos >= PAGE_SIZE) {
+			mapping->pages[filled] = cache.get(first + filled);
+			if (!mapping->pages[filled]) {
+				break;
+			}
+
+			continue;
+		}
+
+		// The file ends part-way through this page, and the cache page goes on
+		// to the next header, which isn't the mapper's to see.
+		mapping->pages[filled] = NULL;
+
+		PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(0);
+		if (!pgd) {
+			break;
+		}
+
+		uint8_t *data = (uint8_t *)sys.mm().pgalloc().pgd_to_vpa(pgd);
+		memset(data, 0, PAGE_SIZE);
+
+		size_t n = file_size - pos;
+		if (_owner.read_archive(data_offset + pos, data, n) != n) {
+			sys.mm().pgalloc().free_pages(pgd, 0);
+			break;
+		}
+
+		mapping->tail = pgd;
+	}
+
+	if (filled < nr_pages) {
+		release(mapping, filled);
+		return false;
+	}
+
+	for (unsigned int i = 0; i < nr_pages; i++) {
+		PageDescriptor *pgd = mapping->pages[i] ? mapping->pages[i]->pgd : mapping->tail;
+		vma.insert_mapping(va + (i * PAGE_SIZE), sys.mm().pgalloc().pgd_to_pba(pgd), (MappingFlags::MappingFlags)(MappingFlags::Present | MappingFlags::User));
+	}
+
+	{
+		UniqueIRQSpinLock l(_lock);
+
+		mapping->next = _mappings;
+		_mappings = mapping;
+		_nr_mappings++;
+	}
+
+	return true;
+}
+
+/**
+ * Removes a mapping, and unpins its pages.  The address space must be the
+ * current one, as its TLB entries are dropped here.
+ * @param vma The address space containing the mapping.
+ * @param va The virtual address the mapping starts at.
+ * @return Returns TRUE if the mapping was removed, FALSE if there was no such mapping.
+ */
+bool TarFSMappings::unmap(VMA& vma, virt_addr_t va)
+{
+	Mapping *mapping;
+
+	{
+		UniqueIRQSpinLock l(_lock);
+
+		Mapping **slot = &_mappings;
+		while (*slot && ((*slot)->vma != &vma || (*slot)->base != va)) {
+			slot = &(*slot)->next;
+		}
+
+		if (*slot == NULL) {
+			return false;
+		}
+
+		mapping = *slot;
+		*slot = mapping->next;
+		_nr_mappings--;
+	}
+
+	for (unsigned int i = 0; i < mapping->nr_pages; i++) {
+		virt_addr_t page = mapping->base + (i * PAGE_SIZE);
+
+		vma.remove_mapping(page);
+		invlpg(page);
+	}
+
+	release(mapping, mapping->nr_pages);
+	return true;
+}
+
+/**
+ * Unpins the first nr_filled pages of a mapping, frees its private page, and
+ * then the mapping itself.
+ */
+void TarFSMappings::release(Mapping *mapping, unsigned int nr_filled)
+{
+	for (unsigned int i = 0; i < nr_filled; i++) {
+		if (mapping->pages[i]) {
+			_owner.cache().release(mapping->pages[i]);
+		}
+	}
+
+	if (mapping->tail) {
+		sys.mm().pgalloc().free_pages(mapping->tail, 0);
+	}
+
+	{
+		UniqueIRQSpinLock l(_lock);
+		_nr_pinned -= mapping->nr_pages;
+	}
+
+	delete[] mapping->pages;
+	delete mapping;
+}
@@ -0,0 +1,78 @@
+/*
+ * TAR File-system Memory Mapping Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef TARFS_MMAP_H
+#define TARFS_MMAP_H
+
+#include "tarfs-cache.h"
+#include "spinlock.h"
+
+#include <infos/mm/vma.h>
+
+namespace tarfs {
+
+	class TarFS;
+
+	/**
+	 * Read-only memory mappings of TarFS files.  The pages mapped are the page
+	 * cache's own pages, pinned for as long as the mapping lasts, so every process
+	 * that maps a file shares them with each other and with read().  That needs the
+	 * file's data to start on a page boundary in the archive (tools/mkbenchfs.py
+	 * pads the archive to make it so); files that don't can't be mapped.  Only a
+	 * partial last page is a private copy, with zeroes after the end of the file,
+	 * as the rest of that cache page holds the next header.
+	 *
+	 * The page fault handler is in the infos submodule, so a mapping is filled in
+	 * when it is made, rather than as it is touched.  To leave room for everything
+	 * else, mappings can pin at most half of the cache between them.
+	 */
+	class TarFSMappings {
+	public:
+		TarFSMappings(TarFS& owner);
+		~TarFSMappings();
+
+		/* Maps length bytes of a file, from offset off, read-only at va */
+		bool map(infos::mm::VMA& vma, virt_addr_t va, uint64_t data_offset, uint64_t file_size, uint64_t off, uint64_t length);
+
+		/* Removes the mapping that starts at the given address */
+		bool unmap(infos::mm::VMA& vma, virt_addr_t va);
+
+		uint64_t nr_mappings() const {
+			return __atomic_load_n(&_nr_mappings, __ATOMIC_RELAXED);
+		}
+
+		unsigned int nr_pinned() const {
+			return __atomic_load_n(&_nr_pinned, __ATOMIC_RELAXED);
+		}
+
+	private:
+		struct Mapping {
+			infos::mm::VMA *vma;
+			virt_addr_t base;
+			unsigned int nr_pages;
+
+			// The pinned cache page behind each page of the mapping, or NULL for
+			// the private copy of a partial last page.
+			TarFSCache::Page **pages;
+			infos::mm::PageDescriptor *tail;
+
+			Mapping *next;
+		};
+
+		void release(Mapping *mapping, unsigned int nr_filled);
+
+		TarFS& _owner;
+
+		coursework::SpinLock _lock;
+		Mapping *_mappings;
+
+		uint64_t _nr_mappings;
+		unsigned int _nr_pinned;
+	};
+}
+
+#endif /* TARFS_MMAP_H */
@@ -7,13 +7,21 @@
  * STUDENT NUMBER: s1894401
  */
 #include "tarfs.h"
+#include "boot-timing.h"
+#include "cmdline-util.h"
+#include "klog.h"
+#include "trace.h"
+#include "tsc.h"
 #include <infos/kernel/log.h>
+#include <infos/kernel/process.h>
+#include <infos/kernel/thread.h>
 #define BLOCK_SIZE 512
 
 using namespace infos::fs;
 using namespace infos::drivers;
 using namespace infos::drivers::block;
 using namespace infos::kernel;
+using namespace infos::mm;
 using namespace infos::util;
 using namespace tarfs;
 
@@ -21,33 +29,30 @@ using namespace tarfs;
  * TAR files contain header data encoded as octal values in ASCII.  This function
  * converts this terrible representation into a real unsigned integer.
  *
- * You DO NOT need to modify this function.
+ * The field is not necessarily null-terminated (a size field can use all twelve
+ * characters for digits), so parsing stops at the end of the field, or at the
+ * first space or null character after the digits.
  *
- * @param data The (null-terminated) ASCII data containing an octal number.
+ * @param data The ASCII data containing an octal number.
+ * @param len The length of the field containing the data.
  * @return Returns an unsigned integer number, corresponding to the input data.
  */
-static inline unsigned int octal2ui(const char *data)
+static inline uint64_t octal2ui(const char *data, size_t len)
 {
 	// Current working value.
-	unsigned int value = 0;
+	uint64_t value = 0;
 
-	// Length of the input data.
-	int len = strlen(data);
+	size_t i = 0;
 
-	// Starting at i = 1, with a factor of one.
-	int i = 1, factor = 1;
-	while (i < len) {
-		// Extract the current character we're working on (backwards from the end).
-		char ch = data[len - i];
+	// Skip any leading padding.
+	while (i < len && data[i] == ' ') {
+		i++;
+	}
 
-		// Add the value of the character, multipled by the factor, to
-		// the working value.
-		value += factor * (ch - '0');
-		
-		// Increment the factor by multiplying it by eight.
-		factor *= 8;
-		
-		// Increment the current character position.
+	while (i < len && data[i] >= '0' && data[i] <= '7') {
+		// Shift the working value up by one octal digit, and add in the
+		// value of the current character.
+		value = (value << 3) + (data[i] - '0');
 		i++;
 	}
 
@@ -55,60 +60,467 @@ static inline unsigned int octal2ui(const char *data)
 	return value;
 }
 
+/**
+ * Numeric header fields that are too large for octal are stored by GNU tar (and
+ * POSIX.1-2001 implementations) as big-endian base-256, which is flagged by the top
+ * bit of the first byte being set.  This function handles both representations.
+ *
+ * @param data The numeric field.
+ * @param len The length of the field.
+ * @return Returns the value stored in the field.
+ */
+static inline uint64_t parse_number(const char *data, size_t len)
+{
+	if (!(data[0] & 0x80)) {
+		return octal2ui(data, len);
+	}
+
+	// The remaining bits of the first byte are the most significant part of the
+	// value.  Anything that doesn't fit in 64 bits is simply dropped.
+	uint64_t value = data[0] & 0x7f;
+	for (size_t i = 1; i < len; i++) {
+		value = (value << 8) | (uint8_t)data[i];
+	}
+
+	return value;
+}
+
+/**
+ * Turns a fixed-size header field, which need not be null-terminated, into a string.
+ * @param data The field.
+ * @param len The length of the field.
+ * @return Returns the contents of the field, up to the first null character.
+ */
+static String field_string(const char *data, size_t len)
+{
+	char *str = new char[len + 1];
+
+	size_t i = 0;
+	while (i < len && data[i] != '\0') {
+		str[i] = data[i];
+		i++;
+	}
+	str[i] = '\0';
+
+	String result(str);
+	delete[] str;
+
+	return result;
+}
+
 // The structure that represents the header block present in
 // TAR files.  A header block occurs before every file, this
 // this structure must EXACTLY match the layout as described
 // in the TAR file format description.
 namespace tarfs {
 	struct posix_header {
-		// TO BE FILLED IN
 		char name[100];
 		char mode[8];
 		char uid[8];
-		char grid[8];
+		char gid[8];
 		char size[12];
 		char mtime[12];
 		char chksum[8];
 		char typeflag;
 		char linkname[100];
 		char magic[6];
-		char version[12];
+		char version[2];
 		char uname[32];
 		char gname[32];
 		char devmajor[8];
 		char devminor[8];
-		char prefix[167];
+		char prefix[155];
+		char pad[12];
 	} __packed;
 }
 
+// Type flags of the headers that describe the header that follows them, rather
+// than a file of their own.
+#define GNU_LONGNAME	'L'
+#define GNU_LONGLINK	'K'
+#define PAX_EXTENDED	'x'
+#define PAX_GLOBAL	'g'
+
+String TarFS::file_name(const uint8_t *buffer) {
+	const struct posix_header *hdr = (const struct posix_header *)buffer;
+	String name = field_string(hdr->name, sizeof(hdr->name));
 
-char* TarFS::file_name(uint8_t *buffer) {
-	char *name = new char[MAX_NAME + 1]; 
-	for (int i = 0; i < MAX_NAME; i++) {
-		name[i] = (char)buffer[i];
+	// ustar archives split long paths across the prefix and name fields
+	if (strncmp(hdr->magic, "ustar", 5) == 0 && hdr->prefix[0] != '\0') {
+		return field_string(hdr->prefix, sizeof(hdr->prefix)) + "/" + name;
 	}
-	name[MAX_NAME] = '\0';
+
 	return name;
 }
 
-unsigned int TarFS::file_size(uint8_t *buffer) {
-	char *size = new char[MAX_SIZE + 1];
-	for (int i = 0; i < MAX_SIZE; i++) {
-		size[i] = (char)buffer[124 + i];
-	}
-	size[MAX_SIZE] = '\0';
-	return octal2ui(size);
+uint64_t TarFS::file_size(const uint8_t *buffer) {
+	const struct posix_header *hdr = (const struct posix_header *)buffer;
+	return parse_number(hdr->size, sizeof(hdr->size));
 }
 
-unsigned int TarFS::next_header(uint8_t *buffer) {
-	unsigned int size = file_size(buffer);
+uint64_t TarFS::next_header(const uint8_t *buffer) {
+	uint64_t size = file_size(buffer);
 	// move to next block if file is empty
 	if (size % BLOCK_SIZE == 0) {
 		return ((size/BLOCK_SIZE) + 1);
 	}
 	return ((size/BLOCK_SIZE) + 2);
 }
+
+/**
+ * Applies the records of a PAX extended header.  Each record has the form
+ * "<length> <keyword>=<value>\n", where the length covers the whole record.
+ * Only the keywords that affect how the archive is laid out are understood.
+ * @param data The contents of the extended header.
+ * @param len The length of the contents.
+ * @param ext Receives any overrides for the next file header.
+ */
+void TarFS::parse_pax_records(const char *data, size_t len, ExtendedHeader& ext)
+{
+	size_t pos = 0;
+	
+	while (pos < len) {
+		size_t record_len = 0, p = pos;
+		while (p < len && data[p] >= '0' && data[p] <= '9') {
+			record_len = (record_len * 10) + (data[p++] - '0');
+		}
+		
+		// stop at anything malformed, rather than trying to resynchronise
+		if (record_len == 0 || pos + record_len > len || p >= len || data[p] != ' ') {
+			break;
+		}
+		
+		const char *keyword = &data[p + 1];
+		const char *end = &data[pos + record_len - 1];
+		const char *equals = keyword;
+		while (equals < end && *equals != '=') {
+			equals++;
+		}
+		
+		if (equals < end) {
+			size_t keyword_len = equals - keyword;
+			const char *value = equals + 1;
+			size_t value_len = end - value;
+			
+			if (keyword_len == 4 && strncmp(keyword, "path", 4) == 0) {
+				ext.name = field_string(value, value_len);
+				ext.has_name = true;
+			} else if (keyword_len == 4 && strncmp(keyword, "size", 4) == 0) {
+				ext.size = 0;
+				for (size_t i = 0; i < value_len && value[i] >= '0' && value[i] <= '9'; i++) {
+					ext.size = (ext.size * 10) + (value[i] - '0');
+				}
+				ext.has_size = true;
+			}
+		}
+		
+		pos += record_len;
+	}
+}
+
+/**
+ * Copies a single block of the archive into the buffer.
+ * @param block The block to read.
+ * @param buffer The buffer to read the block into.
+ * @return Returns TRUE if the block was read, FALSE otherwise.
+ */
+bool TarFS::read_block(uint64_t block, void *buffer)
+{
+	TarFSCache::Page *page = _cache.get(TarFSCache::page_of_block(block));
+	if (!page) {
+		return false;
+	}
+
+	unsigned int offset = (block % TarFSCache::BLOCKS_PER_PAGE) * BLOCK_SIZE;
+	memcpy(buffer, page->data + offset, BLOCK_SIZE);
+
+	_cache.release(page);
+	return true;
+}
+
+/**
+ * Copies a range of bytes from the archive into the buffer.
+ * @param pos The byte offset within the archive to start copying from.
+ * @param buffer The buffer to copy the data into.
+ * @param size The number of bytes to copy.
+ * @return Returns the number of bytes copied, which is only short of 'size' if
+ * part of the range could not be read.
+ */
+size_t TarFS::read_archive(uint64_t pos, void *buffer, size_t size)
+{
+	size_t nbytes = 0;
+	
+	while (nbytes < size) {
+		TarFSCache::Page *page = _cache.get((pos + nbytes) / TarFSCache::PAGE_SIZE);
+		if (!page) {
+			break;
+		}
+		
+		// get the number of bytes to copy from the page
+		size_t remainder = (pos + nbytes) % TarFSCache::PAGE_SIZE;
+		size_t dist = __min(TarFSCache::PAGE_SIZE - remainder, size - nbytes);
+		memcpy((void *)((uintptr_t)buffer + nbytes), page->data + remainder, dist);
+		_cache.release(page);
+		
+		nbytes += dist;
+	}
+	
+	return nbytes;
+}
+
+/**
+ * Writes a range of bytes from the archive straight out to another file, from
+ * the page cache, without copying it into an intermediate buffer first.
+ * @param pos The byte offset within the archive to start sending from.
+ * @param out The file to write the data to.
+ * @param size The number of bytes to send.
+ * @return Returns the number of bytes written, which is short of 'size' if part
+ * of the range could not be read, or the destination accepted fewer bytes.
+ */
+size_t TarFS::send_archive(uint64_t pos, File& out, size_t size)
+{
+	size_t nbytes = 0;
+	
+	while (nbytes < size) {
+		TarFSCache::Page *page = _cache.get((pos + nbytes) / TarFSCache::PAGE_SIZE);
+		if (!page) {
+			break;
+		}
+		
+		// the page stays pinned whilst the destination reads from it
+		size_t remainder = (pos + nbytes) % TarFSCache::PAGE_SIZE;
+		size_t dist = __min(TarFSCache::PAGE_SIZE - remainder, size - nbytes);
+		int written = out.write(page->data + remainder, dist);
+		_cache.release(page);
+		
+		if (written <= 0) {
+			break;
+		}
+		
+		nbytes += written;
 		
+		if ((size_t)written < dist) {
+			break;
+		}
+	}
+	
+	return nbytes;
+}
+
+/**
+ * Produces the contents of /.stats/tarfs, for benchmarks and tuning.
+ */
+size_t TarFS::render_stats(char *buffer, size_t size, void *arg)
+{
+	TarFS *fs = (TarFS *)arg;
+	size_t pos = 0;
+
+	coursework::stats_printf(buffer, size, pos, "device_reads %lu\n", fs->_io.nr_device_reads());
+	coursework::stats_printf(buffer, size, pos, "merged_requests %lu\n", fs->_io.nr_merged_requests());
+	coursework::stats_printf(buffer, size, pos, "cache_hits %lu\n", fs->_cache.nr_hits());
+	coursework::stats_printf(buffer, size, pos, "cache_misses %lu\n", fs->_cache.nr_misses());
+	coursework::stats_printf(buffer, size, pos, "archive_blocks %lu\n", fs->_cache.nr_blocks());
+	coursework::stats_printf(buffer, size, pos, "frames_decompressed %lu\n", fs->_cache.nr_frames_decompressed());
+	coursework::stats_printf(buffer, size, pos, "sendfile_bytes %lu\n", __atomic_load_n(&fs->_nr_sendfile_bytes, __ATOMIC_RELAXED));
+	coursework::stats_printf(buffer, size, pos, "mmap_mappings %lu\n", fs->_mappings.nr_mappings());
+	coursework::stats_printf(buffer, size, pos, "mmap_pinned_pages %u\n", fs->_mappings.nr_pinned());
+
+	return pos;
+}
+
+/**
+ * Handles writes to /.stats/tarfs:
+ *
+ *   sendfile <path> <name>
+ *	Sends the whole of a file in this filesystem to the /.stats file with the
+ *	given name (e.g. "console", or "null" to time the copy on its own), through
+ *	TarFSFile::sendfile().
+ *   map <path> <va> [<offset> <length>]
+ *	Maps a file (or length bytes of it, from offset) read-only at va in the
+ *	writer's address space.  See TarFSMappings.
+ *   unmap <va>
+ *	Removes the writer's mapping at va.
+ */
+int TarFS::control(const char *buffer, size_t size, void *arg)
+{
+	TarFS *fs = (TarFS *)arg;
+
+	// ignore a trailing newline, as left by shell tools
+	size_t len = size;
+	if (len > 0 && buffer[len - 1] == '\n') {
+		len--;
+	}
+
+	if (len >= 4 && strncmp(buffer, "map ", 4) == 0) {
+		return fs->map_control(buffer + 4, len - 4) ? (int)size : -1;
+	}
+
+	if (len >= 6 && strncmp(buffer, "unmap ", 6) == 0) {
+		return fs->unmap_control(buffer + 6, len - 6) ? (int)size : -1;
+	}
+
+	if (len < 9 || strncmp(buffer, "sendfile ", 9) != 0) {
+		return -1;
+	}
+
+	const char *path = buffer + 9;
+	const char *end = buffer + len;
+	const char *space = path;
+	while (space < end && *space != ' ') space++;
+
+	if (space == path || space + 1 >= end) {
+		return -1;
+	}
+
+	if (!fs->send_to_stats(path, space - path, space + 1, end - (space + 1))) {
+		return -1;
+	}
+
+	return size;
+}
+
+/**
+ * Maps a file into the address space of the process that wrote the command,
+ * from "<path> <va> [<offset> <length>]".
+ * @return Returns TRUE if the file was mapped.
+ */
+bool TarFS::map_control(const char *args, size_t len)
+{
+	size_t path_len = 0;
+	while (path_len < len && args[path_len] != ' ') path_len++;
+
+	uint64_t va, offset = 0, length = 0;
+	size_t i = path_len;
+
+	if (!coursework::parse_control_number(args, len, i, va)) {
+		return false;
+	}
+
+	bool whole = coursework::control_at_end(args, len, i);
+	if (!whole && (!coursework::parse_control_number(args, len, i, offset) || !coursework::parse_control_number(args, len, i, length) || !coursework::control_at_end(args, len, i))) {
+		return false;
+	}
+
+	TarFSNode *node = lookup_path(args, path_len);
+	uint64_t data_offset;
+	if (!node || !node->data_offset(data_offset)) {
+		return false;
+	}
+
+	if (whole) {
+		length = node->size();
+	}
+
+	return _mappings.map(Thread::current().owner().vma(), va, data_offset, node->size(), offset, length);
+}
+
+/**
+ * Removes a mapping made by map_control(), from "<va>".
+ * @return Returns TRUE if there was such a mapping.
+ */
+bool TarFS::unmap_control(const char *args, size_t len)
+{
+	uint64_t va;
+	size_t i = 0;
+
+	if (!coursework::parse_control_number(args, len, i, va) || !coursework::control_at_end(args, len, i)) {
+		return false;
+	}
+
+	return _mappings.unmap(Thread::current().owner().vma(), va);
+}
+
+/**
+ * Sends the whole of a file to one of the /.stats files.
+ * @return Returns TRUE if every byte of the file was sent.
+ */
+bool TarFS::send_to_stats(const char *path, size_t path_len, const char *dest, size_t dest_len)
+{
+	char name[64];
+	if (dest_len >= sizeof(name) || !_stats_node) {
+		return false;
+	}
+
+	memcpy(name, dest, dest_len);
+	name[dest_len] = 0;
+
+	TarFSNode *node = lookup_path(path, path_len);
+	PFSNode *dest_node = _stats_node->get_child(String(name));
+	if (!node || !dest_node) {
+		return false;
+	}
+
+	TarFSFile *in = (TarFSFile *)node->open();
+	if (!in) {
+		return false;
+	}
+
+	File *out = dest_node->open();
+	if (!out) {
+		delete in;
+		return false;
+	}
+
+	// Send from (and so advance) the file position, as a sendfile system call
+	// without an offset would, until the end of the file.
+	uint64_t sent = 0;
+	for (;;) {
+		int n = in->sendfile(*out, NULL, in->size() - sent);
+		if (n <= 0) break;
+
+		sent += n;
+	}
+
+	__atomic_add_fetch(&_nr_sendfile_bytes, sent, __ATOMIC_RELAXED);
+
+	bool ok = (sent == in->size());
+
+	out->close();
+	delete out;
+	in->close();
+	delete in;
+
+	return ok;
+}
+
+/**
+ * Finds the node for an absolute path within this filesystem.  The /.stats
+ * directory isn't part of the archive, so paths into it aren't found.
+ * @param path The path, which need not be NUL-terminated.
+ * @param len The length of the path.
+ * @return Returns the node, or NULL if there is no such node.
+ */
+TarFSNode *TarFS::lookup_path(const char *path, size_t len)
+{
+	TarFSNode *node = _root_node;
+	size_t i = 0;
+
+	while (node) {
+		while (i < len && path[i] == '/') i++;
+		if (i == len) break;
+
+		size_t start = i;
+		while (i < len && path[i] != '/') i++;
+
+		char name[256];
+		if (i - start >= sizeof(name)) {
+			return NULL;
+		}
+
+		memcpy(name, path + start, i - start);
+		name[i - start] = 0;
+
+		PFSNode *child = node->get_child(String(name));
+		if (child == _stats_node) {
+			return NULL;
+		}
+
+		node = (TarFSNode *)child;
+	}
+
+	return node;
+}
+
 /**
  * Reads the contents of the file into the buffer, from the specified file offset.
  * @param buffer The buffer to read the data into.
@@ -118,33 +530,104 @@ unsigned int TarFS::next_header(uint8_t *buffer) {
  */
 int TarFSFile::pread(void* buffer, size_t size, off_t off)
 {
-	if (off >= this->size()) return 0;
-	
 	// buffer is a pointer to the buffer that should receive the data.
 	// size is the amount of data to read from the file.
 	// off is the zero-based offset within the file to start reading from.
+	TRACE(TarFS, TarFSPread, off, size);
+
+	uint64_t start;
+	size = prepare_read(off, size, start);
+	if (size == 0) return 0;
 	
-	unsigned int nbytes = 0; // number of bytes read from the file
-	const int block_size = _owner.block_device().block_size();
-	char file_buffer[block_size]; // temporary store for data read from the buffer
+	size_t nbytes = _owner.read_archive(start, buffer, size);
 	
-	while (nbytes < size) {
-		unsigned int j = off/block_size;
-		unsigned int remainder = off % block_size;
-		if (!_owner.block_device().read_blocks(file_buffer, _file_start_block + j, 1)) { 
-			break; 
-		}
-		// get the number of bytes to copy from file_buffer
-		size_t dist = __min(BLOCK_SIZE - remainder, size - nbytes);
-		// Cast pointers to the required argument types for memcpy and copy specified number of bytes
-		memcpy((void *)((uintptr_t)buffer + nbytes), (void *)((uintptr_t)file_buffer + (uintptr_t)remainder), dist);
-		nbytes += dist;
-		off += dist;
+	return nbytes;
+}
+
+/**
+ * Sends the contents of the file straight to another file, without going through
+ * a buffer of the caller's.  The data is written directly out of the TarFS page
+ * cache.
+ * @param out The file to write the data to.
+ * @param off If non-NULL, the offset within the file to start sending from, which
+ * is advanced by the number of bytes sent, and the current file offset is left
+ * alone.  If NULL, the data is sent from (and advances) the current file offset.
+ * @param size The number of bytes to send.
+ * @return Returns the number of bytes sent.
+ */
+int TarFSFile::sendfile(File& out, off_t *off, size_t size)
+{
+	off_t pos;
+	if (off) {
+		pos = *off;
+	} else {
+		pos = claim(size);
+	}
+	
+	size_t claimed = size;
+	
+	uint64_t start;
+	size = prepare_read(pos, size, start);
+	
+	size_t nbytes = size ? _owner.send_archive(start, out, size) : 0;
+	
+	if (off) {
+		*off += nbytes;
+	} else if (nbytes < claimed) {
+		// hand back what wasn't sent, so the next call carries on from there
+		unclaim(pos, claimed, nbytes);
 	}
 	
 	return nbytes;
 }
 
+/**
+ * Clamps a read to the file, and queues up the cache pages that it covers.
+ * @param off The offset within the file to read from.
+ * @param size The number of bytes to read.
+ * @param start Receives the offset within the archive that corresponds to 'off'.
+ * @return Returns the number of bytes that can actually be read.
+ */
+size_t TarFSFile::prepare_read(off_t off, size_t size, uint64_t& start)
+{
+	uint64_t file_size = this->size();
+	if (size == 0 || off < 0 || (uint64_t)off >= file_size) return 0;
+	
+	// don't read past the end of the file, into the next header
+	if (size > file_size - off) {
+		size = file_size - off;
+	}
+	
+	// the number of bytes read is returned as an int, so large reads are
+	// cut short, just like a read that reaches the end of the file
+	if (size > 0x7fffffff) {
+		size = 0x7fffffff;
+	}
+	
+	TarFSCache& cache = _owner.cache();
+	
+	// work out which cache pages cover the requested range of the archive
+	start = (_file_start_block * BLOCK_SIZE) + off;
+	uint64_t first_page = start / TarFSCache::PAGE_SIZE;
+	uint64_t last_page = (start + size - 1) / TarFSCache::PAGE_SIZE;
+	
+	// queue up the whole range at once, so that any misses are merged into as
+	// few device transfers as possible.  If the file is being read sequentially,
+	// also queue up the pages that are likely to be asked for next.
+	// This is only a heuristic, so concurrent readers racing on it is harmless.
+	uint64_t next_page = __atomic_load_n(&_next_page, __ATOMIC_RELAXED);
+	uint64_t end_page = last_page;
+	if (first_page == next_page || first_page == next_page + 1) {
+		uint64_t file_last_page = ((_file_start_block * BLOCK_SIZE) + file_size - 1) / TarFSCache::PAGE_SIZE;
+		end_page = __min(last_page + READAHEAD_PAGES, file_last_page);
+	}
+	cache.prefetch(first_page, end_page - first_page + 1);
+	
+	__atomic_store_n(&_next_page, last_page, __ATOMIC_RELAXED);
+	
+	return size;
+}
+
 /**
  * Reads all the file headers in the TAR file, and builds an in-memory
  * representation.
@@ -152,6 +635,8 @@ int TarFSFile::pread(void* buffer, size_t size, off_t off)
  */
 TarFSNode* TarFS::build_tree()
 {	
+	coursework::BootPhase phase("tarfs.build_tree");
+
 	// Create map to keep track of the nodes
 	// that have been created so far
 	TarFSNodeMap node_map;
@@ -162,33 +647,78 @@ TarFSNode* TarFS::build_tree()
 	// add root node to map
 	node_map.add(String("").get_hash(), root); 
 	
-	auto block_count = block_device().block_count();
+	// a compressed archive is read through its frame index, and from here on
+	// everything works in terms of the uncompressed archive
+	TarFSFrameStore *frames = TarFSFrameStore::probe(_io);
+	if (frames) {
+		_cache.attach_frames(frames);
+	}
+	
+	auto block_count = _cache.nr_blocks();
 	
 	// syslog.messagef(LogLevel::DEBUG, "block_count : %lu", block_count);
 	
 	// read the entire TAR file
 	uint8_t *buffer = new uint8_t[BLOCK_SIZE];
-	block_device().read_blocks(buffer, 0, 1);
+	read_block(0, buffer);
 	
-	unsigned int i = 0;
+	// overrides from GNU and PAX extended headers, which apply to the next
+	// file header in the archive
+	ExtendedHeader ext;
+	
+	uint64_t i = 0;
 	
 	while (i < block_count-2) {	
 		
-		// syslog.messagef(LogLevel::DEBUG, "Value of i is %u", i);
+		// syslog.messagef(LogLevel::DEBUG, "Value of i is %lu", i);
 		
 		if (is_zero_block(buffer)) {
 			i += 1;
-			block_device().read_blocks(buffer, i, 1);
+			read_block(i, buffer);
+			continue;
+		}
+		
+		const struct posix_header *hdr = (const struct posix_header *)buffer;
+		
+		// start fetching the next header now, so that the device can get on with
+		// it whilst this header is turned into nodes
+		uint64_t next = i + next_header(buffer);
+		_cache.prefetch(TarFSCache::page_of_block(next), 1);
+		
+		if (hdr->typeflag == GNU_LONGNAME || hdr->typeflag == GNU_LONGLINK || hdr->typeflag == PAX_EXTENDED || hdr->typeflag == PAX_GLOBAL) {
+			// the contents of an extended header follow it, just like file data
+			uint64_t ext_size = file_size(buffer);
+			char *data = new char[ext_size + 1];
+			size_t n = read_archive((i + 1) * BLOCK_SIZE, data, ext_size);
+			data[n] = '\0';
+			
+			if (hdr->typeflag == GNU_LONGNAME) {
+				ext.name = String(data);
+				ext.has_name = true;
+			} else if (hdr->typeflag == PAX_EXTENDED) {
+				parse_pax_records(data, n, ext);
+			}
+			
+			// long link names and global headers don't change where or how big
+			// files are, so there's nothing to take from them
+			
+			delete[] data;
+			
+			i = next;
+			read_block(i, buffer);
 			continue;
 		}
 		
 		// use the file name to get the full file path
-		char *name = file_name(buffer);
-		syslog.messagef(LogLevel::DEBUG, "File is : %s", name);
+		String name = ext.has_name ? ext.name : file_name(buffer);
+		uint64_t size = ext.has_size ? ext.size : file_size(buffer);
+		ext.reset();
+		
+		KLOG(syslog, DEBUG, "File is : %s", name.c_str());
 		
-		assert(strlen(name) != 0);
+		assert(name.length() != 0);
 		
-		List<String> parts = String(name).split('/', false);
+		List<String> parts = name.split('/', false);
 		List<String> components;
 		String path = "";
 		
@@ -209,7 +739,7 @@ TarFSNode* TarFS::build_tree()
 				if (j == 0) {
 					child = new TarFSNode(root, components.at(j), *this);
 					child->set_block_offset(i); // specify block offset of the node's header
-					child->size(file_size(buffer)); // specify file size of this node
+					child->size(size); // specify file size of this node
 					root->add_child(components.at(j), child);
 				} else {
 					TarFSNode *node = nullptr;
@@ -218,15 +748,20 @@ TarFSNode* TarFS::build_tree()
 					// add child to parent node
 					child = new TarFSNode(node, components.at(j), *this);
 					child->set_block_offset(i); // specify block offset of the node's header
-					child->size(file_size(buffer)); // specify file size of this node
+					child->size(size); // specify file size of this node
 					node->add_child(components.at(j), child);
 				}
 				node_map.add(components.at(j).get_hash(), child);
 			}
 		}
+		
+		// a PAX size overrides the header, and that also moves the next header
+		if (size != file_size(buffer)) {
+			next = i + 1 + ((size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+		}
 			
-		i += next_header(buffer);
-		block_device().read_blocks(buffer, i, 1);		
+		i = next;
+		read_block(i, buffer);
 	}
 	
 	delete buffer;
@@ -236,10 +771,9 @@ TarFSNode* TarFS::build_tree()
 /**
  * Returns the size of this TarFS File
  */
-unsigned int TarFSFile::size() const
+uint64_t TarFSFile::size() const
 {
-	syslog.messagef(LogLevel::DEBUG, "The value of size is %u", octal2ui(_hdr->size));
-	return octal2ui(_hdr->size);
+	return _size;
 }
 
 /* --- YOU DO NOT NEED TO CHANGE ANYTHING BELOW THIS LINE --- */
@@ -250,9 +784,28 @@ unsigned int TarFSFile::size() const
  */
 PFSNode *TarFS::mount()
 {
-	// If the root node has not been generated, then build it.
-	if (_root_node == NULL) {
+	// If the root node has not been generated, then build it.  Only the first
+	// caller builds the tree, and anyone else waits for it to be published.
+	// The tree is never changed after this, so lookups need no locking.
+	unsigned int expected = NotMounted;
+	if (__atomic_compare_exchange_n(&_mount_state, &expected, Mounting, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+		uint64_t start = coursework::rdtsc();
+
 		_root_node = build_tree();
+		_stats_node = new coursework::StatsDirectoryNode(_root_node, *this);
+		__atomic_store_n(&_mount_state, Mounted, __ATOMIC_RELEASE);
+
+		uint64_t end = coursework::rdtsc();
+		TRACE(TarFS, TarFSMount, this, end - start);
+
+		// mounting the root filesystem is the last thing the kernel does before
+		// it starts init, so this is the end of boot
+		coursework::boot_timing.record("tarfs.mount", start, end);
+		coursework::boot_timing.report();
+	} else {
+		while (__atomic_load_n(&_mount_state, __ATOMIC_ACQUIRE) != Mounted) {
+			asm volatile("pause");
+		}
 	}
 
 	// Return the root node.
@@ -262,9 +815,10 @@ PFSNode *TarFS::mount()
 /**
  * Constructs a TarFS File object, given the owning file system and the block
  */
-TarFSFile::TarFSFile(TarFS& owner, unsigned int file_header_block)
+TarFSFile::TarFSFile(TarFS& owner, uint64_t file_header_block, TarFSNode *node)
 : _hdr(NULL),
 _owner(owner),
+_node(node),
 _file_start_block(file_header_block),
 _cur_pos(0)
 {
@@ -272,10 +826,17 @@ _cur_pos(0)
 	_hdr = (struct posix_header *) new char[_owner.block_device().block_size()];
 	
 	// Read the header block into the header structure.
-	_owner.block_device().read_blocks(_hdr, _file_start_block, 1);
+	_owner.read_block(_file_start_block, _hdr);
 	
 	// Increment the starting block for file data.
 	_file_start_block++;
+	
+	// The size was worked out when the archive was mounted, taking extended
+	// headers into account, so prefer that over the header's own size field.
+	_size = _node ? _node->size() : TarFS::file_size((const uint8_t *)_hdr);
+	
+	// A read from the start of the file counts as sequential.
+	_next_page = (_file_start_block * BLOCK_SIZE) / TarFSCache::PAGE_SIZE;
 }
 
 TarFSFile::~TarFSFile()
@@ -305,16 +866,55 @@ int TarFSFile::read(void* buffer, size_t size)
 	// current position indicator, so just delegate actual processing to
 	// pread, and update internal state accordingly.
 
-	// Perform the read from the current file position.
-	int rc = pread(buffer, size, _cur_pos);
+	// The file object may be shared, so claim the range to be read before
+	// reading it.  That way, concurrent readers each get their own part of
+	// the file.
+	off_t pos = claim(size);
+
+	// Perform the read from the claimed file position, and hand back the part
+	// of the range that couldn't be read, so that the next read retries it.
+	int nbytes = pread(buffer, size, pos);
+	if (nbytes >= 0 && (size_t)nbytes < size) {
+		unclaim(pos, size, nbytes);
+	}
+
+	return nbytes;
+}
+
+/**
+ * Claims a range of the file for a read from the current file offset, by
+ * advancing the current position atomically.  The range is clamped to the end
+ * of the file, so the position never moves past it.
+ * @param size The number of bytes wanted, which is updated to the number of bytes
+ * that were claimed.
+ * @return Returns the offset of the start of the claimed range.
+ */
+off_t TarFSFile::claim(size_t& size)
+{
+	uint64_t pos = __atomic_load_n(&_cur_pos, __ATOMIC_RELAXED);
+	uint64_t end;
+	do {
+		uint64_t count = (pos < _size) ? __min((uint64_t)size, _size - pos) : 0;
+		end = pos + __min(count, (uint64_t)0x7fffffff);
+	} while (!__atomic_compare_exchange_n(&_cur_pos, &pos, end, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 
-	// Increment the current file position by the number of bytes that was read.
-	// The number of bytes actually read may be less than 'size', so it's important
-	// we only advance the current position by the actual number of bytes read.
-	_cur_pos += rc;
+	size = end - pos;
+	return pos;
+}
 
-	// Return the number of bytes read.
-	return rc;
+/**
+ * Gives back the end of a claimed range that a read didn't get to, by moving
+ * the current position back to just after the bytes that were read.  If the
+ * position has moved on since (another reader claimed the range after it, or
+ * the file was seeked), it is left alone.
+ * @param pos The start of the claimed range.
+ * @param claimed The number of bytes that were claimed.
+ * @param done The number of bytes that were actually read.
+ */
+void TarFSFile::unclaim(off_t pos, size_t claimed, size_t done)
+{
+	uint64_t expected = pos + claimed;
+	__atomic_compare_exchange_n(&_cur_pos, &expected, (uint64_t)pos + done, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
 }
 
 /**
@@ -330,14 +930,20 @@ void TarFSFile::seek(off_t offset, SeekType type)
 	// If this is an absolute seek, then set the current file position
 	// to the given offset (subject to the file size).  There should
 	// probably be a way to return an error if the offset was out of bounds.
-	if (type == File::SeekAbsolute) {
-		_cur_pos = offset;
-	} else if (type == File::SeekRelative) {
-		_cur_pos += offset;
-	}
-	if (_cur_pos >= size()) {
-		_cur_pos = size() - 1;
-	}
+	uint64_t pos = __atomic_load_n(&_cur_pos, __ATOMIC_RELAXED);
+	uint64_t new_pos;
+	do {
+		if (type == File::SeekAbsolute) {
+			new_pos = offset;
+		} else if (type == File::SeekRelative) {
+			new_pos = pos + offset;
+		} else {
+			new_pos = pos;
+		}
+		if (new_pos >= _size) {
+			new_pos = _size - 1;
+		}
+	} while (!__atomic_compare_exchange_n(&_cur_pos, &pos, new_pos, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 }
 
 TarFSNode::TarFSNode(TarFSNode *parent, const String& name, TarFS& owner) : PFSNode(parent, owner), _name(name), _size(0), _has_block_offset(false), _block_offset(0)
@@ -359,8 +965,10 @@ File* TarFSNode::open()
 		return NULL;
 	}
 
+	TRACE(TarFS, TarFSOpen, this, _block_offset);
+
 	// Create a new file object, with a header from this node's block offset.
-	return new TarFSFile((TarFS&) owner(), _block_offset);
+	return new TarFSFile((TarFS&) owner(), _block_offset, this);
 }
 
 /**
@@ -381,6 +989,12 @@ PFSNode* TarFSNode::get_child(const String& name)
 {
 	TarFSNode *child;
 
+	// The stats directory isn't part of the archive, but appears at the root.
+	TarFS& fs = (TarFS&) owner();
+	if (this == fs._root_node && name == String(".stats")) {
+		return fs.stats_node();
+	}
+
 	// Try to find the given child node in the children map, and return
 	// NULL if it wasn't found.
 	if (!_children.try_get_value(name.get_hash(), child)) {
@@ -407,7 +1021,7 @@ PFSNode* TarFSNode::mkdir(const String& name)
  * that contains the header of the file that this node represents.
  * @param offset The block offset that corresponds to this node.
  */
-void TarFSNode::set_block_offset(unsigned int offset)
+void TarFSNode::set_block_offset(uint64_t offset)
 {
 	_has_block_offset = true;
 	_block_offset = offset;
@@ -443,10 +1057,14 @@ TarFSDirectory::~TarFSDirectory()
 
 bool TarFSDirectory::read_entry(infos::fs::DirectoryEntry& entry)
 {
-	if (_cur_entry < _nr_entries) {
-		entry = _entries[_cur_entry++];
+	unsigned int cur = __atomic_fetch_add(&_cur_entry, 1, __ATOMIC_RELAXED);
+	
+	if (cur < _nr_entries) {
+		entry = _entries[cur];
 		return true;
 	} else {
+		// Don't let the counter wrap round, however many times this is called.
+		__atomic_store_n(&_cur_entry, _nr_entries, __ATOMIC_RELAXED);
 		return false;
 	}
 }
@@ -8,8 +8,6 @@
  */
 #ifndef TARFS_H
 #define TARFS_H
-#define MAX_NAME 100
-#define MAX_SIZE 12
 #define BLOCK_SIZE 512
 
 #include <infos/fs/block-based-filesystem.h>
@@ -23,6 +21,11 @@
 #include <infos/util/map.h>
 #include <infos/util/list.h>
 
+#include "tarfs-bio.h"
+#include "tarfs-cache.h"
+#include "tarfs-mmap.h"
+#include "stats.h"
+
 namespace tarfs {
 
 	class TarFSNode;
@@ -37,7 +40,7 @@ namespace tarfs {
 	public:
 		typedef infos::util::Map<infos::util::String::hash_type, TarFSNode *> TarFSNodeMap;
 		
-		TarFS(infos::drivers::block::BlockDevice& bdev) : BlockBasedFilesystem(bdev), _root_node(NULL) {
+		TarFS(infos::drivers::block::BlockDevice& bdev) : BlockBasedFilesystem(bdev), _mount_state(NotMounted), _root_node(NULL), _stats_node(NULL), _io(bdev), _cache(_io, bdev.block_count()), _mappings(*this), _nr_sendfile_bytes(0), _stats("tarfs", render_stats, control, this) {
 		}
 
 		infos::fs::PFSNode *mount() override;
@@ -46,20 +49,69 @@ namespace tarfs {
 			return "tarfs";
 		}
 		
-		/* Returns the name of the file using the name
-		field of the specified buffer */
-		static char* file_name(uint8_t *buffer);
+		/* Returns the name of the file using the name (and, for ustar
+		archives, prefix) fields of the specified buffer */
+		static infos::util::String file_name(const uint8_t *buffer);
 		
 		/* Returns the size (in bytes) of the file using 
 		data from the size field of the specified buffer */
-		static unsigned int file_size(uint8_t *buffer);
+		static uint64_t file_size(const uint8_t *buffer);
 		
 		/*Returns the block offset of the header of the next node after
 		the specified node */
-		static unsigned int next_header(uint8_t *buffer);
+		static uint64_t next_header(const uint8_t *buffer);
+		
+		/* Copies a single block of the archive into the specified buffer,
+		going through the page cache */
+		bool read_block(uint64_t block, void *buffer);
 		
+		/* Copies an arbitrary byte range of the archive into the specified
+		buffer, going through the page cache.  Returns the number of bytes copied */
+		size_t read_archive(uint64_t pos, void *buffer, size_t size);
+		
+		/* Writes an arbitrary byte range of the archive to another file, straight
+		from the page cache.  Returns the number of bytes written */
+		size_t send_archive(uint64_t pos, infos::fs::File& out, size_t size);
+
+		/* Returns the node for an absolute path within this filesystem, or NULL if
+		there isn't one */
+		TarFSNode *lookup_path(const char *path, size_t len);
+
+		/* Returns the /.stats directory, which hangs off the root of this filesystem */
+		infos::fs::PFSNode *stats_node() const {
+			return _stats_node;
+		}
+
+		BlockIOQueue& io() {
+			return _io;
+		}
+
+		TarFSCache& cache() {
+			return _cache;
+		}
+
 	private:
+		/* Overrides for the next file header, collected from GNU long
+		name and PAX extended headers */
+		struct ExtendedHeader {
+			ExtendedHeader() {
+				reset();
+			}
+
+			void reset() {
+				name = "";
+				size = 0;
+				has_name = has_size = false;
+			}
+
+			infos::util::String name;
+			uint64_t size;
+			bool has_name, has_size;
+		};
+
 		TarFSNode *build_tree();
+
+		static void parse_pax_records(const char *data, size_t len, ExtendedHeader& ext);
 		
 		static bool is_zero_block(const uint8_t *buffer, size_t size = 512) {
 			for (unsigned int i = 0; i < size; i++) {
@@ -69,19 +121,43 @@ namespace tarfs {
 			return true;
 		}
 
+		enum MountState { NotMounted, Mounting, Mounted };
+
+		static size_t render_stats(char *buffer, size_t size, void *arg);
+		static int control(const char *buffer, size_t size, void *arg);
+
+		bool send_to_stats(const char *path, size_t path_len, const char *dest, size_t dest_len);
+		bool map_control(const char *args, size_t len);
+		bool unmap_control(const char *args, size_t len);
+
+		unsigned int _mount_state;
 		TarFSNode *_root_node;
+		coursework::StatsDirectoryNode *_stats_node;
+
+		BlockIOQueue _io;
+		TarFSCache _cache;
+		TarFSMappings _mappings;
+
+		uint64_t _nr_sendfile_bytes;
+		coursework::StatsEntry _stats;
 	};
 
 	class TarFSFile : public infos::fs::File {
 	public:
+		/* The number of pages read ahead of a sequential reader */
+		static const unsigned int READAHEAD_PAGES = 8;
 
-		TarFSFile(TarFS& owner, unsigned int file_header_block);
+		TarFSFile(TarFS& owner, uint64_t file_header_block, TarFSNode *node = NULL);
 		virtual ~TarFSFile();
 
 		void close() override;
 
 		int read(void* buffer, size_t size) override;
 		int pread(void* buffer, size_t size, off_t off) override;
+		
+		/* Copies part of this file to another file, straight from the page cache.
+		If off is NULL, the current file position is used and advanced */
+		int sendfile(infos::fs::File& out, off_t *off, size_t size);
 
 		int write(const void* buffer, size_t size) override {
 			// DO NOT IMPLEMENT
@@ -90,13 +166,21 @@ namespace tarfs {
 
 		void seek(off_t offset, SeekType type) override;
 		
-		unsigned int size() const;
+		uint64_t size() const;
 
 	private:
+		off_t claim(size_t& size);
+		void unclaim(off_t pos, size_t claimed, size_t done);
+		size_t prepare_read(off_t off, size_t size, uint64_t& start);
+
 		struct posix_header *_hdr;
 
 		TarFS& _owner;
-		unsigned int _file_start_block, _cur_pos;
+		TarFSNode *_node;
+		uint64_t _file_start_block, _cur_pos, _size;
+
+		/* The cache page at which the last read finished, used to spot sequential readers */
+		uint64_t _next_page;
 	};
 
 	class TarFSDirectory : public infos::fs::Directory {
@@ -126,7 +210,18 @@ namespace tarfs {
 
 		PFSNode* mkdir(const infos::util::String& name) override;
 
-		void set_block_offset(unsigned int offset);
+		void set_block_offset(uint64_t offset);
+
+		/* Returns TRUE if this node is a file, and sets where its data starts in
+		the archive */
+		bool data_offset(uint64_t& offset) const {
+			if (!_has_block_offset) {
+				return false;
+			}
+
+			offset = (_block_offset + 1) * BLOCK_SIZE;
+			return true;
+		}
 
 		void add_child(const infos::util::String& name, TarFSNode *child);
 
@@ -138,20 +233,20 @@ namespace tarfs {
 			return _name;
 		}
 
-		unsigned int size() const {
+		uint64_t size() const {
 			return _size;
 		}
 
-		void size(unsigned int size) {
+		void size(uint64_t size) {
 			_size = size;
 		}
 
 	private:
 		TarFSNodeMap _children;
 		const infos::util::String _name;
-		unsigned int _size;
+		uint64_t _size;
 		bool _has_block_offset;
-		unsigned int _block_offset;
+		uint64_t _block_offset;
 	};
 }
 
@@ -0,0 +1,53 @@
+/*
+ * Shared Time Page Layout
+ *
+ * Included by both the kernel and user programs, so it must stay plain C.
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_TIME_PAGE_ABI_H
+#define COURSEWORK_TIME_PAGE_ABI_H
+
+/* Where the time page is mapped, read-only, in a process that asks for it */
+#define TIME_PAGE_VA		0x00007fff00000000ULL
+
+/* The value of magic once the page holds a calibrated clock */
+#define TIME_PAGE_MAGIC		0x454d4954
+
+/**
+ * The kernel's clock, as published to user programs.  A reader takes the time
+ * from the TSC with no kernel entry:
+ *
+ *	elapsed_ns = ((rdtsc() - tsc_base) * tsc_mult) >> 32
+ *	monotonic_ns = monotonic_base_ns + elapsed_ns
+ *	wall_ns = wall_base_ns + elapsed_ns
+ *
+ * where the multiplication is 128-bit, and a TSC value below tsc_base (from a
+ * CPU whose TSC is slightly behind) counts as no time at all.  The kernel changes the page under a
+ * sequence counter: sequence is odd while an update is in progress, so a reader
+ * copies the fields it needs, and starts again if sequence was odd or has
+ * changed since it started.
+ */
+struct time_page {
+	uint32_t magic;
+	uint32_t sequence;
+
+	// The TSC value that both clocks count from.
+	uint64_t tsc_base;
+
+	// Nanoseconds per TSC cycle, as a 32.32 fixed-point number.
+	uint64_t tsc_mult;
+
+	// The TSC frequency, in Hz.
+	uint64_t tsc_hz;
+
+	// The monotonic clock at tsc_base, in nanoseconds.
+	uint64_t monotonic_base_ns;
+
+	// The wall-clock time at tsc_base, in nanoseconds since 1970.
+	uint64_t wall_base_ns;
+};
+
+#endif /* COURSEWORK_TIME_PAGE_ABI_H */
@@ -0,0 +1,172 @@
+/*
+ * Shared Time Page
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "time-page.h"
+#include "cmdline-util.h"
+#include "tsc-clock.h"
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/process.h>
+#include <infos/kernel/thread.h>
+#include <infos/mm/mm.h>
+
+using namespace infos::kernel;
+using namespace infos::mm;
+using namespace coursework;
+
+#define PAGE_SIZE	0x1000
+
+TimePage coursework::time_page;
+
+TimePage::TimePage()
+: _pgd(NULL),
+_page(NULL),
+_nr_mappings(0),
+_nr_updates(0),
+_stats("timepage", read_stats, write_stats, this)
+{
+	memset(&_params, 0, sizeof(_params));
+}
+
+/**
+ * Copies the published parameters to the page, using the sequence counter in the
+ * page itself.  Must be called with the lock held.
+ */
+void TimePage::write_page()
+{
+	if (!_page) {
+		return;
+	}
+
+	__atomic_store_n(&_page->sequence, _page->sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	_page->magic = _params.magic;
+	_page->tsc_base = _params.tsc_base;
+	_page->tsc_mult = _params.tsc_mult;
+	_page->tsc_hz = _params.tsc_hz;
+	_page->monotonic_base_ns = _params.monotonic_base_ns;
+	_page->wall_base_ns = _params.wall_base_ns;
+
+	__atomic_store_n(&_page->sequence, _page->sequence + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Called by the TSC clock whenever its parameters change: when it is
+ * calibrated, when the frequency is refined, and when the wall clock is stepped.
+ */
+void TimePage::publish(uint64_t tsc_base, uint64_t tsc_mult, uint64_t tsc_hz, uint64_t monotonic_base_ns, uint64_t wall_base_ns)
+{
+	UniqueIRQSpinLock l(_lock);
+
+	_params.magic = TIME_PAGE_MAGIC;
+	_params.tsc_base = tsc_base;
+	_params.tsc_mult = tsc_mult;
+	_params.tsc_hz = tsc_hz;
+	_params.monotonic_base_ns = monotonic_base_ns;
+	_params.wall_base_ns = wall_base_ns;
+
+	write_page();
+	_nr_updates++;
+}
+
+/**
+ * Allocates the page, the first time it is needed.
+ * @return Returns TRUE if the page is available, FALSE otherwise.
+ */
+bool TimePage::ensure_allocated()
+{
+	{
+		UniqueIRQSpinLock l(_lock);
+		if (_pgd) {
+			return true;
+		}
+	}
+
+	PageDescriptor *pgd = sys.mm().pgalloc().alloc_pages(0);
+	if (!pgd) {
+		return false;
+	}
+
+	volatile struct time_page *page = (volatile struct time_page *)sys.mm().pgalloc().pgd_to_vpa(pgd);
+	memset((void *)page, 0, PAGE_SIZE);
+
+	{
+		UniqueIRQSpinLock l(_lock);
+
+		// Somebody else may have allocated it in the meantime, in which case
+		// theirs wins.
+		if (!_pgd) {
+			_pgd = pgd;
+			_page = page;
+			pgd = NULL;
+
+			write_page();
+		}
+	}
+
+	if (pgd) {
+		sys.mm().pgalloc().free_pages(pgd, 0);
+	}
+
+	return true;
+}
+
+/**
+ * Maps the page read-only into an address space, at TIME_PAGE_VA.
+ * @param vma The address space of the process that asked for it.
+ * @return Returns TRUE if the page was mapped, FALSE otherwise, including if
+ * something (which may be the page itself) is already mapped there.
+ */
+bool TimePage::map_into(VMA& vma)
+{
+	// calibrate the clock before the first process can read the page
+	tsc_clock.frequency();
+
+	if (!ensure_allocated()) {
+		syslog.messagef(LogLevel::ERROR, "timepage: unable to allocate the time page");
+		return false;
+	}
+
+	if (vma.is_mapped(TIME_PAGE_VA)) {
+		return false;
+	}
+
+	phys_addr_t pa = sys.mm().pgalloc().pgd_to_pba(_pgd);
+	vma.insert_mapping(TIME_PAGE_VA, pa, (MappingFlags::MappingFlags)(MappingFlags::Present | MappingFlags::User));
+
+	__atomic_fetch_add(&_nr_mappings, 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+size_t TimePage::read_stats(char *buffer, size_t size, void *arg)
+{
+	TimePage *page = (TimePage *)arg;
+	size_t pos = 0;
+
+	stats_printf(buffer, size, pos, "va %p\n", (void *)TIME_PAGE_VA);
+	stats_printf(buffer, size, pos, "mapped %lu\n", page->_nr_mappings);
+	stats_printf(buffer, size, pos, "updates %lu\n", page->_nr_updates);
+
+	return pos;
+}
+
+/**
+ * Handles "map", which maps the page into the address space of the process
+ * that wrote it.
+ */
+int TimePage::write_stats(const char *buffer, size_t size, void *arg)
+{
+	TimePage *page = (TimePage *)arg;
+
+	if (size >= 3 && strncmp(buffer, "map", 3) == 0 && control_at_end(buffer, size, 3)) {
+		return page->map_into(Thread::current().owner().vma()) ? (int)size : -1;
+	}
+
+	return -1;
+}
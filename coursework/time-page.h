@@ -0,0 +1,65 @@
+/*
+ * Shared Time Page Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_TIME_PAGE_H
+#define COURSEWORK_TIME_PAGE_H
+
+#include <infos/mm/page-allocator.h>
+#include <infos/mm/vma.h>
+
+#include "spinlock.h"
+#include "stats.h"
+#include "time-page-abi.h"
+
+namespace coursework {
+
+	/**
+	 * A page holding the TSC clock's parameters, mapped read-only at
+	 * TIME_PAGE_VA, so that user programs can read the time without a system
+	 * call.  Processes are created in the infos submodule, so rather than every
+	 * process getting the page, a process asks for it once by writing "map" to
+	 * /.stats/timepage, which maps it into the writer's address space.  The page
+	 * is allocated when it is first asked for; the clock publishes every change
+	 * to its parameters, which the page picks up from then on.  Reading
+	 * /.stats/timepage gives how many times it has been mapped.
+	 */
+	class TimePage {
+	public:
+		TimePage();
+
+		/* Maps the page read-only into an address space, unless something is
+		mapped there already */
+		bool map_into(infos::mm::VMA& vma);
+
+		/* Replaces the clock parameters on the page */
+		void publish(uint64_t tsc_base, uint64_t tsc_mult, uint64_t tsc_hz, uint64_t monotonic_base_ns, uint64_t wall_base_ns);
+
+	private:
+		bool ensure_allocated();
+		void write_page();
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+		static int write_stats(const char *buffer, size_t size, void *arg);
+
+		SpinLock _lock;
+
+		// The parameters, as last published, which are copied to the page when it
+		// is allocated.
+		struct time_page _params;
+
+		infos::mm::PageDescriptor *_pgd;
+		volatile struct time_page *_page;
+
+		uint64_t _nr_mappings, _nr_updates;
+
+		StatsEntry _stats;
+	};
+
+	extern TimePage time_page;
+}
+
+#endif /* COURSEWORK_TIME_PAGE_H */
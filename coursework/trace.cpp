@@ -0,0 +1,259 @@
+/*
+ * Event Tracing
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "trace.h"
+#include "percpu-sched.h"
+#include "stats.h"
+#include <infos/kernel/cmdline.h>
+
+using namespace infos::kernel;
+using namespace coursework;
+
+#define NR_CPU_SLOTS	16
+#define NR_RECORDS	2048
+
+/**
+ * One event, as it is stored and as it is drained: the trace format is these 32
+ * bytes, little-endian, in hex.  seq is the low 32 bits of the record's position
+ * in its buffer, plus one, and is zero while the record is being written.
+ */
+struct TraceRecord {
+	uint64_t tsc;
+	uint32_t seq;
+	uint32_t event;
+	uint64_t arg1, arg2;
+};
+
+/**
+ * A ring of records for one CPU, which keeps the most recent NR_RECORDS events.
+ * Space is claimed with an atomic increment, so an interrupt that traces on the
+ * same CPU part-way through another event just takes the next slot.
+ */
+struct TraceBuffer {
+	uint64_t head;
+
+	// How far the buffer has been drained, and how many events were overwritten
+	// before they could be.
+	uint64_t tail, nr_lost;
+
+	TraceRecord records[NR_RECORDS];
+} __attribute__((aligned(64)));
+
+// The buffers are static, as tracing can start before there is a heap, and the
+// page allocator is one of the things being traced.
+static TraceBuffer buffers[NR_CPU_SLOTS];
+
+unsigned int coursework::trace_categories;
+
+static const char *event_names[TraceEvent::NR_EVENTS] = {
+	"none",
+	"pgalloc.alloc", "pgalloc.free", "pgalloc.split", "pgalloc.merge",
+	"sched.enqueue", "sched.dequeue", "sched.pick",
+	"tarfs.mount", "tarfs.open", "tarfs.pread", "tarfs.block_read",
+};
+
+static const struct {
+	const char *name;
+	unsigned int category;
+} category_names[] = {
+	{ "pgalloc", TraceCategory::PageAlloc },
+	{ "sched", TraceCategory::Sched },
+	{ "tarfs", TraceCategory::TarFS },
+	{ "all", TraceCategory::All },
+};
+
+/**
+ * Parses a comma- or space-separated list of category names.
+ * @return Returns the categories, or zero if any name is unknown.
+ */
+static unsigned int parse_categories(const char *text, size_t size)
+{
+	unsigned int categories = 0;
+
+	size_t i = 0;
+	while (i < size && text[i] && text[i] != '\n') {
+		size_t start = i;
+		while (i < size && text[i] && text[i] != ',' && text[i] != ' ' && text[i] != '\n') i++;
+
+		size_t len = i - start;
+		if (len) {
+			unsigned int found = 0;
+			for (unsigned int c = 0; c < sizeof(category_names) / sizeof(category_names[0]); c++) {
+				if (strlen(category_names[c].name) == len && strncmp(category_names[c].name, &text[start], len) == 0) {
+					found = category_names[c].category;
+				}
+			}
+
+			if (!found) {
+				return 0;
+			}
+
+			categories |= found;
+		}
+
+		if (i < size && (text[i] == ',' || text[i] == ' ')) i++;
+	}
+
+	return categories;
+}
+
+RegisterCmdLineArgument(Trace, "trace")
+{
+	trace_categories = parse_categories(value, strlen(value));
+}
+
+void coursework::trace_record(unsigned int event, uint64_t arg1, uint64_t arg2)
+{
+	// One rdtscp gives both the time and the CPU, where the CPU has it.
+	uint64_t tsc;
+	unsigned int cpu = current_cpu_tsc(tsc);
+
+	TraceBuffer& buffer = buffers[cpu % NR_CPU_SLOTS];
+	uint64_t index = __atomic_fetch_add(&buffer.head, 1, __ATOMIC_RELAXED);
+
+	TraceRecord& record = buffer.records[index % NR_RECORDS];
+
+	__atomic_store_n(&record.seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	record.tsc = tsc;
+	record.event = event;
+	record.arg1 = arg1;
+	record.arg2 = arg2;
+
+	__atomic_store_n(&record.seq, (uint32_t)(index + 1), __ATOMIC_RELEASE);
+}
+
+static void console_write_hex(const void *data, size_t size)
+{
+	static const char digits[] = "0123456789abcdef";
+	const uint8_t *bytes = (const uint8_t *)data;
+
+	for (size_t i = 0; i < size; i++) {
+		char hex[2] = { digits[bytes[i] >> 4], digits[bytes[i] & 0xf] };
+		console_write(hex, sizeof(hex));
+	}
+}
+
+/**
+ * Writes out every event recorded since the last drain, one CPU at a time, as
+ *
+ *	TRACE <cpu> <record in hex>
+ *
+ * lines, between a header that names the events and a footer with the number
+ * of events that were lost.  tools/trace-decode.py turns this back into events.
+ * Tracing can carry on meanwhile: records being overwritten as they are read
+ * are counted as lost.
+ */
+void coursework::trace_drain()
+{
+	char line[96];
+	size_t pos = 0;
+
+	stats_printf(line, sizeof(line), pos, "TRACE begin records=%u\n", NR_RECORDS);
+	console_write(line, pos);
+
+	for (unsigned int i = 1; i < TraceEvent::NR_EVENTS; i++) {
+		pos = 0;
+		stats_printf(line, sizeof(line), pos, "TRACE event %u %s\n", i, event_names[i]);
+		console_write(line, pos);
+	}
+
+	uint64_t total = 0, lost = 0;
+
+	for (unsigned int cpu = 0; cpu < NR_CPU_SLOTS; cpu++) {
+		TraceBuffer& buffer = buffers[cpu];
+		uint64_t head = __atomic_load_n(&buffer.head, __ATOMIC_ACQUIRE);
+
+		// anything older than a whole buffer ago has been overwritten
+		uint64_t start = buffer.tail;
+		if (head - start > NR_RECORDS) {
+			buffer.nr_lost += (head - NR_RECORDS) - start;
+			start = head - NR_RECORDS;
+		}
+
+		for (uint64_t index = start; index < head; index++) {
+			const TraceRecord& slot = buffer.records[index % NR_RECORDS];
+
+			uint32_t seq = __atomic_load_n(&slot.seq, __ATOMIC_ACQUIRE);
+			TraceRecord record = slot;
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			if (seq != (uint32_t)(index + 1) || __atomic_load_n(&slot.seq, __ATOMIC_RELAXED) != seq) {
+				buffer.nr_lost++;
+				continue;
+			}
+
+			pos = 0;
+			stats_printf(line, sizeof(line), pos, "TRACE %u ", cpu);
+			console_write(line, pos);
+			console_write_hex(&record, sizeof(record));
+			console_write("\n", 1);
+
+			total++;
+		}
+
+		buffer.tail = head;
+		lost += buffer.nr_lost;
+	}
+
+	pos = 0;
+	stats_printf(line, sizeof(line), pos, "TRACE end records=%lu lost=%lu\n", total, lost);
+	console_write(line, pos);
+}
+
+static size_t read_stats(char *buffer, size_t size, void *arg)
+{
+	size_t pos = 0;
+
+	stats_printf(buffer, size, pos, "categories");
+	for (unsigned int c = 0; c < sizeof(category_names) / sizeof(category_names[0]) - 1; c++) {
+		if (trace_categories & category_names[c].category) {
+			stats_printf(buffer, size, pos, " %s", category_names[c].name);
+		}
+	}
+	stats_printf(buffer, size, pos, "\n");
+
+	for (unsigned int cpu = 0; cpu < NR_CPU_SLOTS; cpu++) {
+		const TraceBuffer& trace = buffers[cpu];
+		if (trace.head) {
+			stats_printf(buffer, size, pos, "cpu%u events %lu drained %lu lost %lu\n", cpu, trace.head, trace.tail, trace.nr_lost);
+		}
+	}
+
+	return pos;
+}
+
+/**
+ * Accepts "enable <categories>", "disable <categories>" and "drain".
+ */
+static int write_stats(const char *buffer, size_t size, void *arg)
+{
+	if (size > 7 && strncmp(buffer, "enable ", 7) == 0) {
+		unsigned int categories = parse_categories(buffer + 7, size - 7);
+		if (!categories) {
+			return -1;
+		}
+
+		__atomic_fetch_or(&trace_categories, categories, __ATOMIC_RELAXED);
+	} else if (size > 8 && strncmp(buffer, "disable ", 8) == 0) {
+		unsigned int categories = parse_categories(buffer + 8, size - 8);
+		if (!categories) {
+			return -1;
+		}
+
+		__atomic_fetch_and(&trace_categories, ~categories, __ATOMIC_RELAXED);
+	} else if (size >= 5 && strncmp(buffer, "drain", 5) == 0) {
+		trace_drain();
+	} else {
+		return -1;
+	}
+
+	return size;
+}
+
+static StatsEntry trace_entry("trace", read_stats, write_stats);
@@ -0,0 +1,65 @@
+/*
+ * Event Tracing Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_TRACE_H
+#define COURSEWORK_TRACE_H
+
+#include <infos/define.h>
+
+namespace coursework {
+
+	namespace TraceCategory {
+		enum TraceCategory {
+			PageAlloc = 1,
+			Sched = 2,
+			TarFS = 4,
+			All = 7,
+		};
+	}
+
+	/* Every event, with what its two arguments are.  Event numbers are part of
+	the trace format, so new events go at the end */
+	namespace TraceEvent {
+		enum TraceEvent {
+			None = 0,
+			PageAlloc,		// pfn, order
+			PageFree,		// pfn, order
+			PageSplit,		// pfn, order split from
+			PageMerge,		// pfn, order merged from
+			SchedEnqueue,		// entity, 0
+			SchedDequeue,		// entity, 0
+			SchedPick,		// entity, cpu
+			TarFSMount,		// filesystem, cycles taken
+			TarFSOpen,		// node, header block
+			TarFSPread,		// offset, size
+			TarFSBlockRead,		// first block, number of blocks
+			NR_EVENTS
+		};
+	}
+
+	/* The categories being traced.  Only tracepoints read this */
+	extern unsigned int trace_categories;
+
+	/* Records an event in the calling CPU's trace buffer.  Use TRACE() instead */
+	void trace_record(unsigned int event, uint64_t arg1, uint64_t arg2);
+
+	/* Writes every buffered event to the debug console, and empties the buffers */
+	void trace_drain();
+}
+
+/**
+ * A tracepoint.  While its category is off, this is a load and a branch that is
+ * predicted not taken, and the arguments aren't evaluated.
+ */
+#define TRACE(category, event, arg1, arg2) \
+	do { \
+		if (__builtin_expect(coursework::trace_categories & coursework::TraceCategory::category, 0)) { \
+			coursework::trace_record(coursework::TraceEvent::event, (uint64_t)(arg1), (uint64_t)(arg2)); \
+		} \
+	} while (0)
+
+#endif /* COURSEWORK_TRACE_H */
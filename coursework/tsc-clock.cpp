@@ -0,0 +1,547 @@
+/*
+ * TSC Clock Source
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include "tsc-clock.h"
+#include "boot-timing.h"
+#include "cmdline-util.h"
+#include "cmos.h"
+#include "time-page.h"
+#include "tsc.h"
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/log.h>
+#include <infos/kernel/cmdline.h>
+#include <infos/util/lock.h>
+#include <arch/x86/pio.h>
+
+using namespace infos::kernel;
+using namespace infos::drivers::timer;
+using namespace coursework;
+
+#define NSEC_PER_SEC	1000000000ULL
+
+// How many seconds of the RTC's update-ended interrupts the frequency is
+// measured over, after the quick calibration at boot.
+static uint64_t clock_calibrate_s = 16;
+
+// How often the wall clock is checked against the RTC, in seconds.
+static uint64_t clock_resync_s = 64;
+
+// How many times to poll the RTC for a second boundary before giving up on it.
+// Each poll is a pair of port accesses, which take at least a microsecond.
+#define MAX_BOUNDARY_POLLS	10000000
+
+// How late the RTC's update-ended interrupt can be handled, in nanoseconds.
+#define RTC_IRQ_SLACK_NS	1000000ULL
+
+// The PIT's input clock, and how long the TSC is measured against its channel 2
+// at boot, which its 16-bit counter limits to 54 ms.
+#define PIT_HZ			1193182ULL
+#define PIT_CALIBRATE_MS	50
+
+#define PIT_CHANNEL2		0x42
+#define PIT_COMMAND		0x43
+
+// Port 0x61: bit 0 gates channel 2, bit 1 connects it to the speaker, and bit 5
+// reads its output.
+#define PIT_GATE_PORT		0x61
+#define PIT_GATE2		0x01
+#define PIT_SPEAKER		0x02
+#define PIT_OUT2		0x20
+
+// Channel 2, low then high byte of the count, mode 0 (output goes high when the
+// count reaches zero), binary.
+#define PIT_CHANNEL2_ONESHOT	0xb0
+
+// How far (in parts per thousand) the frequency measured from the interrupts
+// can be from the first estimate before it is taken as a sign that the RTC was
+// set part-way through, and the measurement starts again.
+#define MAX_REFINE_ERROR	10
+
+RegisterCmdLineArgument(ClockCalibrate, "clock.calibrate")
+{
+	uint64_t seconds = parse_cmdline_number(value);
+	if (seconds > 0) {
+		clock_calibrate_s = seconds;
+	}
+}
+
+RegisterCmdLineArgument(ClockResync, "clock.resync")
+{
+	uint64_t seconds = parse_cmdline_number(value);
+	if (seconds > 0) {
+		clock_resync_s = seconds;
+	}
+}
+
+SpinLock coursework::cmos_lock;
+TSCClock coursework::tsc_clock;
+
+TSCClock::TSCClock()
+: _state(Uncalibrated),
+_hz(0),
+_mult(0),
+_source(NoSource),
+_base_tsc(0),
+_mono_base(0),
+_wall_base(0),
+_ref_tsc(0),
+_ref_seconds(0),
+_next_resync(0),
+_nr_resyncs(0),
+_nr_corrections(0),
+_nr_refinements(0),
+_last_correction(0),
+_stats("clock", read_stats, NULL, this)
+{
+}
+
+/**
+ * Reads the TSC frequency from cpuid leaf 0x15, which gives the ratio of the
+ * TSC to the core crystal clock, and (on some CPUs) the crystal's frequency.
+ * @return Returns the frequency in Hz, or zero if the CPU doesn't say.
+ */
+static uint64_t cpuid_frequency()
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(0, eax, ebx, ecx, edx);
+	if (eax < 0x15) {
+		return 0;
+	}
+
+	cpuid(0x15, eax, ebx, ecx, edx);
+	if (!eax || !ebx || !ecx) {
+		return 0;
+	}
+
+	return ((uint64_t)ecx * ebx) / eax;
+}
+
+/**
+ * Measures the TSC against a one-shot count on the PIT's channel 2, which has
+ * a fixed, known input clock.  Interrupts are disabled for the 50 ms this
+ * takes, so that none lands between the count ending and the TSC being read.
+ * @return Returns the frequency in Hz, or zero if the count never ended.
+ */
+static uint64_t pit_frequency()
+{
+	using namespace infos::arch::x86;
+
+	const uint64_t count = (PIT_HZ * PIT_CALIBRATE_MS) / 1000;
+
+	infos::util::UniqueIRQLock l;
+
+	__outb(PIT_GATE_PORT, (__inb(PIT_GATE_PORT) & ~PIT_SPEAKER) | PIT_GATE2);
+
+	__outb(PIT_COMMAND, PIT_CHANNEL2_ONESHOT);
+	__outb(PIT_CHANNEL2, count & 0xff);
+	__outb(PIT_CHANNEL2, count >> 8);
+
+	// the count starts as soon as its high byte is written
+	uint64_t start = rdtsc();
+
+	unsigned int polls = 0;
+	while (!(__inb(PIT_GATE_PORT) & PIT_OUT2)) {
+		if (++polls == MAX_BOUNDARY_POLLS) return 0;
+	}
+
+	uint64_t end = rdtsc();
+
+	return ((end - start) * PIT_HZ) / count;
+}
+
+/**
+ * Waits for the RTC to start a new second, which is when its update-in-progress
+ * flag clears.
+ * @return Returns the TSC at the boundary, or zero if the RTC never updated.
+ */
+static uint64_t wait_for_second()
+{
+	unsigned int polls = 0;
+
+	while (!cmos_update_in_progress()) {
+		if (++polls == MAX_BOUNDARY_POLLS) return 0;
+	}
+
+	while (cmos_update_in_progress()) {
+		if (++polls == MAX_BOUNDARY_POLLS) return 0;
+	}
+
+	return rdtsc();
+}
+
+/**
+ * Measures the TSC over a whole RTC second, which takes up to two seconds, so
+ * is only done if there's no PIT to measure it against.
+ * @return Returns the frequency in Hz, or zero if the RTC never updated.
+ */
+static uint64_t rtc_frequency()
+{
+	uint64_t start = wait_for_second();
+	uint64_t end = start ? wait_for_second() : 0;
+
+	return (start && end > start) ? end - start : 0;
+}
+
+/**
+ * Calibrates the clock, unless it already has been.  Only one caller does the
+ * work, and any others wait for it.
+ */
+void TSCClock::ensure_calibrated()
+{
+	State state = __atomic_load_n(&_state, __ATOMIC_ACQUIRE);
+	if (state == Calibrated || state == Failed) {
+		return;
+	}
+
+	if (state == Uncalibrated && __atomic_compare_exchange_n(&_state, &state, Calibrating, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		calibrate();
+		return;
+	}
+
+	while (__atomic_load_n(&_state, __ATOMIC_ACQUIRE) == Calibrating) {
+		asm volatile("pause");
+	}
+}
+
+/**
+ * Finds the TSC frequency in the quickest way the machine allows, and starts
+ * both clocks from now.  The update-ended interrupts refine it later.
+ */
+void TSCClock::calibrate()
+{
+	BootPhase phase("clock.calibrate");
+
+	Source source = CPUIDSource;
+	uint64_t hz = cpuid_frequency();
+
+	if (!hz) {
+		source = PITSource;
+		hz = pit_frequency();
+	}
+
+	if (!hz) {
+		source = RTCSource;
+		hz = rtc_frequency();
+	}
+
+	if (!hz) {
+		syslog.messagef(LogLevel::ERROR, "clock: the TSC can't be calibrated");
+		__atomic_store_n(&_state, Failed, __ATOMIC_RELEASE);
+		return;
+	}
+
+	RTCTimePoint tp;
+	cmos_read_timepoint(tp);
+	uint64_t tsc = rdtsc();
+
+	{
+		UniqueIRQSpinLock l(_lock);
+
+		_seq.write_begin();
+		set_frequency(hz, source);
+		_base_tsc = tsc;
+		_mono_base = 0;
+		_wall_base = from_timepoint(tp) * NSEC_PER_SEC;
+		_seq.write_end();
+
+		publish();
+
+		__atomic_store_n(&_next_resync, tsc + (clock_resync_s * hz), __ATOMIC_RELAXED);
+	}
+
+	syslog.messagef(LogLevel::INFO, "clock: TSC runs at %lu Hz", hz);
+
+	__atomic_store_n(&_state, Calibrated, __ATOMIC_RELEASE);
+}
+
+/**
+ * Sets the frequency.  Called with _lock held, inside a write of _seq.
+ */
+void TSCClock::set_frequency(uint64_t hz, Source source)
+{
+	__atomic_store_n(&_hz, hz, __ATOMIC_RELAXED);
+	_mult = (NSEC_PER_SEC << 32) / hz;
+	_source = source;
+}
+
+/**
+ * Copies the clock's parameters to the time page, for user programs.  Called
+ * with _lock held, after every change to them.
+ */
+void TSCClock::publish()
+{
+	time_page.publish(_base_tsc, _mult, _hz, _mono_base, _wall_base);
+}
+
+/**
+ * Moves the base to the given TSC value, carrying both clocks over unchanged,
+ * so that the frequency can then change without either of them jumping.
+ * Called with _lock held, inside a write of _seq.
+ */
+void TSCClock::rebase(uint64_t tsc)
+{
+	uint64_t elapsed = since_base(tsc);
+
+	_mono_base += elapsed;
+	_wall_base += elapsed;
+	_base_tsc = tsc;
+}
+
+/**
+ * Checks the wall clock against the RTC, which has only whole seconds, so the
+ * time should be somewhere in the second the RTC is showing.  If it isn't, the
+ * wall clock is stepped to the nearest edge of that second.  This never waits
+ * for the RTC: if it is mid-update, the check is tried again on the next read.
+ */
+void TSCClock::resync(uint64_t tsc)
+{
+	uint64_t next = __atomic_load_n(&_next_resync, __ATOMIC_RELAXED);
+	if (tsc < next) {
+		return;
+	}
+
+	uint64_t hz = __atomic_load_n(&_hz, __ATOMIC_RELAXED);
+
+	// only one caller does the check
+	if (!__atomic_compare_exchange_n(&_next_resync, &next, tsc + (clock_resync_s * hz), false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	if (cmos_update_in_progress()) {
+		__atomic_store_n(&_next_resync, tsc, __ATOMIC_RELAXED);
+		return;
+	}
+
+	RTCTimePoint tp;
+	cmos_read_timepoint(tp);
+
+	uint64_t rtc = from_timepoint(tp) * NSEC_PER_SEC;
+
+	UniqueIRQSpinLock l(_lock);
+	correct(rdtsc(), rtc, rtc + NSEC_PER_SEC);
+}
+
+/**
+ * Called by the RTC's update-ended interrupt, which fires just after the RTC
+ * starts a new second, so the time at that TSC value is known to within the
+ * interrupt latency, rather than to the second.  While these keep arriving,
+ * the wall clock never needs to be checked by reading the RTC.
+ */
+void TSCClock::rtc_second(uint64_t tsc, uint64_t seconds)
+{
+	if (!calibrated()) {
+		return;
+	}
+
+	UniqueIRQSpinLock l(_lock);
+
+	__atomic_store_n(&_next_resync, tsc + (clock_resync_s * _hz), __ATOMIC_RELAXED);
+
+	refine(tsc, seconds);
+
+	uint64_t rtc = seconds * NSEC_PER_SEC;
+	correct(tsc, rtc, rtc + RTC_IRQ_SLACK_NS);
+}
+
+/**
+ * Measures the frequency again, between the first update-ended interrupt and
+ * the one clock.calibrate= seconds later, and switches to it.  That span is
+ * hundreds of times longer than the calibration at boot, and the interrupt
+ * latency at either end is the only error.  Called with _lock held.
+ */
+void TSCClock::refine(uint64_t tsc, uint64_t seconds)
+{
+	if (_nr_refinements) {
+		return;
+	}
+
+	// start (or, if the RTC went backwards, start again) from this second
+	if (!_ref_tsc || seconds < _ref_seconds) {
+		_ref_tsc = tsc;
+		_ref_seconds = seconds;
+		return;
+	}
+
+	uint64_t span = seconds - _ref_seconds;
+	if (span < clock_calibrate_s) {
+		return;
+	}
+
+	uint64_t hz = (tsc - _ref_tsc) / span;
+
+	// a big difference means the RTC was set in the meantime, not that the
+	// first estimate was that far out
+	uint64_t error = hz > _hz ? hz - _hz : _hz - hz;
+	if (error > (_hz / 1000) * MAX_REFINE_ERROR) {
+		_ref_tsc = tsc;
+		_ref_seconds = seconds;
+		return;
+	}
+
+	_seq.write_begin();
+	rebase(tsc);
+	set_frequency(hz, RTCIRQSource);
+	_seq.write_end();
+
+	publish();
+
+	_nr_refinements++;
+}
+
+/**
+ * Steps the wall clock to the nearest edge of [earliest, latest), if the time
+ * it gives for the given TSC value is outside it.  Called with _lock held.
+ */
+void TSCClock::correct(uint64_t tsc, uint64_t earliest, uint64_t latest)
+{
+	uint64_t estimate = _wall_base + since_base(tsc);
+
+	int64_t correction = 0;
+	if (estimate < earliest) {
+		correction = earliest - estimate;
+	} else if (estimate >= latest) {
+		correction = -(int64_t)(estimate - (latest - 1));
+	}
+
+	if (correction) {
+		_seq.write_begin();
+		_wall_base += correction;
+		_seq.write_end();
+
+		publish();
+
+		_last_correction = correction;
+		_nr_corrections++;
+	}
+
+	_nr_resyncs++;
+}
+
+uint64_t TSCClock::monotonic_ns()
+{
+	ensure_calibrated();
+
+	if (__atomic_load_n(&_state, __ATOMIC_ACQUIRE) != Calibrated) {
+		return sys.runtime().count();
+	}
+
+	uint64_t ns;
+	unsigned int seq;
+	do {
+		seq = _seq.read_begin();
+		ns = _mono_base + since_base(rdtsc());
+	} while (_seq.read_retry(seq));
+
+	return ns;
+}
+
+uint64_t TSCClock::wall_ns()
+{
+	ensure_calibrated();
+
+	// without a calibrated TSC, all there is is the RTC itself
+	if (__atomic_load_n(&_state, __ATOMIC_ACQUIRE) != Calibrated) {
+		RTCTimePoint tp;
+		cmos_read_timepoint(tp);
+		return from_timepoint(tp) * NSEC_PER_SEC;
+	}
+
+	resync(rdtsc());
+
+	uint64_t ns;
+	unsigned int seq;
+	do {
+		seq = _seq.read_begin();
+		ns = _wall_base + since_base(rdtsc());
+	} while (_seq.read_retry(seq));
+
+	return ns;
+}
+
+uint64_t TSCClock::frequency()
+{
+	ensure_calibrated();
+	return __atomic_load_n(&_hz, __ATOMIC_RELAXED);
+}
+
+// The number of days from 1970-01-01 to the given date, and back, using the
+// proleptic Gregorian calendar with years starting in March, so that leap days
+// come at the end.
+
+static int64_t days_from_civil(int64_t y, unsigned int m, unsigned int d)
+{
+	y -= (m <= 2);
+
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	unsigned int yoe = (unsigned int)(y - era * 400);
+	unsigned int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+static void civil_from_days(int64_t z, int64_t& y, unsigned int& m, unsigned int& d)
+{
+	z += 719468;
+
+	int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+	unsigned int doe = (unsigned int)(z - era * 146097);
+	unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned int mp = (5 * doy + 2) / 153;
+
+	d = doy - (153 * mp + 2) / 5 + 1;
+	m = mp < 10 ? mp + 3 : mp - 9;
+	y = (int64_t)yoe + era * 400 + (m <= 2);
+}
+
+void TSCClock::to_timepoint(uint64_t wall_ns, RTCTimePoint& tp)
+{
+	uint64_t secs = wall_ns / NSEC_PER_SEC;
+	uint64_t secs_of_day = secs % 86400;
+
+	int64_t year;
+	unsigned int month, day;
+	civil_from_days(secs / 86400, year, month, day);
+
+	tp.seconds = secs_of_day % 60;
+	tp.minutes = (secs_of_day / 60) % 60;
+	tp.hours = secs_of_day / 3600;
+	tp.day_of_month = day;
+	tp.month = month;
+	tp.year = year % 100;
+}
+
+uint64_t TSCClock::from_timepoint(const RTCTimePoint& tp)
+{
+	// the RTC only has two digits of year, and this century is the likely one
+	int64_t days = days_from_civil(2000 + tp.year, tp.month, tp.day_of_month);
+	return (uint64_t)days * 86400 + tp.hours * 3600 + tp.minutes * 60 + tp.seconds;
+}
+
+static const char *source_names[] = { "none", "cpuid", "pit", "rtc", "rtc-irq" };
+
+size_t TSCClock::read_stats(char *buffer, size_t size, void *arg)
+{
+	TSCClock *clock = (TSCClock *)arg;
+	size_t pos = 0;
+
+	uint64_t wall = clock->wall_ns();
+
+	stats_printf(buffer, size, pos, "calibrated %u\n", clock->calibrated() ? 1 : 0);
+	stats_printf(buffer, size, pos, "tsc_hz %lu\n", clock->frequency());
+	stats_printf(buffer, size, pos, "tsc_source %s\n", source_names[clock->_source]);
+	stats_printf(buffer, size, pos, "refinements %lu\n", clock->_nr_refinements);
+	stats_printf(buffer, size, pos, "monotonic_ns %lu\n", clock->monotonic_ns());
+	stats_printf(buffer, size, pos, "wall_ns %lu\n", wall);
+	stats_printf(buffer, size, pos, "resyncs %lu\n", clock->_nr_resyncs);
+	stats_printf(buffer, size, pos, "corrections %lu\n", clock->_nr_corrections);
+	stats_printf(buffer, size, pos, "last_correction_ns %ld\n", clock->_last_correction);
+
+	return pos;
+}
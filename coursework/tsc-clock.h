@@ -0,0 +1,135 @@
+/*
+ * TSC Clock Source Header File
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_TSC_CLOCK_H
+#define COURSEWORK_TSC_CLOCK_H
+
+#include <infos/drivers/timer/rtc.h>
+
+#include "seqcount.h"
+#include "spinlock.h"
+#include "stats.h"
+
+namespace coursework {
+
+	/**
+	 * A nanosecond clock read from the TSC, so that reading the time never needs
+	 * port I/O.  It is calibrated when the RTC driver starts (or when it is first
+	 * used, if that is sooner), without waiting for the RTC: the TSC frequency
+	 * comes from cpuid leaf 0x15 where the CPU reports it, and otherwise is
+	 * measured against the PIT's channel 2 over 50 ms.  Only if neither works is
+	 * it measured over a whole RTC second.  The wall clock starts at the RTC's
+	 * current second.
+	 *
+	 * The RTC driver's update-ended interrupt then reports each new second as it
+	 * starts.  That keeps the wall clock within a millisecond of the RTC without
+	 * reading it, and once clock.calibrate= seconds (16 by default) of them have
+	 * passed, the frequency is measured again over that span, and replaces the
+	 * first estimate.  Without the interrupts, the wall clock is checked against
+	 * the RTC every clock.resync= seconds (64 by default), and stepped back into
+	 * the RTC's current second if it has drifted out of it.  The monotonic clock
+	 * is never stepped, and a new frequency only changes its rate from then on.
+	 * Both are published, with the calibration, as /.stats/clock, and the
+	 * parameters for reading them are published on the time page.
+	 *
+	 * The clock's parameters change under a spinlock, from the interrupt or from
+	 * a reader that does a resync, and readers take a consistent copy of them
+	 * through a sequence counter.
+	 */
+	class TSCClock {
+	public:
+		TSCClock();
+
+		/* Calibrates the clock now, unless it already has been.  Called at boot,
+		so that the first caller to want the time doesn't wait for it */
+		void ensure_calibrated();
+
+		/* Returns the time since the clock was calibrated, in nanoseconds */
+		uint64_t monotonic_ns();
+
+		/* Returns the time since 1970-01-01 00:00:00 in the RTC's time zone, in
+		nanoseconds */
+		uint64_t wall_ns();
+
+		/* Returns the TSC frequency, in Hz, or zero if calibration failed */
+		uint64_t frequency();
+
+		/* Returns TRUE once the clock has been calibrated */
+		bool calibrated() const {
+			return __atomic_load_n(&_state, __ATOMIC_ACQUIRE) == Calibrated;
+		}
+
+		/* Tells the clock that the RTC started the given second (since 1970) when
+		the TSC had the given value */
+		void rtc_second(uint64_t tsc, uint64_t seconds);
+
+		/* Converts a wall-clock time to the RTC's fields */
+		static void to_timepoint(uint64_t wall_ns, infos::drivers::timer::RTCTimePoint& tp);
+
+		/* Converts the RTC's fields to seconds since 1970 */
+		static uint64_t from_timepoint(const infos::drivers::timer::RTCTimePoint& tp);
+
+	private:
+		enum State { Uncalibrated, Calibrating, Calibrated, Failed };
+
+		// Where the frequency came from.
+		enum Source { NoSource, CPUIDSource, PITSource, RTCSource, RTCIRQSource };
+
+		void calibrate();
+		void resync(uint64_t tsc);
+		void refine(uint64_t tsc, uint64_t seconds);
+		void correct(uint64_t tsc, uint64_t earliest, uint64_t latest);
+		void rebase(uint64_t tsc);
+		void set_frequency(uint64_t hz, Source source);
+		void publish();
+
+		uint64_t cycles_to_ns(uint64_t cycles) const {
+			return (uint64_t)(((unsigned __int128)cycles * _mult) >> 32);
+		}
+
+		/* Converts a TSC value to nanoseconds since the base.  Called with _lock
+		held, or inside a read of _seq */
+		uint64_t since_base(uint64_t tsc) const {
+			// another CPU's TSC can be a little behind the one the base came from
+			return tsc > _base_tsc ? cycles_to_ns(tsc - _base_tsc) : 0;
+		}
+
+		static size_t read_stats(char *buffer, size_t size, void *arg);
+
+		State _state;
+
+		// Serialises changes to everything below, which readers copy under _seq.
+		SpinLock _lock;
+		SeqCount _seq;
+
+		// The TSC frequency and where it came from, and the nanoseconds per cycle
+		// as a 32.32 fixed-point number.
+		uint64_t _hz, _mult;
+		Source _source;
+
+		// The TSC value that both clocks count from, and their times at that
+		// value.  The wall clock's is adjusted for drift.
+		uint64_t _base_tsc, _mono_base, _wall_base;
+
+		// The first update-ended interrupt that the frequency is measured from,
+		// once the interrupts have been arriving for clock.calibrate= seconds.
+		uint64_t _ref_tsc, _ref_seconds;
+
+		// The TSC value at which the wall clock is next checked against the RTC.
+		uint64_t _next_resync;
+
+		uint64_t _nr_resyncs, _nr_corrections, _nr_refinements;
+		int64_t _last_correction;
+
+		StatsEntry _stats;
+	};
+
+	/* The clock shared by everything that wants the time */
+	extern TSCClock tsc_clock;
+}
+
+#endif /* COURSEWORK_TSC_CLOCK_H */
@@ -0,0 +1,30 @@
+/*
+ * Time Stamp Counter Helpers
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#ifndef COURSEWORK_TSC_H
+#define COURSEWORK_TSC_H
+
+#include <infos/define.h>
+
+namespace coursework {
+
+	/* Returns the current value of this CPU's time stamp counter */
+	static inline uint64_t rdtsc()
+	{
+		uint32_t lo, hi;
+		asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+		return ((uint64_t)hi << 32) | lo;
+	}
+
+	/* Runs cpuid for the given leaf (and subleaf zero) */
+	static inline void cpuid(uint32_t leaf, uint32_t& eax, uint32_t& ebx, uint32_t& ecx, uint32_t& edx)
+	{
+		asm volatile("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(leaf), "c"(0));
+	}
+}
+
+#endif /* COURSEWORK_TSC_H */
@@ -0,0 +1,71 @@
+#!/bin/sh
+#
+# Runs a benchmark program under QEMU, and collects the results on the host.
+# Everything that could vary between runs (memory, CPUs, kernel command line and
+# the archive itself) is fixed, so results can be compared across changes.
+#
+#   BENCH_PROGRAM   the benchmark program to run as init (default: tarfsbench)
+#                   tarfsstress checks TarFS under concurrent readers instead,
+#                   and any errors it finds make this script fail
+#   BENCH_PGALLOC   the page allocator (default: simple)
+#   BENCH_SCHED     the scheduler (default: cfs)
+#   BENCH_ROOTFS    the archive to benchmark (default: generated from rootfs.tar)
+#   BENCH_PACK=1    benchmark the compressed form of the archive instead
+#   BENCH_OUT       where the BENCH lines are written (default: bench-results.txt)
+#   BENCH_TIMEOUT   seconds to wait for the benchmarks to finish (default: 600)
+#
+# Any arguments are added to the kernel command line, e.g. to set a quantum:
+#
+#   BENCH_PROGRAM=schedbench BENCH_SCHED=mlfq ./run-bench.sh sched.mlfq.quantum=1000
+#
+
+TOP="`pwd`"
+INFOS_DIR="$TOP/infos"
+INFOS_USER_DIR="$TOP/infos-user"
+KERNEL="$INFOS_DIR/out/infos-kernel"
+BENCH_PROGRAM=${BENCH_PROGRAM:-tarfsbench}
+BENCH_PGALLOC=${BENCH_PGALLOC:-simple}
+BENCH_SCHED=${BENCH_SCHED:-cfs}
+BENCH_ROOTFS="${BENCH_ROOTFS:-$TOP/bench-rootfs.tar}"
+BENCH_OUT="${BENCH_OUT:-$TOP/bench-results.txt}"
+BENCH_TIMEOUT=${BENCH_TIMEOUT:-600}
+KERNEL_CMDLINE="boot-device=ata0 init=/usr/$BENCH_PROGRAM pgalloc.debug=0 pgalloc.algorithm=$BENCH_PGALLOC objalloc.debug=0 sched.debug=0 sched.algorithm=$BENCH_SCHED syslog=serial $*"
+QEMU=qemu-system-x86_64
+
+if [ ! -f "$BENCH_ROOTFS" ] || [ "$TOP/tools/mkbenchfs.py" -nt "$BENCH_ROOTFS" ]; then
+	python3 "$TOP/tools/mkbenchfs.py" "$INFOS_USER_DIR/bin/rootfs.tar" "$BENCH_ROOTFS" || exit 1
+fi
+
+ROOTFS="$BENCH_ROOTFS"
+if [ "$BENCH_PACK" = "1" ]; then
+	ROOTFS="${BENCH_ROOTFS%.tar}.tzf"
+	"$TOP/tools/tarfs-pack" "$BENCH_ROOTFS" "$ROOTFS" || exit 1
+fi
+
+LOG=`mktemp`
+$QEMU -kernel "$KERNEL" -m 1G -smp 1 -display none -debugcon "file:$LOG" -hda "$ROOTFS" -append "$KERNEL_CMDLINE" &
+QEMU_PID=$!
+
+# Wait for the benchmarks to say they're done, or for QEMU to give up.
+elapsed=0
+while ! grep -q "^BENCH [a-z]*\.done" "$LOG"; do
+	if ! kill -0 $QEMU_PID 2>/dev/null || [ $elapsed -ge $BENCH_TIMEOUT ]; then
+		echo "benchmarks did not finish" >&2
+		break
+	fi
+
+	sleep 1
+	elapsed=$((elapsed + 1))
+done
+
+kill $QEMU_PID 2>/dev/null
+wait $QEMU_PID 2>/dev/null
+
+grep "^BENCH " "$LOG" | tee "$BENCH_OUT"
+rm -f "$LOG"
+
+# Results that carry an error count (e.g. from tarfsstress) must have found none.
+if grep -q " errors=[1-9]" "$BENCH_OUT"; then
+	echo "benchmarks reported errors" >&2
+	exit 1
+fi
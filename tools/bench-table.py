@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+#
+# Prints a table comparing the results collected by bench-matrix.sh: one row per
+# benchmark metric, one column per page allocator and scheduler combination, with
+# the mean over every run and its coefficient of variation.
+#
+# usage: bench-table.py [-m metric,...] [-b pgalloc-sched] matrix-dir
+#
+# The directory holds <program>/<pgalloc>-<sched>/run<N>.txt, each file being the
+# BENCH lines from one boot.  With -b, every other column also shows its mean as
+# a ratio of the baseline's, so lower than 1.00x is faster for a latency.
+#
+
+#
+# STUDENT NUMBER: s1894401
+#
+
+import argparse
+import math
+import os
+import sys
+
+DEFAULT_METRICS = 'cycles,p50,p99'
+
+
+def parse_run(path):
+    """Returns {benchmark: {key: value}} for one run, and whether it finished."""
+    results = {}
+    done = False
+
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) < 2 or fields[0] != 'BENCH':
+                continue
+
+            if fields[1].endswith('.done'):
+                done = True
+                continue
+
+            values = {}
+            for field in fields[2:]:
+                key, sep, value = field.partition('=')
+                if sep and value.isdigit():
+                    values[key] = int(value)
+
+            if values:
+                results[fields[1]] = values
+
+    return results, done
+
+
+def load_matrix(path):
+    """Returns {program: {config: [runs]}}, and the runs that didn't finish."""
+    matrix = {}
+    unfinished = []
+
+    for program in sorted(os.listdir(path)):
+        program_dir = os.path.join(path, program)
+        if not os.path.isdir(program_dir):
+            continue
+
+        configs = {}
+        for config in sorted(os.listdir(program_dir)):
+            config_dir = os.path.join(program_dir, config)
+            if not os.path.isdir(config_dir):
+                continue
+
+            runs = []
+            for name in sorted(os.listdir(config_dir)):
+                if not (name.startswith('run') and name.endswith('.txt')):
+                    continue
+
+                results, done = parse_run(os.path.join(config_dir, name))
+                if not done:
+                    unfinished.append(os.path.join(program, config, name))
+                runs.append(results)
+
+            configs[config] = runs
+
+        matrix[program] = configs
+
+    return matrix, unfinished
+
+
+def summarise(values):
+    """Returns the mean and the coefficient of variation (in percent)."""
+    mean = sum(values) / len(values)
+    if len(values) < 2 or mean == 0:
+        return mean, 0.0
+
+    variance = sum((v - mean) ** 2 for v in values) / (len(values) - 1)
+    return mean, 100.0 * math.sqrt(variance) / mean
+
+
+def format_mean(mean):
+    if mean >= 10000000:
+        return '%.1fM' % (mean / 1000000)
+    if mean >= 10000:
+        return '%.1fk' % (mean / 1000)
+    return '%.0f' % mean
+
+
+def print_table(program, configs, metrics, baseline, out):
+    names = list(configs)
+
+    # Every benchmark that appears in any run, in the order the program ran them.
+    benchmarks = []
+    for runs in configs.values():
+        for results in runs:
+            for benchmark in results:
+                if benchmark not in benchmarks:
+                    benchmarks.append(benchmark)
+
+    rows = []
+    for benchmark in benchmarks:
+        for metric in metrics:
+            cells = []
+            means = {}
+            for config in names:
+                values = [r[benchmark][metric] for r in configs[config]
+                          if benchmark in r and metric in r[benchmark]]
+                if not values:
+                    cells.append(None)
+                    continue
+
+                mean, cv = summarise(values)
+                means[config] = mean
+
+                cell = '%s ±%.1f%%' % (format_mean(mean), cv)
+                if len(values) < len(configs[config]):
+                    cell += ' (n=%d)' % len(values)
+                cells.append(cell)
+
+            if all(cell is None for cell in cells):
+                continue
+
+            if baseline in means and means[baseline]:
+                for i, config in enumerate(names):
+                    if cells[i] is not None and config != baseline:
+                        cells[i] += ' %.2fx' % (means[config] / means[baseline])
+
+            rows.append(['%s.%s' % (benchmark, metric)] + ['-' if c is None else c for c in cells])
+
+    if not rows:
+        return
+
+    header = [program] + names
+    widths = [max(len(row[i]) for row in rows + [header]) for i in range(len(header))]
+
+    def emit(row):
+        line = row[0].ljust(widths[0])
+        for cell, width in zip(row[1:], widths[1:]):
+            line += '  ' + cell.rjust(width)
+        out.write(line.rstrip() + '\n')
+
+    emit(header)
+    emit(['-' * w for w in widths])
+    for row in rows:
+        emit(row)
+    out.write('\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare benchmark results across kernel configurations.')
+    parser.add_argument('-m', '--metrics', default=DEFAULT_METRICS,
+                        help='comma-separated BENCH keys to show (default: %s)' % DEFAULT_METRICS)
+    parser.add_argument('-b', '--baseline', help='the pgalloc-sched column to compare the others with')
+    parser.add_argument('matrix', help='the directory written by bench-matrix.sh')
+    args = parser.parse_args()
+
+    matrix, unfinished = load_matrix(args.matrix)
+    if not matrix:
+        sys.exit('%s: no results' % args.matrix)
+
+    metrics = [m for m in args.metrics.split(',') if m]
+    for program, configs in matrix.items():
+        print_table(program, configs, metrics, args.baseline, sys.stdout)
+
+    for run in unfinished:
+        sys.stderr.write('%s: did not finish\n' % run)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,18 @@
+/*
+ * Host-side stand-in for the kernel's basic definitions, so that freestanding
+ * parts of the coursework can be built into host tools.
+ */
+#ifndef TOOLS_INFOS_DEFINE_H
+#define TOOLS_INFOS_DEFINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define __packed __attribute__((packed))
+#define __min(a, b) ((a) < (b) ? (a) : (b))
+#define __max(a, b) ((a) > (b) ? (a) : (b))
+
+namespace infos { namespace util { } }
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Host-side stand-in for the local APIC timer, which host tools never find.
+ */
+#ifndef TOOLS_INFOS_DRIVERS_TIMER_LAPIC_TIMER_H
+#define TOOLS_INFOS_DRIVERS_TIMER_LAPIC_TIMER_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace drivers {
+		class DeviceClass {
+		};
+
+		namespace timer {
+			class LAPICTimer {
+			public:
+				static inline const DeviceClass LAPICTimerDeviceClass;
+
+				void init_oneshot(uint64_t period) { }
+				void init_periodic(uint64_t period) { }
+				void start() { }
+				void stop() { }
+				uint64_t frequency() const { return 0; }
+			};
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ * Host-side stand-in for the kernel's directories, which host tools only ever name.
+ */
+#ifndef TOOLS_INFOS_FS_DIRECTORY_H
+#define TOOLS_INFOS_FS_DIRECTORY_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace fs {
+		class Directory {
+		public:
+			virtual ~Directory() { }
+		};
+	}
+}
+
+#endif
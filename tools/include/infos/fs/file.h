@@ -0,0 +1,18 @@
+/*
+ * Host-side stand-in for the kernel's files, which host tools only ever name.
+ */
+#ifndef TOOLS_INFOS_FS_FILE_H
+#define TOOLS_INFOS_FS_FILE_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace fs {
+		class File {
+		public:
+			virtual ~File() { }
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Host-side stand-in for the kernel's filesystem nodes, which host tools only
+ * ever name.
+ */
+#ifndef TOOLS_INFOS_FS_PFS_NODE_H
+#define TOOLS_INFOS_FS_PFS_NODE_H
+
+#include <infos/fs/file.h>
+#include <infos/fs/directory.h>
+#include <infos/util/string.h>
+
+namespace infos {
+	namespace fs {
+		class Filesystem;
+
+		class PFSNode {
+		public:
+			PFSNode(PFSNode *parent, Filesystem& owner) { }
+			virtual ~PFSNode() { }
+
+			virtual File *open() = 0;
+			virtual Directory *opendir() = 0;
+			virtual PFSNode *get_child(const util::String& name) = 0;
+			virtual PFSNode *mkdir(const util::String& name) = 0;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Host-side stand-in for the kernel's command-line arguments.  Registered
+ * arguments are collected into a list, so host programs can set them.
+ */
+#ifndef TOOLS_INFOS_KERNEL_CMDLINE_H
+#define TOOLS_INFOS_KERNEL_CMDLINE_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace kernel {
+		class CmdLineArgument {
+		public:
+			typedef void (*Handler)(const char *value);
+
+			CmdLineArgument(const char *key, Handler handler) : _key(key), _handler(handler), _next(_first) {
+				_first = this;
+			}
+
+			/* Passes the value to the argument with the given key, and returns
+			FALSE if there isn't one */
+			static bool set(const char *key, const char *value) {
+				for (const CmdLineArgument *arg = _first; arg; arg = arg->_next) {
+					if (strcmp(arg->_key, key) == 0) {
+						arg->_handler(value);
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+		private:
+			const char *_key;
+			Handler _handler;
+			const CmdLineArgument *_next;
+
+			static inline const CmdLineArgument *_first;
+		};
+	}
+}
+
+#define RegisterCmdLineArgument(_name, _key) \
+	static void __cmdline_##_name(const char *value); \
+	static infos::kernel::CmdLineArgument __cmdline_arg_##_name(_key, __cmdline_##_name); \
+	static void __cmdline_##_name(const char *value)
+
+#endif
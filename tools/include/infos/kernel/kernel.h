@@ -0,0 +1,50 @@
+/*
+ * Host-side stand-in for the kernel object.  Time is whatever the host program
+ * says it is, and there are no devices.
+ */
+#ifndef TOOLS_INFOS_KERNEL_KERNEL_H
+#define TOOLS_INFOS_KERNEL_KERNEL_H
+
+#include <infos/define.h>
+#include <infos/util/time.h>
+
+namespace infos {
+	namespace drivers {
+		class DeviceClass;
+
+		class DeviceManager {
+		public:
+			template<typename T>
+			bool try_get_device_by_class(const DeviceClass& device_class, T*& device) {
+				return false;
+			}
+		};
+	}
+
+	namespace kernel {
+		class Kernel {
+		public:
+			Kernel() : _now(0) { }
+
+			util::Nanoseconds runtime() const {
+				return util::Nanoseconds(_now);
+			}
+
+			void set_runtime(uint64_t now) {
+				_now = now;
+			}
+
+			drivers::DeviceManager& device_manager() {
+				return _device_manager;
+			}
+
+		private:
+			uint64_t _now;
+			drivers::DeviceManager _device_manager;
+		};
+
+		inline Kernel sys;
+	}
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Host-side stand-in for the kernel's log, which writes to stderr.
+ */
+#ifndef TOOLS_INFOS_KERNEL_LOG_H
+#define TOOLS_INFOS_KERNEL_LOG_H
+
+#include <infos/define.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+namespace infos {
+	namespace kernel {
+		namespace LogLevel {
+			enum LogLevel {
+				DEBUG,
+				INFO,
+				IMPORTANT,
+				WARNING,
+				ERROR,
+				FATAL,
+			};
+		}
+
+		class ComponentLog {
+		public:
+			void messagef(LogLevel::LogLevel level, const char *fmt, ...) {
+				if (level < LogLevel::WARNING) {
+					return;
+				}
+
+				va_list args;
+				va_start(args, fmt);
+				vfprintf(stderr, fmt, args);
+				va_end(args);
+				fputc('\n', stderr);
+			}
+		};
+
+		inline ComponentLog syslog;
+	}
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*
+ * Host-side stand-in for the kernel's scheduling entities.  The host program
+ * that owns the entities updates their state directly.
+ */
+#ifndef TOOLS_INFOS_KERNEL_SCHED_ENTITY_H
+#define TOOLS_INFOS_KERNEL_SCHED_ENTITY_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace kernel {
+		namespace SchedulingEntityPriority {
+			enum SchedulingEntityPriority {
+				REALTIME,
+				INTERACTIVE,
+				NORMAL,
+				DAEMON,
+				IDLE,
+			};
+		}
+
+		class SchedulingEntity {
+		public:
+			typedef uint64_t EntityRuntime;
+
+			SchedulingEntity() : _cpu_runtime(0), _stopped(false), _priority(SchedulingEntityPriority::NORMAL) { }
+			virtual ~SchedulingEntity() { }
+
+			EntityRuntime cpu_runtime() const {
+				return _cpu_runtime;
+			}
+
+			bool stopped() const {
+				return _stopped;
+			}
+
+			SchedulingEntityPriority::SchedulingEntityPriority priority() const {
+				return _priority;
+			}
+
+			void increment_cpu_runtime(EntityRuntime delta) {
+				_cpu_runtime += delta;
+			}
+
+			void set_stopped() {
+				_stopped = true;
+			}
+
+			void set_priority(SchedulingEntityPriority::SchedulingEntityPriority priority) {
+				_priority = priority;
+			}
+
+		private:
+			EntityRuntime _cpu_runtime;
+			bool _stopped;
+			SchedulingEntityPriority::SchedulingEntityPriority _priority;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,55 @@
+/*
+ * Host-side stand-in for the kernel's scheduler interface.  Registered
+ * algorithms are collected into a list, from which host programs create them.
+ */
+#ifndef TOOLS_INFOS_KERNEL_SCHED_H
+#define TOOLS_INFOS_KERNEL_SCHED_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace infos {
+	namespace kernel {
+		class SchedulingAlgorithm {
+		public:
+			virtual ~SchedulingAlgorithm() { }
+
+			virtual const char *name() const = 0;
+			virtual void init() { }
+			virtual void add_to_runqueue(SchedulingEntity& entity) = 0;
+			virtual void remove_from_runqueue(SchedulingEntity& entity) = 0;
+			virtual SchedulingEntity *pick_next_entity() = 0;
+		};
+
+		class SchedulerRegistration {
+		public:
+			typedef SchedulingAlgorithm *(*Factory)();
+
+			SchedulerRegistration(Factory factory) : _factory(factory), _next(_first) {
+				_first = this;
+			}
+
+			SchedulingAlgorithm *create() const {
+				return _factory();
+			}
+
+			static const SchedulerRegistration *first() {
+				return _first;
+			}
+
+			const SchedulerRegistration *next() const {
+				return _next;
+			}
+
+		private:
+			Factory _factory;
+			const SchedulerRegistration *_next;
+
+			static inline const SchedulerRegistration *_first;
+		};
+	}
+}
+
+#define RegisterScheduler(_class) \
+	static infos::kernel::SchedulerRegistration __sched_reg_##_class([]() -> infos::kernel::SchedulingAlgorithm * { return new _class(); })
+
+#endif
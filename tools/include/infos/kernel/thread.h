@@ -0,0 +1,28 @@
+/*
+ * Host-side stand-in for the kernel's threads.  The host program sets which
+ * thread is current.
+ */
+#ifndef TOOLS_INFOS_KERNEL_THREAD_H
+#define TOOLS_INFOS_KERNEL_THREAD_H
+
+#include <infos/kernel/sched-entity.h>
+
+namespace infos {
+	namespace kernel {
+		class Thread : public SchedulingEntity {
+		public:
+			static Thread& current() {
+				return *_current;
+			}
+
+			static void set_current(Thread *thread) {
+				_current = thread;
+			}
+
+		private:
+			static inline Thread *_current;
+		};
+	}
+}
+
+#endif
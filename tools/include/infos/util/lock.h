@@ -0,0 +1,20 @@
+/*
+ * Host-side stand-in for the kernel's locks.  Host tools are single-threaded,
+ * so there are no interrupts to disable.
+ */
+#ifndef TOOLS_INFOS_UTIL_LOCK_H
+#define TOOLS_INFOS_UTIL_LOCK_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace util {
+		class UniqueIRQLock {
+		public:
+			UniqueIRQLock() { }
+			~UniqueIRQLock() { }
+		};
+	}
+}
+
+#endif
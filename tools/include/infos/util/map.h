@@ -0,0 +1,17 @@
+/*
+ * Host-side stand-in for the kernel's map, which host tools only ever name.
+ */
+#ifndef TOOLS_INFOS_UTIL_MAP_H
+#define TOOLS_INFOS_UTIL_MAP_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace util {
+		template<typename TKey, typename TValue>
+		class Map {
+		};
+	}
+}
+
+#endif
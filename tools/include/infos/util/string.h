@@ -0,0 +1,19 @@
+/*
+ * Host-side stand-in for the kernel's string routines.
+ */
+#ifndef TOOLS_INFOS_UTIL_STRING_H
+#define TOOLS_INFOS_UTIL_STRING_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace util {
+		/* Only named in declarations that host tools never call */
+		class String {
+		public:
+			typedef uint64_t hash_type;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Host-side stand-in for the kernel's time types.
+ */
+#ifndef TOOLS_INFOS_UTIL_TIME_H
+#define TOOLS_INFOS_UTIL_TIME_H
+
+#include <infos/define.h>
+
+namespace infos {
+	namespace util {
+		class Nanoseconds {
+		public:
+			explicit Nanoseconds(uint64_t count) : _count(count) { }
+
+			uint64_t count() const {
+				return _count;
+			}
+
+		private:
+			uint64_t _count;
+		};
+	}
+}
+
+#endif
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+#
+# Builds the root filesystem used by the TarFS benchmarks: a copy of the normal
+# rootfs.tar, with the benchmark data added under /bench.
+#
+# usage: mkbenchfs.py [-s large-file-MiB] input.tar output.tar
+#
+# The output only depends on the input and the options -- file contents come
+# from a fixed seed and every header uses the same owner and timestamp -- so
+# results from different runs are comparable.
+#
+
+#
+# STUDENT NUMBER: s1894401
+#
+
+import argparse
+import io
+import random
+import struct
+import tarfile
+
+NR_SMALL_FILES = 4096
+SMALL_FILE_SIZE = 256
+DEEP_LEVELS = 32
+NR_WIDE_ENTRIES = 10000
+PATTERN_SIZE = 4 * 1024 * 1024
+BLOCK_SIZE = 512
+PAGE_SIZE = 4096
+
+
+def add_file(tar, name, data):
+    info = tarfile.TarInfo(name)
+    info.size = len(data)
+    info.mtime = 0
+    info.mode = 0o644
+    tar.addfile(info, io.BytesIO(data))
+
+
+def align_next_file(tar, name):
+    # TarFS can only map a file whose data starts on a page boundary, so pad the
+    # archive with a zero-filled file until the next plain header ends on one.
+    if (tar.offset + BLOCK_SIZE) % PAGE_SIZE:
+        add_file(tar, name, bytes(-(tar.offset + 2 * BLOCK_SIZE) % PAGE_SIZE))
+    assert (tar.offset + BLOCK_SIZE) % PAGE_SIZE == 0
+
+
+def add_dir(tar, name):
+    info = tarfile.TarInfo(name)
+    info.type = tarfile.DIRTYPE
+    info.mtime = 0
+    info.mode = 0o755
+    tar.addfile(info)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build the TarFS benchmark root filesystem.')
+    parser.add_argument('-s', '--large-size', type=int, default=64, help='size of the large file, in MiB')
+    parser.add_argument('input')
+    parser.add_argument('output')
+    args = parser.parse_args()
+
+    rng = random.Random(1)
+
+    with tarfile.open(args.input, 'r') as src, tarfile.open(args.output, 'w', format=tarfile.PAX_FORMAT) as tar:
+        for member in src.getmembers():
+            tar.addfile(member, src.extractfile(member) if member.isfile() else None)
+
+        add_dir(tar, 'bench')
+
+        # Half random bytes and half text-like runs, so that compressed archives
+        # aren't either trivially small or incompressible.
+        chunk = 1024 * 1024
+        data = bytearray()
+        for i in range(args.large_size):
+            if i % 2:
+                data += rng.randbytes(chunk)
+            else:
+                data += bytes(rng.choice(b'abcdefgh \n') for _ in range(4096)) * (chunk // 4096)
+        add_file(tar, 'bench/large.bin', bytes(data))
+
+        # Every 8-byte word holds its own offset, so that tarfsstress can check
+        # any range it reads, and tarfsbench anything it maps.
+        align_next_file(tar, 'bench/.pad')
+        add_file(tar, 'bench/pattern.bin', b''.join(struct.pack('<Q', off) for off in range(0, PATTERN_SIZE, 8)))
+
+        add_dir(tar, 'bench/small')
+        for i in range(NR_SMALL_FILES):
+            add_file(tar, 'bench/small/f%04u' % i, rng.randbytes(SMALL_FILE_SIZE))
+
+        path = 'bench/deep'
+        add_dir(tar, path)
+        for i in range(DEEP_LEVELS):
+            path += '/d%02u' % i
+            add_dir(tar, path)
+        add_file(tar, path + '/leaf', b'leaf\n')
+
+        add_dir(tar, 'bench/wide')
+        for i in range(NR_WIDE_ENTRIES):
+            add_file(tar, 'bench/wide/entry-%05u' % i, b'')
+
+
+if __name__ == '__main__':
+    main()
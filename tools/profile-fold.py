@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+#
+# Turns the kernel profiler's dump (the PROFILE lines written to the debug
+# console by "echo dump > /.stats/profile") into flame graph input: one line per
+# stack, with frames separated by semicolons, followed by its sample count.
+#
+# usage: profile-fold.py [-k kernel] [-t] [--histogram] [log ...]
+#
+# Addresses are symbolised against the kernel image with nm.  The profiler only
+# records where each interrupt arrived, so every stack is the interrupted
+# function, under the interrupted thread with -t.  --histogram prints a table
+# of functions by sample count instead.
+#
+
+#
+# STUDENT NUMBER: s1894401
+#
+
+import argparse
+import bisect
+import collections
+import subprocess
+import sys
+
+
+def load_symbols(kernel):
+    out = subprocess.run(['nm', '-n', '-C', '--defined-only', kernel],
+                         check=True, capture_output=True, text=True).stdout
+
+    addresses, names = [], []
+    for line in out.splitlines():
+        fields = line.split(' ', 2)
+        if len(fields) == 3 and fields[1] in 'tTwW':
+            addresses.append(int(fields[0], 16))
+            names.append(fields[2])
+
+    return addresses, names
+
+
+def symbolise(symbols, rip):
+    addresses, names = symbols
+    if rip == 0:
+        return '[unknown]'
+
+    i = bisect.bisect_right(addresses, rip) - 1
+    return names[i] if i >= 0 else '0x%x' % rip
+
+
+def read_samples(files):
+    samples = collections.Counter()
+    for f in files:
+        for line in f:
+            fields = line.split()
+            if len(fields) != 4 or fields[0] != 'PROFILE' or '=' in line:
+                continue
+
+            # %p prints NULL as "(nil)" on some printf implementations
+            rip = 0 if fields[1] == '(nil)' else int(fields[1], 16)
+            samples[(rip, fields[2])] += int(fields[3])
+
+    return samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Fold kernel profiler samples into flame graph input.')
+    parser.add_argument('-k', '--kernel', default='infos/out/infos-kernel', help='the kernel image, for symbols')
+    parser.add_argument('-t', '--threads', action='store_true', help='put each thread at the root of its stacks')
+    parser.add_argument('--histogram', action='store_true', help='print samples per function instead')
+    parser.add_argument('logs', nargs='*', help='debug console logs (default: standard input)')
+    args = parser.parse_args()
+
+    symbols = load_symbols(args.kernel)
+
+    files = [open(name) for name in args.logs] or [sys.stdin]
+    samples = read_samples(files)
+
+    folded = collections.Counter()
+    for (rip, thread), count in samples.items():
+        function = symbolise(symbols, rip)
+        folded['thread-%s;%s' % (thread, function) if args.threads else function] += count
+
+    if args.histogram:
+        total = sum(folded.values())
+        for stack, count in folded.most_common():
+            print('%8u %5.1f%%  %s' % (count, (count * 100.0) / total, stack))
+    else:
+        for stack, count in sorted(folded.items()):
+            print('%s %u' % (stack, count))
+
+
+if __name__ == '__main__':
+    main()
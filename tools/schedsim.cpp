@@ -0,0 +1,548 @@
+/*
+ * Scheduler Simulator
+ *
+ * Runs the scheduling algorithms from coursework/ on the host, against simulated
+ * threads, so that they can be compared (and checked for regressions) without
+ * booting the kernel.  The simulated machine has one CPU, and a timer that
+ * ticks every -t microseconds.  As in the kernel, the algorithm is asked to pick
+ * on every tick, and whenever the running thread blocks or exits.
+ *
+ *   schedsim [-s rr,mlfq,...] [-w cpu,io,...] [-t tick_us] [-r seed]
+ *            [-l limit_s] [-o key=value]... [-v]
+ *
+ * Every workload is run under every algorithm unless -s or -w say otherwise.
+ * -o sets one of the kernel command-line arguments (e.g. sched.rr.quantum=5000),
+ * and -v prints each algorithm's stats file after each run.  With -o trace=sched,
+ * the scheduler trace events from the last runs are written out at the end, in
+ * the kernel's trace format.  One line is printed per run:
+ *
+ *   SIM <workload> <algorithm> key=value ...
+ *
+ * Times are in simulated microseconds, except ns_per_pick, which is the host
+ * time taken by pick_next_entity.  fairness_milli is Jain's fairness index of
+ * the rate at which each thread got through its work, scaled by a thousand.
+ *
+ * The per-CPU algorithms aren't simulated, as there is only one CPU.
+ */
+#include <infos/kernel/sched.h>
+#include <infos/kernel/thread.h>
+#include <infos/kernel/kernel.h>
+#include <infos/kernel/cmdline.h>
+
+#include "../coursework/percpu-sched.h"
+#include "../coursework/stats.h"
+#include "../coursework/trace.h"
+#include "../coursework/tsc.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+using namespace infos::kernel;
+using namespace coursework;
+
+/*
+ * The parts of the coursework that the algorithms use, but which need the rest
+ * of the kernel, are provided here instead.
+ */
+
+static StatsEntry *stats_entries;
+
+StatsEntry::StatsEntry(const char *name, StatsReadFn read, StatsWriteFn write, void *arg)
+	: _name(name), _read(read), _write(write), _arg(arg), _next(stats_entries)
+{
+	stats_entries = this;
+}
+
+StatsEntry::~StatsEntry()
+{
+	for (StatsEntry **entry = &stats_entries; *entry; entry = &(*entry)->_next) {
+		if (*entry == this) {
+			*entry = _next;
+			break;
+		}
+	}
+}
+
+unsigned int StatsEntry::list(StatsEntry **entries, unsigned int max)
+{
+	unsigned int count = 0;
+	for (StatsEntry *entry = stats_entries; entry && count < max; entry = entry->_next) {
+		entries[count++] = entry;
+	}
+
+	return count;
+}
+
+void coursework::stats_printf(char *buffer, size_t size, size_t& pos, const char *fmt, ...)
+{
+	if (pos >= size) {
+		return;
+	}
+
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(buffer + pos, size - pos, fmt, args);
+	va_end(args);
+
+	if (n > 0) {
+		pos = std::min(pos + n, size);
+	}
+}
+
+/* The debug console is standard output */
+void coursework::console_write(const char *text, size_t size)
+{
+	fwrite(text, 1, size, stdout);
+}
+
+/* There is only one simulated CPU */
+unsigned int coursework::current_cpu()
+{
+	return 0;
+}
+
+unsigned int coursework::current_cpu_tsc(uint64_t& tsc)
+{
+	tsc = rdtsc();
+	return 0;
+}
+
+/**
+ * A fixed-seed xorshift generator, so that every run does the same work.
+ */
+struct SimRandom {
+	uint64_t state;
+
+	SimRandom(uint64_t seed) : state(seed ? seed : 1) {
+	}
+
+	uint64_t next() {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	/* Returns a number from min up to max, inclusive */
+	uint64_t range(uint64_t min, uint64_t max) {
+		return max > min ? min + (next() % (max - min + 1)) : min;
+	}
+};
+
+#define US	((uint64_t)1000)
+#define MS	(1000 * US)
+
+/**
+ * A simulated thread.  It arrives, and then alternates between using the CPU for
+ * a burst and sleeping, until it has used all the CPU time it needs.  Threads
+ * with a zero burst length never sleep.
+ */
+struct SimThread : public Thread {
+	enum State { NotArrived, Runnable, Sleeping, Done };
+
+	State state;
+	uint64_t arrival, work;
+
+	uint64_t burst_min, burst_max, sleep_min, sleep_max;
+	uint64_t remaining, burst_left;
+
+	// When the thread last became runnable, if it hasn't run since.
+	bool waiting;
+	uint64_t runnable_since;
+
+	uint64_t finish;
+
+	SimThread(uint64_t arrival, uint64_t work) : state(NotArrived), arrival(arrival), work(work),
+		burst_min(0), burst_max(0), sleep_min(0), sleep_max(0), remaining(work), burst_left(0),
+		waiting(false), runnable_since(0), finish(0) { }
+
+	void new_burst(SimRandom& random) {
+		burst_left = burst_max ? random.range(burst_min, burst_max) : remaining;
+	}
+};
+
+struct Workload {
+	const char *name;
+	const char *description;
+	void (*create)(std::vector<SimThread *>& threads, SimRandom& random);
+};
+
+static SimThread *add_thread(std::vector<SimThread *>& threads, uint64_t arrival, uint64_t work)
+{
+	SimThread *thread = new SimThread(arrival, work);
+	threads.push_back(thread);
+	return thread;
+}
+
+static void set_io(SimThread *thread, uint64_t burst_min, uint64_t burst_max, uint64_t sleep_min, uint64_t sleep_max)
+{
+	thread->burst_min = burst_min;
+	thread->burst_max = burst_max;
+	thread->sleep_min = sleep_min;
+	thread->sleep_max = sleep_max;
+}
+
+static void create_cpu(std::vector<SimThread *>& threads, SimRandom& random)
+{
+	for (unsigned int i = 0; i < 8; i++) {
+		add_thread(threads, 0, 500 * MS);
+	}
+}
+
+static void create_io(std::vector<SimThread *>& threads, SimRandom& random)
+{
+	for (unsigned int i = 0; i < 32; i++) {
+		set_io(add_thread(threads, 0, 100 * MS), 200 * US, 2 * MS, 1 * MS, 20 * MS);
+	}
+}
+
+static void create_mixed(std::vector<SimThread *>& threads, SimRandom& random)
+{
+	for (unsigned int i = 0; i < 4; i++) {
+		add_thread(threads, 0, 1000 * MS);
+	}
+
+	for (unsigned int i = 0; i < 16; i++) {
+		set_io(add_thread(threads, random.range(0, 50 * MS), 50 * MS), 100 * US, 1 * MS, 5 * MS, 30 * MS);
+	}
+}
+
+static void create_bursty(std::vector<SimThread *>& threads, SimRandom& random)
+{
+	for (unsigned int wave = 0; wave < 10; wave++) {
+		for (unsigned int i = 0; i < 50; i++) {
+			add_thread(threads, wave * 100 * MS + random.range(0, 1 * MS), random.range(1 * MS, 5 * MS));
+		}
+	}
+}
+
+static void create_many(std::vector<SimThread *>& threads, SimRandom& random)
+{
+	// Well past the 1024 entities scheduler state tables hold before they grow.
+	for (unsigned int i = 0; i < 4000; i++) {
+		SimThread *thread = add_thread(threads, random.range(0, 1000 * MS), random.range(1 * MS, 10 * MS));
+		if (i % 2) {
+			set_io(thread, 500 * US, 2 * MS, 1 * MS, 10 * MS);
+		}
+	}
+}
+
+static const Workload workloads[] = {
+	{ "cpu", "8 CPU-bound threads", create_cpu },
+	{ "io", "32 threads blocking at random", create_io },
+	{ "mixed", "4 CPU-bound threads against 16 interactive ones", create_mixed },
+	{ "bursty", "waves of 50 short jobs", create_bursty },
+	{ "many", "4000 short jobs, half of them blocking", create_many },
+};
+
+#define NR_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+struct Options {
+	uint64_t tick;
+	uint64_t seed;
+	uint64_t limit;
+	bool verbose;
+};
+
+static uint64_t host_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t percentile(std::vector<uint64_t>& values, unsigned int pct)
+{
+	if (values.empty()) {
+		return 0;
+	}
+
+	size_t index = (values.size() * pct) / 100;
+	return values[std::min(index, values.size() - 1)];
+}
+
+/**
+ * Runs one workload under one algorithm, and prints the results.
+ */
+static void simulate(SchedulingAlgorithm& algorithm, const Workload& workload, const Options& options)
+{
+	SimRandom random(options.seed);
+	std::vector<SimThread *> threads;
+	workload.create(threads, random);
+
+	// Arrivals and wakeups, earliest first.
+	typedef std::pair<uint64_t, SimThread *> Event;
+	std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+	for (SimThread *thread : threads) {
+		events.push(Event(thread->arrival, thread));
+	}
+
+	std::vector<uint64_t> responses, pick_times;
+	uint64_t now = 0, next_tick = options.tick;
+	uint64_t nr_picks = 0, nr_switches = 0;
+	unsigned int nr_done = 0;
+	SimThread *current = NULL;
+
+	algorithm.init();
+	sys.set_runtime(0);
+
+	while (nr_done < threads.size() && now < options.limit) {
+		// Run until the next thing happens.
+		uint64_t next = next_tick;
+		if (!events.empty()) {
+			next = std::min(next, events.top().first);
+		}
+		if (current) {
+			next = std::min(next, now + std::min(current->burst_left, current->remaining));
+		}
+
+		if (current) {
+			uint64_t ran = next - now;
+			current->increment_cpu_runtime(ran);
+			current->burst_left -= ran;
+			current->remaining -= ran;
+		}
+
+		now = next;
+		sys.set_runtime(now);
+
+		bool reschedule = false;
+
+		while (!events.empty() && events.top().first <= now) {
+			SimThread *thread = events.top().second;
+			events.pop();
+
+			thread->state = SimThread::Runnable;
+			thread->waiting = true;
+			thread->runnable_since = now;
+			thread->new_burst(random);
+
+			algorithm.add_to_runqueue(*thread);
+
+			// an idle CPU picks up new work straight away
+			reschedule |= (current == NULL);
+		}
+
+		if (current && current->remaining == 0) {
+			current->state = SimThread::Done;
+			current->finish = now;
+			current->set_stopped();
+			algorithm.remove_from_runqueue(*current);
+
+			nr_done++;
+			current = NULL;
+			reschedule = true;
+		} else if (current && current->burst_left == 0) {
+			current->state = SimThread::Sleeping;
+			algorithm.remove_from_runqueue(*current);
+			events.push(Event(now + random.range(current->sleep_min, current->sleep_max), current));
+
+			current = NULL;
+			reschedule = true;
+		}
+
+		if (now == next_tick) {
+			next_tick += options.tick;
+			reschedule = true;
+		}
+
+		if (!reschedule) {
+			continue;
+		}
+
+		Thread::set_current(current);
+
+		uint64_t start = host_ns();
+		SchedulingEntity *picked = algorithm.pick_next_entity();
+		pick_times.push_back(host_ns() - start);
+		nr_picks++;
+
+		SimThread *thread = (SimThread *)picked;
+		if (thread && thread->state != SimThread::Runnable) {
+			fprintf(stderr, "schedsim: %s picked a thread that can't run\n", algorithm.name());
+			thread = NULL;
+		}
+
+		if (thread != current) {
+			nr_switches++;
+		}
+
+		if (thread && thread->waiting) {
+			responses.push_back(now - thread->runnable_since);
+			thread->waiting = false;
+		}
+
+		current = thread;
+	}
+
+	// Work out the results, from the threads that finished.
+	std::vector<uint64_t> turnarounds;
+	double rate_sum = 0, rate_sq_sum = 0;
+
+	for (SimThread *thread : threads) {
+		if (thread->state != SimThread::Done) {
+			continue;
+		}
+
+		uint64_t turnaround = thread->finish - thread->arrival;
+		turnarounds.push_back(turnaround);
+
+		double rate = turnaround ? (double)thread->work / turnaround : 1;
+		rate_sum += rate;
+		rate_sq_sum += rate * rate;
+	}
+
+	std::sort(turnarounds.begin(), turnarounds.end());
+	std::sort(responses.begin(), responses.end());
+	std::sort(pick_times.begin(), pick_times.end());
+
+	uint64_t pick_total = 0;
+	for (uint64_t t : pick_times) {
+		pick_total += t;
+	}
+
+	uint64_t fairness = rate_sq_sum ? (uint64_t)(1000 * (rate_sum * rate_sum) / (turnarounds.size() * rate_sq_sum)) : 0;
+
+	printf("SIM %s %s threads=%zu completed=%u sim_ms=%lu turnaround_p50_us=%lu turnaround_p99_us=%lu "
+		"response_p50_us=%lu response_p90_us=%lu response_p99_us=%lu response_max_us=%lu "
+		"fairness_milli=%lu picks=%lu switches=%lu ns_per_pick=%lu pick_p99_ns=%lu\n",
+		workload.name, algorithm.name(), threads.size(), nr_done, now / MS,
+		percentile(turnarounds, 50) / US, percentile(turnarounds, 99) / US,
+		percentile(responses, 50) / US, percentile(responses, 90) / US, percentile(responses, 99) / US, percentile(responses, 100) / US,
+		fairness, nr_picks, nr_switches, nr_picks ? pick_total / nr_picks : 0, percentile(pick_times, 99));
+
+	if (options.verbose) {
+		StatsEntry *entries[64];
+		unsigned int nr_entries = StatsEntry::list(entries, 64);
+
+		for (unsigned int i = 0; i < nr_entries; i++) {
+			if (strcmp(entries[i]->name(), algorithm.name()) == 0) {
+				static char buffer[StatsEntry::MAX_SIZE + 1];
+				size_t n = entries[i]->read(buffer, StatsEntry::MAX_SIZE);
+				buffer[n] = 0;
+
+				printf("%s", buffer);
+			}
+		}
+	}
+
+	// Stop whatever didn't finish, so the algorithm (and the instrumentation
+	// shared between algorithms) lets go of it.
+	for (SimThread *thread : threads) {
+		if (thread->state != SimThread::Done) {
+			thread->set_stopped();
+			algorithm.remove_from_runqueue(*thread);
+		}
+
+		delete thread;
+	}
+}
+
+/**
+ * Checks whether a name is in a comma-separated list, where an empty list
+ * matches everything.
+ */
+static bool selected(const char *list, const char *name)
+{
+	if (!list) {
+		return true;
+	}
+
+	size_t len = strlen(name);
+	for (const char *p = list; *p; ) {
+		if (strncmp(p, name, len) == 0 && (p[len] == ',' || p[len] == 0)) {
+			return true;
+		}
+
+		while (*p && *p != ',') p++;
+		if (*p) p++;
+	}
+
+	return false;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: schedsim [-s algorithms] [-w workloads] [-t tick_us] [-r seed] [-l limit_s] [-o key=value]... [-v]\n\nalgorithms:");
+
+	for (const SchedulerRegistration *reg = SchedulerRegistration::first(); reg; reg = reg->next()) {
+		SchedulingAlgorithm *algorithm = reg->create();
+		fprintf(stderr, " %s", algorithm->name());
+		delete algorithm;
+	}
+
+	fprintf(stderr, "\nworkloads:\n");
+	for (unsigned int i = 0; i < NR_WORKLOADS; i++) {
+		fprintf(stderr, "  %-8s %s\n", workloads[i].name, workloads[i].description);
+	}
+
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	Options options = { 1 * MS, 1, 600000 * MS, false };
+	const char *algorithms = NULL, *workload_list = NULL;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:w:t:r:l:o:v")) != -1) {
+		switch (opt) {
+		case 's': algorithms = optarg; break;
+		case 'w': workload_list = optarg; break;
+		case 't': options.tick = strtoull(optarg, NULL, 0) * US; break;
+		case 'r': options.seed = strtoull(optarg, NULL, 0); break;
+		case 'l': options.limit = strtoull(optarg, NULL, 0) * 1000 * MS; break;
+		case 'v': options.verbose = true; break;
+
+		case 'o': {
+			char *value = strchr(optarg, '=');
+			if (!value) {
+				usage();
+			}
+
+			*value++ = 0;
+			if (!CmdLineArgument::set(optarg, value)) {
+				fprintf(stderr, "schedsim: unknown argument %s\n", optarg);
+				return 1;
+			}
+			break;
+		}
+
+		default:
+			usage();
+		}
+	}
+
+	if (options.tick == 0) {
+		usage();
+	}
+
+	for (unsigned int i = 0; i < NR_WORKLOADS; i++) {
+		if (!selected(workload_list, workloads[i].name)) {
+			continue;
+		}
+
+		for (const SchedulerRegistration *reg = SchedulerRegistration::first(); reg; reg = reg->next()) {
+			SchedulingAlgorithm *algorithm = reg->create();
+
+			if (selected(algorithms, algorithm->name())) {
+				simulate(*algorithm, workloads[i], options);
+			}
+
+			delete algorithm;
+		}
+	}
+
+	if (trace_categories) {
+		trace_drain();
+	}
+
+	return 0;
+}
@@ -0,0 +1,294 @@
+/*
+ * TAR File-system Compressed Archive Packer
+ *
+ * Converts a plain TAR file into the framed, LZ4-compressed format that TarFS
+ * can mount directly (see coursework/tarfs-lz4.h for the layout).
+ *
+ * usage: tarfs-pack [-f frame-size] [-c] input.tar output.tzf
+ *
+ *   -f   uncompressed size of each frame, a multiple of 4096 (default 64 KiB)
+ *   -c   check the output by decompressing every frame with the kernel's decoder
+ */
+
+/*
+ * STUDENT NUMBER: s1894401
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "../coursework/tarfs-lz4.h"
+
+#define BLOCK_SIZE 512
+
+// LZ4 block format constraints: the last five bytes are always literals, and
+// the last match must start at least twelve bytes before the end of the block.
+#define MIN_MATCH	4
+#define LAST_LITERALS	5
+#define MF_LIMIT	12
+#define MAX_DISTANCE	65535
+
+#define HASH_BITS	16
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t hash32(uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+/**
+ * Writes an LZ4 length extension, for lengths of fifteen or more.
+ */
+static bool write_length(uint8_t *& op, uint8_t *oend, size_t length)
+{
+	for (length -= 15; length >= 255; length -= 255) {
+		if (op >= oend) return false;
+		*op++ = 255;
+	}
+
+	if (op >= oend) return false;
+	*op++ = (uint8_t)length;
+	return true;
+}
+
+/**
+ * Emits one sequence: a run of literals, optionally followed by a match.
+ */
+static bool emit_sequence(uint8_t *& op, uint8_t *oend, const uint8_t *literals, size_t nr_literals, size_t offset, size_t match)
+{
+	if (op >= oend) return false;
+	uint8_t *token = op++;
+
+	*token = (nr_literals >= 15 ? 15 : nr_literals) << 4;
+	if (nr_literals >= 15 && !write_length(op, oend, nr_literals)) return false;
+
+	if ((size_t)(oend - op) < nr_literals) return false;
+	memcpy(op, literals, nr_literals);
+	op += nr_literals;
+
+	if (match == 0) return true;
+
+	if (oend - op < 2) return false;
+	*op++ = offset & 0xff;
+	*op++ = offset >> 8;
+
+	match -= MIN_MATCH;
+	*token |= (match >= 15 ? 15 : match);
+	if (match >= 15 && !write_length(op, oend, match)) return false;
+
+	return true;
+}
+
+/**
+ * A straightforward greedy LZ4 block compressor.  Returns the compressed size,
+ * or zero if the output would not fit in dst_len bytes.
+ */
+static size_t lz4_compress(const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len)
+{
+	std::vector<uint32_t> table(1 << HASH_BITS, 0);
+
+	uint8_t *op = dst, *oend = dst + dst_len;
+	size_t ip = 0, anchor = 0;
+
+	if (src_len > MF_LIMIT) {
+		size_t mf_limit = src_len - MF_LIMIT;
+		size_t match_limit = src_len - LAST_LITERALS;
+
+		while (ip < mf_limit) {
+			uint32_t seq = read32(src + ip);
+			uint32_t h = hash32(seq);
+
+			// Table entries are stored plus one, so that zero means empty.
+			size_t ref = table[h];
+			table[h] = ip + 1;
+
+			if (ref == 0 || ip - (ref - 1) > MAX_DISTANCE || read32(src + ref - 1) != seq) {
+				ip++;
+				continue;
+			}
+			ref--;
+
+			size_t length = MIN_MATCH;
+			while (ip + length < match_limit && src[ref + length] == src[ip + length]) {
+				length++;
+			}
+
+			if (!emit_sequence(op, oend, src + anchor, ip - anchor, ip - ref, length)) {
+				return 0;
+			}
+
+			ip += length;
+			anchor = ip;
+		}
+	}
+
+	if (!emit_sequence(op, oend, src + anchor, src_len - anchor, 0, 0)) {
+		return 0;
+	}
+
+	return op - dst;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-f frame-size] [-c] input.tar output.tzf\n", prog);
+	exit(1);
+}
+
+static bool read_file(const char *path, std::vector<uint8_t>& data)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		perror(path);
+		return false;
+	}
+
+	uint8_t buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+		data.insert(data.end(), buffer, buffer + n);
+	}
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t frame_size = TARFS_LZ4_DEFAULT_FRAME_SIZE;
+	bool check = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "f:c")) != -1) {
+		switch (opt) {
+		case 'f':
+			frame_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			check = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (argc - optind != 2) {
+		usage(argv[0]);
+	}
+
+	if (frame_size == 0 || (frame_size % 4096) != 0 || frame_size > 1024 * 1024) {
+		fprintf(stderr, "frame size must be a multiple of 4096, and no more than 1 MiB\n");
+		return 1;
+	}
+
+	std::vector<uint8_t> input;
+	if (!read_file(argv[optind], input)) {
+		return 1;
+	}
+
+	uint64_t nr_frames = (input.size() + frame_size - 1) / frame_size;
+	uint64_t index_size = nr_frames * sizeof(struct tarfs_lz4_frame);
+	uint64_t index_blocks = (index_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+	struct tarfs_lz4_superblock sb;
+	memset(&sb, 0, sizeof(sb));
+	memcpy(sb.magic, TARFS_LZ4_MAGIC, sizeof(sb.magic));
+	sb.version = TARFS_LZ4_VERSION;
+	sb.frame_size = frame_size;
+	sb.archive_size = input.size();
+	sb.nr_frames = nr_frames;
+	sb.index_offset = BLOCK_SIZE;
+
+	std::vector<struct tarfs_lz4_frame> index(nr_frames);
+	std::vector<uint8_t> frames;
+	std::vector<uint8_t> compressed(frame_size);
+
+	uint64_t offset = (1 + index_blocks) * BLOCK_SIZE;
+
+	for (uint64_t i = 0; i < nr_frames; i++) {
+		const uint8_t *src = input.data() + (i * frame_size);
+		size_t len = input.size() - (i * frame_size);
+		if (len > frame_size) len = frame_size;
+
+		// Anything that doesn't get smaller is stored as-is.
+		size_t clen = lz4_compress(src, len, compressed.data(), len - 1);
+
+		index[i].offset = offset;
+		index[i].flags = 0;
+
+		if (clen == 0) {
+			index[i].compressed_size = len;
+			index[i].flags |= TARFS_LZ4_FRAME_RAW;
+			frames.insert(frames.end(), src, src + len);
+		} else {
+			index[i].compressed_size = clen;
+			frames.insert(frames.end(), compressed.data(), compressed.data() + clen);
+		}
+
+		// Every frame starts on a block boundary.
+		size_t padded = (index[i].compressed_size + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+		frames.resize(frames.size() + padded - index[i].compressed_size, 0);
+		offset += padded;
+	}
+
+	if (check) {
+		std::vector<uint8_t> out(frame_size);
+		uint64_t frame_offset = (1 + index_blocks) * BLOCK_SIZE;
+
+		for (uint64_t i = 0; i < nr_frames; i++) {
+			const uint8_t *src = input.data() + (i * frame_size);
+			size_t len = input.size() - (i * frame_size);
+			if (len > frame_size) len = frame_size;
+
+			const uint8_t *stored = frames.data() + (index[i].offset - frame_offset);
+			if (index[i].flags & TARFS_LZ4_FRAME_RAW) {
+				memcpy(out.data(), stored, len);
+			} else if (tarfs_lz4_decompress(stored, index[i].compressed_size, out.data(), len) != (int)len) {
+				fprintf(stderr, "frame %lu: decompression failed\n", (unsigned long)i);
+				return 1;
+			}
+
+			if (memcmp(out.data(), src, len) != 0) {
+				fprintf(stderr, "frame %lu: contents differ after decompression\n", (unsigned long)i);
+				return 1;
+			}
+		}
+	}
+
+	FILE *f = fopen(argv[optind + 1], "wb");
+	if (!f) {
+		perror(argv[optind + 1]);
+		return 1;
+	}
+
+	std::vector<uint8_t> header((1 + index_blocks) * BLOCK_SIZE, 0);
+	memcpy(header.data(), &sb, sizeof(sb));
+	if (nr_frames) {
+		memcpy(header.data() + BLOCK_SIZE, index.data(), index_size);
+	}
+
+	bool ok = fwrite(header.data(), 1, header.size(), f) == header.size();
+	ok = ok && fwrite(frames.data(), 1, frames.size(), f) == frames.size();
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok) {
+		fprintf(stderr, "%s: write failed\n", argv[optind + 1]);
+		return 1;
+	}
+
+	uint64_t total = header.size() + frames.size();
+	printf("%s: %lu bytes -> %lu bytes in %lu frames (%.2fx)\n", argv[optind + 1],
+		(unsigned long)input.size(), (unsigned long)total, (unsigned long)nr_frames,
+		total ? (double)input.size() / total : 0.0);
+
+	return 0;
+}
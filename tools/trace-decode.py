@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+#
+# Decodes the kernel's event trace (the TRACE lines written to the debug console
+# by "echo drain > /.stats/trace") into one line per event, in time order:
+#
+#   <time> cpu<N> <event> <arg1> <arg2>
+#
+# usage: trace-decode.py [--hz tsc_hz] [--summary] [log ...]
+#
+# Times are TSC cycles since the first event, or microseconds with --hz (the
+# kernel's TSC frequency is tsc_hz in /.stats/clock).  --summary prints the
+# number of times each event happened instead.
+#
+
+#
+# STUDENT NUMBER: s1894401
+#
+
+import argparse
+import collections
+import struct
+import sys
+
+# The layout of a trace record: tsc, seq, event, arg1, arg2.
+RECORD = struct.Struct('<QIIQQ')
+
+
+def read_trace(files):
+    names = {}
+    events = []
+    lost = 0
+
+    for f in files:
+        for line in f:
+            fields = line.split()
+            if len(fields) < 2 or fields[0] != 'TRACE':
+                continue
+
+            if fields[1] == 'event' and len(fields) == 4:
+                names[int(fields[2])] = fields[3]
+            elif fields[1] == 'end':
+                for field in fields[2:]:
+                    key, _, value = field.partition('=')
+                    if key == 'lost':
+                        lost += int(value)
+            elif fields[1].isdigit() and len(fields) == 3:
+                tsc, seq, event, arg1, arg2 = RECORD.unpack(bytes.fromhex(fields[2]))
+                events.append((tsc, int(fields[1]), event, arg1, arg2))
+
+    events.sort()
+    return names, events, lost
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode kernel trace events.')
+    parser.add_argument('--hz', type=int, default=0, help='the TSC frequency, to print times in microseconds')
+    parser.add_argument('--summary', action='store_true', help='print the number of each event instead')
+    parser.add_argument('logs', nargs='*', help='debug console logs (default: standard input)')
+    args = parser.parse_args()
+
+    files = [open(name) for name in args.logs] or [sys.stdin]
+    names, events, lost = read_trace(files)
+
+    if args.summary:
+        counts = collections.Counter(names.get(e[2], 'event%u' % e[2]) for e in events)
+        for name, count in sorted(counts.items()):
+            print('%-20s %u' % (name, count))
+        print('%-20s %u' % ('lost', lost))
+        return
+
+    base = events[0][0] if events else 0
+    for tsc, cpu, event, arg1, arg2 in events:
+        if args.hz:
+            time = '%.3f' % (((tsc - base) * 1000000.0) / args.hz)
+        else:
+            time = '%u' % (tsc - base)
+
+        print('%s cpu%u %s 0x%x 0x%x' % (time, cpu, names.get(event, 'event%u' % event), arg1, arg2))
+
+    if lost:
+        print('%u events lost' % lost, file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()